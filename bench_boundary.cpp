@@ -0,0 +1,106 @@
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include "simplex.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+typedef simplex<int,2> triangle;
+typedef triangle::boundary_type edge;
+
+
+//! The boundary as simplicial_complex found it before, toggling a std::set.
+size_t set_boundary(const std::vector<triangle>& triangles)
+{
+    std::set<edge> bdry;
+    edge faces[3];
+    for (size_t t=0; t<triangles.size(); t++) {
+        detail::oriented_faces(triangles[t], faces);
+        for (int k=0; k<3; k++) {
+            auto elem=bdry.find(faces[k]);
+            if (elem==bdry.end()) {
+                bdry.insert(faces[k]);
+            } else {
+                bdry.erase(elem);
+            }
+        }
+    }
+    return bdry.size();
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t triangle_cnt;
+    po::options_description desc("Boundary of a triangulated grid.");
+    desc.add_options()
+        ("help","Time the boundary of a triangle mesh with a std::set, "
+            "with sort and cancel, and with a hash table.")
+        ("triangles",po::value<size_t>(&triangle_cnt)->default_value(10000000),
+            "about how many triangles")
+        ("shuffle","visit triangles in random order, not row by row")
+        ("skip-set","leave out the std::set, which is slow")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Two triangles per cell of a square grid, oriented alike.
+    size_t side=size_t(std::sqrt(triangle_cnt/2.0));
+    std::vector<triangle> triangles;
+    triangles.reserve(2*side*side);
+    for (size_t iy=0; iy<side; iy++) {
+        for (size_t ix=0; ix<side; ix++) {
+            int v=ix+iy*(side+1);
+            int lower[]={ v, v+1, v+int(side)+2 };
+            int upper[]={ v, v+int(side)+2, v+int(side)+1 };
+            triangle tri;
+            tri.assign(lower, 0);
+            triangles.push_back(tri);
+            tri.assign(upper, 0);
+            triangles.push_back(tri);
+        }
+    }
+    if (vm.count("shuffle")) {
+        std::mt19937 rng;
+        std::shuffle(triangles.begin(), triangles.end(), rng);
+    }
+    std::cout << "triangles " << triangles.size() << " expected boundary "
+              << 4*side << std::endl;
+
+    typedef boost::chrono::high_resolution_clock clock;
+    if (!vm.count("skip-set")) {
+        auto start=clock::now();
+        size_t cnt=set_boundary(triangles);
+        boost::chrono::duration<double> took=clock::now()-start;
+        std::cout << "set edges " << cnt << " seconds " << took.count()
+                  << std::endl;
+    }
+
+    std::vector<edge> bdry;
+    auto start=clock::now();
+    sorted_boundary(triangles.begin(), triangles.end(), bdry);
+    boost::chrono::duration<double> sorted=clock::now()-start;
+    std::cout << "sorted edges " << bdry.size() << " seconds "
+              << sorted.count() << std::endl;
+
+    start=clock::now();
+    hashed_boundary(triangles.begin(), triangles.end(), bdry);
+    boost::chrono::duration<double> hashed=clock::now()-start;
+    std::cout << "hashed edges " << bdry.size() << " seconds "
+              << hashed.count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include "disjoint_sets.hpp"
+#include "space_filling.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+/*! A hardware counter for this process, from perf_event_open.
+ *  Reads -1 where the kernel or a container does not allow it.
+ */
+class hardware_counter
+{
+    int fd_;
+public:
+    hardware_counter(uint64_t config) : fd_(-1)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type=PERF_TYPE_HARDWARE;
+        attr.size=sizeof(attr);
+        attr.config=config;
+        attr.disabled=1;
+        attr.exclude_kernel=1;
+        attr.exclude_hv=1;
+        fd_=syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~hardware_counter() { if (fd_>=0) close(fd_); }
+
+    void start()
+    {
+        if (fd_<0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop()
+    {
+        if (fd_<0) return -1;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        long long count=-1;
+        if (read(fd_, &count, sizeof(count))!=sizeof(count)) return -1;
+        return count;
+    }
+};
+
+
+
+/*! Cluster a raster whose land use is stored by cell id, joining
+ *  each cell with its east and north neighbors of the same use.
+ *  Returns the number of clusters.
+ */
+template<class INDEX>
+size_t cluster_by_id(const curve_numbering<INDEX>& ids,
+                     const std::vector<unsigned char>& use,
+                     dense_disjoint_sets<INDEX>& dset)
+{
+    size_t w=ids.width(), h=ids.height();
+    dset.reserve(w*h);
+    for (size_t id=0; id<w*h; id++) {
+        dset.make_set(id);
+    }
+    for (size_t id=0; id<w*h; id++) {
+        boost::array<size_t,2> xy=ids.cell(id);
+        if (xy[0]+1<w) {
+            size_t east=ids.id(xy[0]+1, xy[1]);
+            if (use[id]==use[east]) dset.union_set(id, east);
+        }
+        if (xy[1]+1<h) {
+            size_t north=ids.id(xy[0], xy[1]+1);
+            if (use[id]==use[north]) dset.union_set(id, north);
+        }
+    }
+    auto begin=boost::counting_iterator<size_t>(0);
+    auto end=boost::counting_iterator<size_t>(w*h);
+    dset.compress_sets(begin, end);
+    return dset.count_sets(begin, end);
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h, patch;
+    int use_cnt;
+    po::options_description desc("Clustering under each cell order.");
+    desc.add_options()
+        ("help","Time union-find clustering with row-major, Morton and "
+            "Hilbert cell ids, and count cache misses where allowed.")
+        ("width",po::value<size_t>(&w)->default_value(4096),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(4096),"raster height")
+        ("uses",po::value<int>(&use_cnt)->default_value(4),
+            "number of distinct land uses")
+        ("patch",po::value<size_t>(&patch)->default_value(64),
+            "typical patch size in cells, zero for independent cells")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Patches of one use with a little noise, like fields.
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_usage(0,use_cnt-1);
+    boost::uniform_int<int> rand_noise(0,19);
+    std::vector<unsigned char> use(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        size_t ix=cell%w, iy=cell/w;
+        if (patch==0 || rand_noise(rng)==0) {
+            use[cell]=rand_usage(rng);
+        } else {
+            use[cell]=(ix/patch+(iy/(patch/2+1))*7)%use_cnt;
+        }
+    }
+
+    typedef boost::chrono::high_resolution_clock clock;
+    const char* names[]={ "row-major", "morton", "hilbert" };
+    cell_order orders[]={ row_major_order, morton_order, hilbert_order };
+    hardware_counter misses(PERF_COUNT_HW_CACHE_MISSES);
+    hardware_counter references(PERF_COUNT_HW_CACHE_REFERENCES);
+    for (int o=0; o<3; o++) {
+        auto start=clock::now();
+        curve_numbering<unsigned int> ids(w, h, orders[o]);
+        std::vector<unsigned char> use_by_id(w*h);
+        ids.from_raster(&use[0], &use_by_id[0]);
+        boost::chrono::duration<double> numbering=clock::now()-start;
+
+        dense_disjoint_sets<unsigned int> dset;
+        start=clock::now();
+        misses.start();
+        references.start();
+        size_t cluster_cnt=cluster_by_id(ids, use_by_id, dset);
+        long long miss_cnt=misses.stop();
+        long long reference_cnt=references.stop();
+        boost::chrono::duration<double> clustering=clock::now()-start;
+
+        // Back to a raster for output.
+        start=clock::now();
+        std::vector<unsigned int> labels(w*h);
+        ids.to_raster(&dset.parents()[0], &labels[0]);
+        boost::chrono::duration<double> output=clock::now()-start;
+
+        std::cout << names[o] << " clusters " << cluster_cnt
+                  << " numbering seconds " << numbering.count()
+                  << " clustering seconds " << clustering.count()
+                  << " output seconds " << output.count();
+        if (miss_cnt>=0 && reference_cnt>0) {
+            std::cout << " cache misses " << miss_cnt << " miss rate "
+                      << double(miss_cnt)/reference_cnt;
+        } else {
+            std::cout << " cache misses unavailable";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include "hdf_io.hpp"
+
+namespace po = boost::program_options;
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h;
+    std::string filename;
+    po::options_description desc("Writing cluster ids to HDF5.");
+    desc.add_options()
+        ("help","Time row, whole-chunk and compressed writes.")
+        ("width",po::value<size_t>(&w)->default_value(8192),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(8192),"raster height")
+        ("file",po::value<std::string>(&filename)->default_value(
+            "bench_hdf_write.h5"),"scratch file, removed afterwards")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Cluster ids are constant over patches, as they are in land use.
+    std::vector<int> labels(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        labels[cell]=(cell%w)/50+((cell/w)/50)*(w/50+1);
+    }
+
+    typedef boost::chrono::high_resolution_clock clock;
+    double megabytes=w*h*sizeof(int)/1e6;
+    const char* names[]={ "rows", "chunks", "deflate" };
+    for (int method=0; method<3; method++) {
+        auto start=clock::now();
+        {
+            HDF_cluster_grid_file out(filename, w, h, method==2 ? 1 : 0);
+            if (method==0) {
+                size_t strip=out.chunk_size()[0];
+                for (size_t y0=0; y0<h; y0+=strip) {
+                    out.write_rows(y0, std::min(strip, h-y0), &labels[y0*w]);
+                }
+            } else {
+                out.write_grid(&labels[0]);
+            }
+        }
+        boost::chrono::duration<double> elapsed=clock::now()-start;
+        std::cout << names[method] << " seconds " << elapsed.count()
+                  << " MB/s " << megabytes/elapsed.count() << std::endl;
+    }
+    std::remove(filename.c_str());
+    return 0;
+}
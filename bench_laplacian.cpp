@@ -0,0 +1,76 @@
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include "CGAL/Simple_cartesian.h"
+#include "tbb/task_arena.h"
+#include "hodge_star.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+typedef CGAL::Simple_cartesian<double> Kernel;
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h;
+    int steps, threads;
+    po::options_description desc("Laplacian sparse matrix-vector product.");
+    desc.add_options()
+        ("help","Time applying the grid Laplacian to a vertex field.")
+        ("width",po::value<size_t>(&w)->default_value(4096),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(4096),"raster height")
+        ("steps",po::value<int>(&steps)->default_value(20),
+            "number of products to time")
+        ("threads",po::value<int>(&threads)->default_value(
+            tbb::this_task_arena::max_concurrency()), "thread count")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    boost::array<double,6> xform = {{ 500000, 30, 0, 4100000, 0, -30 }};
+    quad_mesh<Kernel> mesh(w, h, grid_geometry(xform));
+
+    typedef boost::chrono::high_resolution_clock clock;
+    typedef boost::chrono::duration<double> seconds;
+
+    tbb::task_arena arena(threads);
+    diagonal_hodge hodge;
+    csr_matrix<> laplacian;
+    auto start=clock::now();
+    arena.execute([&] {
+        grid_hodge_stars(mesh, hodge);
+        grid_laplacian(mesh, hodge, laplacian);
+    });
+    seconds assembly=clock::now()-start;
+
+    std::vector<double> u(laplacian.cols, 1.0), lu(laplacian.rows);
+    for (size_t v=0; v<u.size(); v+=7) {
+        u[v]=2.0;
+    }
+    start=clock::now();
+    arena.execute([&] {
+        for (int step=0; step<steps; step++) {
+            laplacian.multiply(&u[0], &lu[0]);
+        }
+    });
+    seconds elapsed=clock::now()-start;
+
+    // Each product reads the matrix and both vectors once.
+    double bytes=laplacian.bytes()
+        + (laplacian.cols+laplacian.rows)*sizeof(double);
+    double per_step=elapsed.count()/steps;
+    std::cout << "vertices " << laplacian.rows << " nonzeros "
+              << laplacian.nnz() << " assembly seconds " << assembly.count()
+              << std::endl;
+    std::cout << "threads " << threads << " seconds per product " << per_step
+              << " GFLOP/s " << 2*laplacian.nnz()/per_step/1e9
+              << " GB/s " << bytes/per_step/1e9 << std::endl;
+    return 0;
+}
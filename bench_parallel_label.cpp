@@ -0,0 +1,98 @@
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include "tbb/task_arena.h"
+#include "parallel_label.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+/*! Land use in patches, so that clusters are large and cross tiles.
+ *  Each patch x patch square gets one random use, and then single
+ *  cells are changed at random to break up the squares.
+ */
+std::vector<unsigned char> patchy_land(size_t w, size_t h, size_t patch,
+                                       int use_cnt)
+{
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_usage(1,use_cnt);
+    boost::uniform_int<int> rand_noise(0,9);
+    size_t patch_w=(w+patch-1)/patch;
+    std::vector<unsigned char> patches(patch_w*((h+patch-1)/patch));
+    for (size_t i=0; i<patches.size(); i++) {
+        patches[i]=rand_usage(rng);
+    }
+    std::vector<unsigned char> use(w*h);
+    for (size_t iy=0; iy<h; iy++) {
+        for (size_t ix=0; ix<w; ix++) {
+            use[ix+iy*w]=patches[ix/patch+(iy/patch)*patch_w];
+            if (rand_noise(rng)==0) {
+                use[ix+iy*w]=rand_usage(rng);
+            }
+        }
+    }
+    return use;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h, tile, patch;
+    int max_threads;
+    po::options_description desc("Scaling of parallel cluster labeling.");
+    desc.add_options()
+        ("help","Time parallel_label_raster for 1 to N threads.")
+        ("width",po::value<size_t>(&w)->default_value(8192),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(8192),"raster height")
+        ("tile",po::value<size_t>(&tile)->default_value(256),
+            "tile width and height, like a GDAL block")
+        ("patch",po::value<size_t>(&patch)->default_value(37),
+            "size of patches of land use")
+        ("threads",po::value<int>(&max_threads)->default_value(
+            tbb::this_task_arena::max_concurrency()), "largest thread count")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    std::vector<unsigned char> use=patchy_land(w, h, patch, 4);
+    raster_values_equal<unsigned char> compare(use.data());
+
+    typedef boost::chrono::high_resolution_clock clock;
+    std::vector<unsigned int> labels;
+    auto start=clock::now();
+    label_raster(w, h, compare, labels);
+    boost::chrono::duration<double> serial=clock::now()-start;
+    std::cout << "serial seconds " << serial.count() << std::endl;
+
+    std::vector<int> thread_cnts;
+    for (int threads=1; threads<max_threads; threads*=2) {
+        thread_cnts.push_back(threads);
+    }
+    thread_cnts.push_back(max_threads);
+
+    std::vector<unsigned int> parallel_labels;
+    for (auto threads=thread_cnts.begin(); threads!=thread_cnts.end();
+         threads++) {
+        start=clock::now();
+        parallel_label_raster(w, h, tile, tile, compare, parallel_labels,
+                              *threads);
+        boost::chrono::duration<double> elapsed=clock::now()-start;
+        std::cout << "threads " << *threads << " seconds " << elapsed.count()
+                  << " speedup " << serial.count()/elapsed.count()
+                  << " Mcells/s " << (w*h)/elapsed.count()/1e6
+                  << (parallel_labels==labels ? "" : " MISMATCH")
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include "gdal/gdal_priv.h"
+#include "gdal/cpl_string.h"
+#include "gdal_io.hpp"
+#include "prefetch_reader.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+/*! Writes a tiled, deflated byte GeoTIFF of patches with noise, so
+ *  blocks cost about what land use costs to decompress.
+ */
+void write_test_tiff(const std::string& filename, size_t w, size_t h)
+{
+    GDALAllRegister();
+    GDALDriver* driver=GetGDALDriverManager()->GetDriverByName("GTiff");
+    char** options=0;
+    options=CSLSetNameValue(options, "TILED", "YES");
+    options=CSLSetNameValue(options, "BLOCKXSIZE", "256");
+    options=CSLSetNameValue(options, "BLOCKYSIZE", "256");
+    options=CSLSetNameValue(options, "COMPRESS", "DEFLATE");
+    GDALDataset* dataset=driver->Create(filename.c_str(), w, h, 1, GDT_Byte,
+                                        options);
+    CSLDestroy(options);
+    if (0==dataset) {
+        throw std::runtime_error("Could not create "+filename);
+    }
+    std::vector<unsigned char> row(w);
+    unsigned int noise=12345;
+    for (size_t iy=0; iy<h; iy++) {
+        for (size_t ix=0; ix<w; ix++) {
+            noise=noise*1103515245+12345;
+            row[ix]=(ix/40+iy/30)%7+((noise>>16)%16==0);
+        }
+        CPLErr err=dataset->GetRasterBand(1)->RasterIO(GF_Write, 0, iy, w, 1,
+                                    &row[0], w, 1, GDT_Byte, 0, 0);
+        if (err!=CE_None) {
+            throw std::runtime_error("Could not write "+filename);
+        }
+    }
+    GDALClose(dataset);
+}
+
+
+
+/*! Stands in for labeling or mesh building: work rounds of
+ *  arithmetic per pixel and a pass over the coordinates.
+ */
+size_t consume(const raster_block& block, size_t block_w, size_t work)
+{
+    size_t sum=0;
+    for (size_t iy=0; iy<block.extent[3]; iy++) {
+        for (size_t ix=0; ix<block.extent[2]; ix++) {
+            size_t v=block.pixels[ix+iy*block_w];
+            for (size_t r=0; r<work; r++) {
+                v=v*2654435761u+r;
+            }
+            sum+=v;
+        }
+    }
+    for (size_t i=0; i<block.x.size(); i++) {
+        sum+=size_t(block.x[i]+block.y[i]);
+    }
+    return sum;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h, in_flight, workers, work;
+    std::string filename;
+    po::options_description desc("Prefetching blocks of a compressed GeoTIFF.");
+    desc.add_options()
+        ("help","Time a consumer with synchronous and prefetched reads.")
+        ("file",po::value<std::string>(&filename),
+            "GeoTIFF to read. Without it, one is written and removed.")
+        ("width",po::value<size_t>(&w)->default_value(8192),
+            "width of the written raster")
+        ("height",po::value<size_t>(&h)->default_value(8192),
+            "height of the written raster")
+        ("in-flight",po::value<size_t>(&in_flight)->default_value(8),
+            "blocks decoded ahead of the consumer")
+        ("workers",po::value<size_t>(&workers)->default_value(
+            std::max<unsigned>(std::thread::hardware_concurrency(), 2)-1),
+            "decoding threads")
+        ("work",po::value<size_t>(&work)->default_value(4),
+            "rounds of consumer arithmetic per pixel")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    bool written=!vm.count("file");
+    if (written) {
+        filename="bench_prefetch.tif";
+        write_test_tiff(filename, w, h);
+    }
+
+    typedef boost::chrono::high_resolution_clock clock;
+    gdal_file reader(filename);
+    boost::array<size_t,2> count=reader.block_count();
+    size_t block_w=reader.block_size()[0];
+    size_t checksum[2]={ 0, 0 };
+
+    // Decode, then consume, one block at a time.
+    double decode_seconds=0;
+    auto start=clock::now();
+    {
+        gdal_block_decoder decode(filename, true);
+        raster_block block;
+        for (size_t by=0; by<count[1]; by++) {
+            for (size_t bx=0; bx<count[0]; bx++) {
+                auto decode_start=clock::now();
+                decode(bx, by, block);
+                boost::chrono::duration<double> d=clock::now()-decode_start;
+                decode_seconds+=d.count();
+                checksum[0]+=consume(block, block_w, work);
+            }
+        }
+    }
+    boost::chrono::duration<double> serial=clock::now()-start;
+
+    start=clock::now();
+    double wait_seconds;
+    {
+        block_prefetcher<gdal_block_decoder> prefetch(count[0], count[1],
+            in_flight, workers, gdal_decoder_factory(filename, true));
+        while (const raster_block* block=prefetch.next()) {
+            checksum[1]+=consume(*block, block_w, work);
+        }
+        wait_seconds=prefetch.wait_seconds();
+    }
+    boost::chrono::duration<double> overlapped=clock::now()-start;
+
+    std::cout << "blocks " << count[0]*count[1] << std::endl;
+    std::cout << "synchronous seconds " << serial.count()
+              << " of which decoding " << decode_seconds << std::endl;
+    std::cout << "prefetched seconds " << overlapped.count()
+              << " consumer waited " << wait_seconds << std::endl;
+    std::cout << "speedup " << serial.count()/overlapped.count() << std::endl;
+    if (checksum[0]!=checksum[1]) {
+        std::cout << "checksums differ" << std::endl;
+    }
+    if (written) {
+        std::remove(filename.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/property_map/property_map.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include "geo_polyhedron.hpp"
+#include "union_find.hpp"
+#include "quad_complex.hpp"
+#include "generate_land.hpp"
+#include "quad_mesh.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+/*! Bytes in a Polyhedron's vertex, halfedge and facet records.
+ *  The default HalfedgeDS keeps each record in an in-place list,
+ *  which adds two pointers per record.
+ */
+size_t polyhedron_bytes(const Polyhedron& P)
+{
+    size_t link=2*sizeof(void*);
+    return P.size_of_vertices()*(sizeof(Polyhedron::Vertex)+link)
+        + P.size_of_halfedges()*(sizeof(Polyhedron::Halfedge)+link)
+        + P.size_of_facets()*(sizeof(Polyhedron::Facet)+link);
+}
+
+
+
+//! Sum over facets of neighbor ids, so the traversal is not optimized away.
+template<class MESH>
+size_t walk_neighbors(const MESH& mesh)
+{
+    size_t total=0;
+    for (auto f=mesh.facets_begin(); f!=mesh.facets_end(); ++f) {
+        auto h=f->facet_begin();
+        do {
+            if (!h->opposite()->is_border()) {
+                total+=h->opposite()->facet()->id();
+            }
+        } while (++h!=f->facet_begin());
+    }
+    return total;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h;
+    po::options_description desc("Polyhedron against quad_mesh.");
+    desc.add_options()
+        ("help","Time building, traversing and clustering a grid.")
+        ("width",po::value<size_t>(&w)->default_value(1000),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(1000),"raster height")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,4);
+    std::vector<unsigned char> land_use(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        land_use[cell]=rand_usage(rng);
+    }
+    typedef boost::iterator_property_map<std::vector<unsigned char>::iterator,
+        boost::identity_property_map> use_map_type;
+    use_map_type land_use_map(land_use.begin(), boost::identity_property_map());
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+    auto id_begin=boost::counting_iterator<size_t>(0);
+    auto id_end=boost::counting_iterator<size_t>(w*h);
+
+    typedef boost::chrono::high_resolution_clock clock;
+    typedef boost::chrono::duration<double> seconds;
+
+    auto start=clock::now();
+    Polyhedron P;
+    Build_grid<Polyhedron::HalfedgeDS> build_grid(w,h);
+    P.delegate(build_grid);
+    seconds poly_build=clock::now()-start;
+
+    start=clock::now();
+    quad_mesh<Kernel> mesh(w,h);
+    seconds mesh_build=clock::now()-start;
+
+    start=clock::now();
+    size_t poly_sum=walk_neighbors(P);
+    seconds poly_walk=clock::now()-start;
+    start=clock::now();
+    size_t mesh_sum=walk_neighbors(mesh);
+    seconds mesh_walk=clock::now()-start;
+
+    start=clock::now();
+    disjoint_set_cluster<Polyhedron,compare_type,dense_disjoint_sets<>>
+        poly_cluster(comparison);
+    poly_cluster(P);
+    seconds poly_time=clock::now()-start;
+    start=clock::now();
+    disjoint_set_cluster<quad_mesh<Kernel>,compare_type,dense_disjoint_sets<>>
+        mesh_cluster(comparison);
+    mesh_cluster(mesh);
+    seconds mesh_time=clock::now()-start;
+
+    double mcells=w*h/1e6;
+    std::cout << "polyhedron bytes " << polyhedron_bytes(P)
+              << " build seconds " << poly_build.count()
+              << " neighbor Mcells/s " << mcells/poly_walk.count()
+              << " cluster Mcells/s " << mcells/poly_time.count() << std::endl;
+    std::cout << "quad_mesh bytes " << mesh.memory_bytes()
+              << " build seconds " << mesh_build.count()
+              << " neighbor Mcells/s " << mcells/mesh_walk.count()
+              << " cluster Mcells/s " << mcells/mesh_time.count() << std::endl;
+    if (poly_sum!=mesh_sum
+        || poly_cluster.dset_.count_sets(id_begin,id_end)
+           !=mesh_cluster.dset_.count_sets(id_begin,id_end)) {
+        std::cout << "MISMATCH" << std::endl;
+        return 1;
+    }
+    return 0;
+}
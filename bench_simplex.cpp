@@ -0,0 +1,157 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include "simplex.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+typedef boost::chrono::high_resolution_clock clock_type;
+
+
+//! Sorting as simplex::assign did before, with insertion sort.
+template<class T, int M>
+void insertion_assign(simplex<T,M>& s, const T* begin)
+{
+    std::copy_n(begin, M+1, s.begin());
+    int reorder_parity=0;
+    for (int i=1; i<M+1; i++) {
+        for (int j=i; j>0 && s[j]<s[j-1]; j--) {
+            std::swap(s[j], s[j-1]);
+            reorder_parity^=1;
+        }
+    }
+    s.parity=reorder_parity;
+}
+
+
+
+/*! Faces as boundary_iterator_t made them before, copying all but one
+ *  vertex and sorting the copy again on each step.
+ */
+template<class T, int M>
+void rebuilt_faces(const simplex<T,M>& s,
+                   typename simplex<T,M>::boundary_type* faces)
+{
+    for (int omit=0; omit<M+1; omit++) {
+        T rest[M];
+        for (int v=0, k=0; v<M+1; v++) {
+            if (v!=omit) rest[k++]=s[v];
+        }
+        faces[omit].assign(rest, s.parity^(omit&1));
+    }
+}
+
+
+
+//! Seconds per million calls, for each way of sorting and of faces.
+template<int M>
+void time_dimension(const std::vector<int>& values, size_t repeat)
+{
+    size_t n=values.size()/(M+1);
+    std::vector<simplex<int,M>> simplices(n);
+    long checksum=0;
+
+    auto start=clock_type::now();
+    for (size_t r=0; r<repeat; r++) {
+        for (size_t i=0; i<n; i++) {
+            insertion_assign(simplices[i], &values[i*(M+1)]);
+            checksum+=simplices[i].parity;
+        }
+    }
+    boost::chrono::duration<double> insertion=clock_type::now()-start;
+
+    start=clock_type::now();
+    for (size_t r=0; r<repeat; r++) {
+        for (size_t i=0; i<n; i++) {
+            simplices[i].assign2(&values[i*(M+1)]);
+            checksum+=simplices[i].parity;
+        }
+    }
+    boost::chrono::duration<double> pydec=clock_type::now()-start;
+
+    start=clock_type::now();
+    for (size_t r=0; r<repeat; r++) {
+        for (size_t i=0; i<n; i++) {
+            simplices[i].assign(&values[i*(M+1)]);
+            checksum+=simplices[i].parity;
+        }
+    }
+    boost::chrono::duration<double> network=clock_type::now()-start;
+
+    double per=1e6/double(n*repeat);
+    std::cout << "M=" << M << " assign insertion " << insertion.count()*per
+              << " assign2 " << pydec.count()*per
+              << " network " << network.count()*per;
+
+    if (M>0) {
+        typename simplex<int,M>::boundary_type faces[M+1];
+        start=clock_type::now();
+        for (size_t r=0; r<repeat; r++) {
+            for (size_t i=0; i<n; i++) {
+                rebuilt_faces(simplices[i], faces);
+                checksum+=faces[M].parity+faces[0][0];
+            }
+        }
+        boost::chrono::duration<double> rebuilt=clock_type::now()-start;
+
+        start=clock_type::now();
+        for (size_t r=0; r<repeat; r++) {
+            for (size_t i=0; i<n; i++) {
+                auto range=simplices[i].boundary();
+                std::copy(range.first, range.second, faces);
+                checksum+=faces[M].parity+faces[0][0];
+            }
+        }
+        boost::chrono::duration<double> tabled=clock_type::now()-start;
+        std::cout << " faces rebuilt " << rebuilt.count()*per
+                  << " tabled " << tabled.count()*per;
+    }
+    std::cout << " (checksum " << checksum << ")" << std::endl;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t simplex_cnt, repeat;
+    po::options_description desc("Sorting and faces of small simplices.");
+    desc.add_options()
+        ("help","Time simplex assignment and boundary for M=0 to 3, "
+            "reporting seconds per million simplices.")
+        ("simplices",po::value<size_t>(&simplex_cnt)->default_value(100000),
+            "simplices per pass, small enough to stay in cache")
+        ("repeat",po::value<size_t>(&repeat)->default_value(100),
+            "passes over the simplices")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Distinct vertices in random order, as a mesh reader hands them out.
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_vertex(0, 1<<30);
+    std::vector<int> values(4*simplex_cnt);
+    for (size_t i=0; i<simplex_cnt; i++) {
+        int* v=&values[4*i];
+        do {
+            for (int k=0; k<4; k++) v[k]=rand_vertex(rng);
+        } while (v[0]==v[1] || v[0]==v[2] || v[0]==v[3]
+                 || v[1]==v[2] || v[1]==v[3] || v[2]==v[3]);
+    }
+
+    time_dimension<0>(values, repeat);
+    time_dimension<1>(values, repeat);
+    time_dimension<2>(values, repeat);
+    time_dimension<3>(values, repeat);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_map/property_map.hpp>
+#include "tbb/task_arena.h"
+#include "stencil.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h, tile_w, tile_h, steps;
+    int threads;
+    po::options_description desc("Advection-diffusion stencil throughput.");
+    desc.add_options()
+        ("help","Time explicit steps with and without temporal blocking.")
+        ("width",po::value<size_t>(&w)->default_value(4096),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(4096),"raster height")
+        ("tile-width",po::value<size_t>(&tile_w)->default_value(512),
+            "tile width in cells")
+        ("tile-height",po::value<size_t>(&tile_h)->default_value(64),
+            "tile height in cells")
+        ("steps",po::value<size_t>(&steps)->default_value(48),
+            "time steps to take")
+        ("threads",po::value<int>(&threads)->default_value(
+            tbb::this_task_arena::max_concurrency()), "thread count")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Four land uses, in stripes, with different diffusivities.
+    std::vector<double> diffusivity(w*h);
+    double use_diffusivity[4]={ 0.0, 0.05, 0.1, 0.2 };
+    for (size_t cell=0; cell<w*h; cell++) {
+        diffusivity[cell]=use_diffusivity[(cell%w/97+cell/w/61)%4];
+    }
+    typedef boost::iterator_property_map<std::vector<double>::iterator,
+        boost::identity_property_map> diffusivity_map;
+    diffusivity_map coefficients(diffusivity.begin(),
+                                 boost::identity_property_map());
+    boost::array<double,2> velocity = {{ 0.1, 0.05 }};
+
+    std::vector<float> density(w*h, 0);
+    for (size_t cell=0; cell<w*h; cell+=101) {
+        density[cell]=1;
+    }
+
+    typedef boost::chrono::high_resolution_clock clock;
+    tbb::task_arena arena(threads);
+    diffusion_stencil<float> stencil(w, h, coefficients, grid_geometry(),
+                                     1.0, velocity);
+    if (!stencil.is_stable()) {
+        std::cout << "time step is unstable" << std::endl;
+    }
+
+    size_t blocks[]={ 1, 2, 4, 8 };
+    for (size_t b=0; b<sizeof(blocks)/sizeof(size_t); b++) {
+        stencil.load(&density[0]);
+        stencil.set_blocking(tile_w, tile_h, blocks[b]);
+        auto start=clock::now();
+        arena.execute([&] { stencil.advance(steps); });
+        boost::chrono::duration<double> elapsed=clock::now()-start;
+
+        // Unblocked steps read the field and two coefficient arrays and
+        // write the field, so this is the bandwidth they would need.
+        double cell_steps=double(w*h)*steps;
+        double bytes=cell_steps*4*sizeof(float);
+        std::cout << "time block " << blocks[b] << " seconds "
+                  << elapsed.count() << " GFLOP/s "
+                  << cell_steps*diffusion_stencil<float>::flops_per_cell
+                     /elapsed.count()/1e9
+                  << " effective GB/s " << bytes/elapsed.count()/1e9
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include "disjoint_sets.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+/*! Cluster a w x h raster of land uses the way disjoint_set_cluster
+ *  does, by making a set for every cell and joining each cell with
+ *  its east and north neighbors when they have the same use.
+ *  Returns the number of clusters.
+ */
+template<class DSET>
+size_t cluster_raster(DSET& dset, const std::vector<unsigned char>& use,
+                      size_t w, size_t h)
+{
+    dset.reserve(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        dset.make_set(cell);
+    }
+    for (size_t iy=0; iy<h; iy++) {
+        for (size_t ix=0; ix<w; ix++) {
+            size_t cell=ix+iy*w;
+            if (ix+1<w && use[cell]==use[cell+1]) {
+                dset.union_set(cell, cell+1);
+            }
+            if (iy+1<h && use[cell]==use[cell+w]) {
+                dset.union_set(cell, cell+w);
+            }
+        }
+    }
+    auto begin=boost::counting_iterator<size_t>(0);
+    auto end=boost::counting_iterator<size_t>(w*h);
+    dset.compress_sets(begin, end);
+    return dset.count_sets(begin, end);
+}
+
+
+
+template<class DSET>
+void time_back_end(const std::string& name,
+                   const std::vector<unsigned char>& use, size_t w, size_t h)
+{
+    typedef boost::chrono::high_resolution_clock clock;
+    DSET dset;
+    auto start=clock::now();
+    size_t cluster_cnt=cluster_raster(dset, use, w, h);
+    boost::chrono::duration<double> elapsed=clock::now()-start;
+    std::cout << name << " clusters " << cluster_cnt << " seconds "
+              << elapsed.count() << " Mcells/s "
+              << (w*h)/elapsed.count()/1e6 << std::endl;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h;
+    int use_cnt;
+    po::options_description desc("Compare union-find back ends.");
+    desc.add_options()
+        ("help","Time hashed and dense union-find on a random raster.")
+        ("width",po::value<size_t>(&w)->default_value(2000),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(2000),"raster height")
+        ("uses",po::value<int>(&use_cnt)->default_value(4),
+            "number of distinct land uses")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_usage(1,use_cnt);
+    std::vector<unsigned char> use(w*h);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        use[gen_idx]=rand_usage(rng);
+    }
+
+    time_back_end<hashed_disjoint_sets>("hashed", use, w, h);
+    time_back_end<dense_disjoint_sets<>>("dense", use, w, h);
+    time_back_end<dense_disjoint_sets<unsigned int>>("dense32", use, w, h);
+    return 0;
+}
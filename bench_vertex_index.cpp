@@ -0,0 +1,101 @@
+#include <iostream>
+#include <map>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include "paged_index.hpp"
+
+using namespace geodec;
+namespace po = boost::program_options;
+
+
+//! The std::map that add_from_file used before.
+struct map_index
+{
+    std::map<size_t,size_t> ids;
+    bool contains(size_t id) const { return ids.find(id)!=ids.end(); }
+    size_t find(size_t id) const { return ids.find(id)->second; }
+    void set(size_t id, size_t index) { ids[id]=index; }
+};
+
+
+
+/*! Look up vertices the way add_from_file does as gdal_file reads
+ *  blocks in row-major order: add each vertex of a block unless a
+ *  neighbor added it, then look up the four corners of each facet.
+ */
+template<class INDEX>
+size_t build(INDEX& index, size_t w, size_t h, size_t block)
+{
+    size_t running=0, sum=0;
+    for (size_t by=0; by<h; by+=block) {
+        for (size_t bx=0; bx<w; bx+=block) {
+            size_t bw=std::min(block, w-bx), bh=std::min(block, h-by);
+            for (size_t iy=by; iy<=by+bh; iy++) {
+                for (size_t ix=bx; ix<=bx+bw; ix++) {
+                    size_t id=ix+iy*(w+1);
+                    if (!index.contains(id)) {
+                        index.set(id, running++);
+                    }
+                }
+            }
+            for (size_t py=by; py<by+bh; py++) {
+                for (size_t px=bx; px<bx+bw; px++) {
+                    size_t v=px+py*(w+1);
+                    sum+=index.find(v)+index.find(v+1)
+                        +index.find(v+w+2)+index.find(v+w+1);
+                }
+            }
+        }
+    }
+    return sum;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    size_t w, h, block;
+    po::options_description desc("Vertex id lookup while building a mesh.");
+    desc.add_options()
+        ("help","Time std::map against paged_index for add_from_file.")
+        ("width",po::value<size_t>(&w)->default_value(4096),"raster width")
+        ("height",po::value<size_t>(&h)->default_value(4096),"raster height")
+        ("block",po::value<size_t>(&block)->default_value(256),"block side")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    typedef boost::chrono::high_resolution_clock clock;
+    auto start=clock::now();
+    size_t map_sum;
+    {
+        map_index index;
+        map_sum=build(index, w, h, block);
+    }
+    boost::chrono::duration<double> tree=clock::now()-start;
+
+    start=clock::now();
+    size_t paged_sum;
+    size_t bytes;
+    {
+        paged_index<size_t> index;
+        paged_sum=build(index, w, h, block);
+        bytes=index.page_bytes();
+    }
+    boost::chrono::duration<double> paged=clock::now()-start;
+
+    std::cout << "map seconds " << tree.count() << std::endl;
+    std::cout << "paged seconds " << paged.count() << " page bytes "
+              << bytes << std::endl;
+    std::cout << "speedup " << tree.count()/paged.count() << std::endl;
+    if (map_sum!=paged_sum) {
+        std::cout << "lookups differ" << std::endl;
+    }
+    return 0;
+}
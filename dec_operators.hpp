@@ -0,0 +1,398 @@
+#ifndef _DEC_OPERATORS_HPP_
+#define _DEC_OPERATORS_HPP_ 1
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <iterator>
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+#include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "simplex.hpp"
+#include "quad_mesh.hpp"
+
+
+namespace geodec
+{
+
+    /*! A sparse matrix in compressed sparse row form.
+     *  Row r has entries offsets[r] to offsets[r+1] in columns and
+     *  values, with columns in increasing order. INDEX is unsigned int
+     *  by default, which halves the index storage and holds the four
+     *  billion entries of d1 on a 10^9 cell raster.
+     */
+    template<class VALUE=double, class INDEX=unsigned int>
+    struct csr_matrix
+    {
+        typedef VALUE value_type;
+        typedef INDEX index_type;
+
+        size_t rows;
+        size_t cols;
+        std::vector<INDEX> offsets;
+        std::vector<INDEX> columns;
+        std::vector<VALUE> values;
+
+        csr_matrix() : rows(0), cols(0) {}
+
+        size_t nnz() const { return columns.size(); }
+
+        size_t bytes() const
+        {
+            return offsets.size()*sizeof(INDEX)
+                + columns.size()*sizeof(INDEX) + values.size()*sizeof(VALUE);
+        }
+
+        //! y = A x, with rows divided among TBB threads.
+        void multiply(const VALUE* x, VALUE* y) const
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+                [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t r=range.begin(); r!=range.end(); r++) {
+                    VALUE sum=0;
+                    for (INDEX k=offsets[r]; k<offsets[r+1]; k++) {
+                        sum+=values[k]*x[columns[k]];
+                    }
+                    y[r]=sum;
+                }
+            });
+        }
+    };
+
+
+
+    /*! Sizes a matrix and fills it with two parallel passes over rows.
+     *  count(r) returns the number of entries in row r, at most
+     *  max_per_row. fill(r, cols, vals) writes them in column order.
+     *  Only the offsets are summed serially. Throws if the matrix
+     *  does not fit its index type.
+     */
+    template<class VALUE, class INDEX, class COUNT, class FILL>
+    void assemble_rows(size_t rows, size_t cols, size_t max_per_row,
+                       COUNT count, FILL fill, csr_matrix<VALUE,INDEX>& m)
+    {
+        size_t largest=std::numeric_limits<INDEX>::max();
+        if (cols>largest || rows*max_per_row>largest) {
+            throw std::runtime_error("Index type too small for operator");
+        }
+        m.rows=rows;
+        m.cols=cols;
+        m.offsets.assign(rows+1, 0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t r=range.begin(); r!=range.end(); r++) {
+                m.offsets[r+1]=count(r);
+            }
+        });
+        std::partial_sum(m.offsets.begin(), m.offsets.end(), m.offsets.begin());
+        m.columns.resize(m.offsets[rows]);
+        m.values.resize(m.offsets[rows]);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t r=range.begin(); r!=range.end(); r++) {
+                fill(r, &m.columns[0]+m.offsets[r], &m.values[0]+m.offsets[r]);
+            }
+        });
+    }
+
+
+
+    /*! d0 of a quad_mesh, from vertices to edges. The row of an edge
+     *  is -1 at its tail and +1 at its head. Rows of missing edges
+     *  are empty, so ids are the same with or without a mask.
+     */
+    template<class Kernel, class VALUE, class INDEX>
+    void grid_d0(const quad_mesh<Kernel>& mesh, csr_matrix<VALUE,INDEX>& d0)
+    {
+        assemble_rows(mesh.edge_count(), mesh.vertex_count(), 2,
+            [&](size_t e) -> size_t {
+                return mesh.edge_exists(e) ? 2 : 0;
+            },
+            [&](size_t e, INDEX* cols, VALUE* vals) {
+                if (!mesh.edge_exists(e)) return;
+                boost::array<size_t,2> ends=mesh.edge_vertices(e);
+                cols[0]=ends[0]; vals[0]=-1;
+                cols[1]=ends[1]; vals[1]=1;
+            }, d0);
+    }
+
+
+
+    /*! d1 of a quad_mesh, from edges to faces. The row of a face is
+     *  +1 at edges it traverses along their direction and -1 at
+     *  the others, as given by quad_mesh::face_edge_sign.
+     */
+    template<class Kernel, class VALUE, class INDEX>
+    void grid_d1(const quad_mesh<Kernel>& mesh, csr_matrix<VALUE,INDEX>& d1)
+    {
+        // Sides in order of increasing edge id: south, north, west, east.
+        static const int side_order[4]={3,1,0,2};
+        assemble_rows(mesh.face_count(), mesh.edge_count(), 4,
+            [&](size_t f) -> size_t {
+                return mesh.facet_exists(f) ? 4 : 0;
+            },
+            [&](size_t f, INDEX* cols, VALUE* vals) {
+                if (!mesh.facet_exists(f)) return;
+                boost::array<size_t,4> edges=mesh.face_edges(f);
+                for (int i=0; i<4; i++) {
+                    int side=side_order[i];
+                    cols[i]=edges[side];
+                    vals[i]=quad_mesh<Kernel>::face_edge_sign(side);
+                }
+            }, d1);
+    }
+
+
+
+    /*! Numbers the edges of a Polyhedron through halfedge ids.
+     *  Edge k is halfedges 2k and 2k+1, and it runs toward the vertex
+     *  of halfedge 2k. Needs Polyhedron_items_with_id_3.
+     *  \returns the number of edges.
+     */
+    template<class POLY>
+    size_t number_polyhedron_edges(POLY& P)
+    {
+        size_t edge_cnt=0;
+        for (auto h=P.edges_begin(); h!=P.edges_end(); ++h) {
+            h->id()=2*edge_cnt;
+            h->opposite()->id()=2*edge_cnt+1;
+            edge_cnt++;
+        }
+        return edge_cnt;
+    }
+
+
+    //! The largest id plus one, which is the size of an id-indexed array.
+    template<class ITER>
+    size_t id_extent(ITER begin, ITER end)
+    {
+        size_t extent=0;
+        for ( ; begin!=end; ++begin) {
+            extent=std::max(extent, size_t(begin->id())+1);
+        }
+        return extent;
+    }
+
+
+
+    /*! d0 of a Polyhedron, such as the output of Build_grid or
+     *  add_from_file. Columns are vertex ids and rows are edges
+     *  numbered by number_polyhedron_edges. The Polyhedron's lists
+     *  are not random access, so this runs serially.
+     */
+    template<class POLY, class VALUE, class INDEX>
+    void polyhedron_d0(POLY& P, csr_matrix<VALUE,INDEX>& d0)
+    {
+        size_t edge_cnt=number_polyhedron_edges(P);
+        size_t cols=id_extent(P.vertices_begin(), P.vertices_end());
+        if (cols>std::numeric_limits<INDEX>::max()
+                || 2*edge_cnt>std::numeric_limits<INDEX>::max()) {
+            throw std::runtime_error("Index type too small for operator");
+        }
+        d0.rows=edge_cnt;
+        d0.cols=cols;
+        d0.offsets.resize(edge_cnt+1);
+        d0.columns.resize(2*edge_cnt);
+        d0.values.resize(2*edge_cnt);
+        size_t e=0;
+        for (auto h=P.edges_begin(); h!=P.edges_end(); ++h, ++e) {
+            size_t tail=h->opposite()->vertex()->id();
+            size_t head=h->vertex()->id();
+            d0.offsets[e]=2*e;
+            int first = tail<head ? 0 : 1;
+            d0.columns[2*e+first]=tail;
+            d0.values[2*e+first]=-1;
+            d0.columns[2*e+1-first]=head;
+            d0.values[2*e+1-first]=1;
+        }
+        d0.offsets[edge_cnt]=2*edge_cnt;
+    }
+
+
+
+    /*! d1 of a Polyhedron. Rows are facet ids, so a facet missing
+     *  from a raster gives an empty row. Edges are numbered as in
+     *  polyhedron_d0, so call both on the same, unchanged Polyhedron.
+     */
+    template<class POLY, class VALUE, class INDEX>
+    void polyhedron_d1(POLY& P, csr_matrix<VALUE,INDEX>& d1)
+    {
+        size_t edge_cnt=number_polyhedron_edges(P);
+        size_t rows=id_extent(P.facets_begin(), P.facets_end());
+        if (edge_cnt>std::numeric_limits<INDEX>::max()
+                || 2*edge_cnt>std::numeric_limits<INDEX>::max()) {
+            throw std::runtime_error("Index type too small for operator");
+        }
+        d1.rows=rows;
+        d1.cols=edge_cnt;
+        d1.offsets.assign(rows+1, 0);
+        for (auto f=P.facets_begin(); f!=P.facets_end(); ++f) {
+            auto h=f->facet_begin();
+            do {
+                d1.offsets[f->id()+1]++;
+            } while (++h!=f->facet_begin());
+        }
+        std::partial_sum(d1.offsets.begin(), d1.offsets.end(),
+                         d1.offsets.begin());
+        d1.columns.resize(d1.offsets[rows]);
+        d1.values.resize(d1.offsets[rows]);
+        for (auto f=P.facets_begin(); f!=P.facets_end(); ++f) {
+            INDEX begin=d1.offsets[f->id()];
+            INDEX end=begin;
+            auto h=f->facet_begin();
+            do {
+                // Insertion sort keeps the short row in column order.
+                INDEX edge=h->id()/2;
+                INDEX k=end++;
+                for ( ; k>begin && d1.columns[k-1]>edge; k--) {
+                    d1.columns[k]=d1.columns[k-1];
+                    d1.values[k]=d1.values[k-1];
+                }
+                d1.columns[k]=edge;
+                d1.values[k]=(h->id()%2==0) ? 1 : -1;
+            } while (++h!=f->facet_begin());
+        }
+    }
+
+
+
+    /*! The exterior derivative from (M-1)-simplices to M-simplices.
+     *  Simplices must have sorted vertices and a parity, as simplex::assign
+     *  leaves them. The faces they share are found by sorting, in
+     *  parallel, and returned in faces, sorted, with parity zero.
+     *  Face i of a simplex omits vertex i and has sign (-1)^(i+parity).
+     *  ITER must be random access.
+     */
+    template<class ITER, class FACE, class VALUE, class INDEX>
+    void simplicial_derivative(ITER begin, ITER end, std::vector<FACE>& faces,
+                               csr_matrix<VALUE,INDEX>& d)
+    {
+        typedef typename std::iterator_traits<ITER>::value_type simplex_type;
+        const size_t per_row=simplex_type::dimension+1;
+        size_t rows=end-begin;
+        if (rows*per_row>std::numeric_limits<INDEX>::max()) {
+            throw std::runtime_error("Index type too small for operator");
+        }
+
+        // Each face with the slot in d where its column goes.
+        typedef std::pair<FACE,size_t> face_slot;
+        std::vector<face_slot> slots(rows*per_row);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t r=range.begin(); r!=range.end(); r++) {
+                const simplex_type& s=begin[r];
+                for (size_t omit=0; omit<per_row; omit++) {
+                    face_slot& fs=slots[r*per_row+omit];
+                    std::copy(s.begin(), s.begin()+omit, fs.first.begin());
+                    std::copy(s.begin()+omit+1, s.end(),
+                              fs.first.begin()+omit);
+                    fs.first.parity=0;
+                    fs.second=r*per_row+omit;
+                }
+            }
+        });
+        tbb::parallel_sort(slots.begin(), slots.end(),
+            [](const face_slot& a, const face_slot& b) {
+                return a.first<b.first;
+            });
+
+        d.rows=rows;
+        d.offsets.resize(rows+1);
+        for (size_t r=0; r<=rows; r++) {
+            d.offsets[r]=r*per_row;
+        }
+        d.columns.resize(rows*per_row);
+        d.values.resize(rows*per_row);
+        faces.clear();
+        for (size_t i=0; i<slots.size(); i++) {
+            if (i==0 || slots[i-1].first<slots[i].first) {
+                faces.push_back(slots[i].first);
+            }
+            size_t slot=slots[i].second;
+            size_t omit=slot%per_row;
+            d.columns[slot]=faces.size()-1;
+            d.values[slot]=((omit+begin[slot/per_row].parity)%2) ? -1 : 1;
+        }
+        d.cols=faces.size();
+        // Faces of a sorted simplex are in decreasing order, so reverse
+        // each row to put columns in increasing order.
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t r=range.begin(); r!=range.end(); r++) {
+                std::reverse(&d.columns[r*per_row], &d.columns[r*per_row]+per_row);
+                std::reverse(&d.values[r*per_row], &d.values[r*per_row]+per_row);
+            }
+        });
+    }
+
+
+
+    //! The exterior derivative of the top simplices of a complex.
+    template<class STORAGE, class VALUE, class INDEX>
+    void simplicial_derivative(simplicial_complex<STORAGE>& complex,
+                std::vector<typename simplicial_complex<STORAGE>::boundary_type>&
+                faces, csr_matrix<VALUE,INDEX>& d)
+    {
+        simplicial_derivative(complex.storage().storage_begin(),
+                              complex.storage().storage_end(), faces, d);
+    }
+
+
+
+    /*! Checks that the product a*b is zero to within tolerance,
+     *  without forming it. Use it to check that d1*d0=0.
+     *  Each row of the product gathers into a per-thread buffer that
+     *  is reused, so the check allocates only once per thread.
+     */
+    template<class VALUE, class INDEX>
+    bool product_is_zero(const csr_matrix<VALUE,INDEX>& a,
+                         const csr_matrix<VALUE,INDEX>& b,
+                         VALUE tolerance=0)
+    {
+        if (a.cols!=b.rows) {
+            throw std::runtime_error("Operator sizes do not compose");
+        }
+        typedef std::vector<std::pair<INDEX,VALUE>> row_type;
+        tbb::enumerable_thread_specific<row_type> buffers;
+        tbb::enumerable_thread_specific<char> failed(0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, a.rows),
+            [&](const tbb::blocked_range<size_t>& range) {
+            row_type& row=buffers.local();
+            for (size_t r=range.begin(); r!=range.end(); r++) {
+                row.clear();
+                for (INDEX k=a.offsets[r]; k<a.offsets[r+1]; k++) {
+                    INDEX mid=a.columns[k];
+                    for (INDEX j=b.offsets[mid]; j<b.offsets[mid+1]; j++) {
+                        row.push_back(std::make_pair(b.columns[j],
+                                                     a.values[k]*b.values[j]));
+                    }
+                }
+                std::sort(row.begin(), row.end());
+                for (size_t i=0; i<row.size(); ) {
+                    VALUE sum=0;
+                    size_t j=i;
+                    for ( ; j<row.size() && row[j].first==row[i].first; j++) {
+                        sum+=row[j].second;
+                    }
+                    if (std::fabs(sum)>tolerance) {
+                        failed.local()=1;
+                    }
+                    i=j;
+                }
+            }
+        });
+        for (auto f=failed.begin(); f!=failed.end(); ++f) {
+            if (*f) return false;
+        }
+        return true;
+    }
+
+}
+
+
+#endif // _DEC_OPERATORS_HPP_
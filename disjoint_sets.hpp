@@ -0,0 +1,189 @@
+#ifndef _DISJOINT_SETS_HPP_
+#define _DISJOINT_SETS_HPP_ 1
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
+#include <boost/property_map/property_map.hpp>
+#include <boost/pending/disjoint_sets.hpp>
+
+
+namespace geodec
+{
+
+    /*! Union-find storage keyed by arbitrary size_t ids.
+     *  This wraps boost::disjoint_sets over two hash tables, so ids
+     *  need not be dense. It is the original back end for
+     *  disjoint_set_cluster.
+     */
+    class hashed_disjoint_sets
+    {
+    public:
+        //! Maps from element to count of elements in set.
+        typedef boost::unordered_map<size_t,size_t> rank_t;
+        //! Maps from element to parent of element.
+        typedef boost::unordered_map<size_t,size_t> parent_t;
+        typedef boost::associative_property_map<rank_t> rank_pmap_t;
+        typedef boost::associative_property_map<parent_t> parent_pmap_t;
+        typedef boost::disjoint_sets<rank_pmap_t,parent_pmap_t> dset_t;
+
+        rank_t        rank_map_;
+        parent_t      parent_map_;
+        rank_pmap_t   rank_pmap_;
+        parent_pmap_t parent_pmap_;
+        dset_t        dset_;
+
+        hashed_disjoint_sets() : rank_pmap_(rank_map_),
+                parent_pmap_(parent_map_), dset_(rank_pmap_,parent_pmap_)
+        {
+        }
+
+        void reserve(size_t n) {
+            rank_map_.reserve(n);
+            parent_map_.reserve(n);
+        }
+
+        bool has_set(size_t x) const {
+            return parent_map_.find(x)!=parent_map_.end();
+        }
+        void make_set(size_t x) { dset_.make_set(x); }
+        size_t find_set(size_t x) { return dset_.find_set(x); }
+        void union_set(size_t x, size_t y) { dset_.union_set(x,y); }
+
+        template<class ITER>
+        void compress_sets(ITER begin, ITER end) {
+            dset_.compress_sets(begin,end);
+        }
+        template<class ITER>
+        void normalize_sets(ITER begin, ITER end) {
+            dset_.normalize_sets(begin,end);
+        }
+        template<class ITER>
+        size_t count_sets(ITER begin, ITER end) {
+            return dset_.count_sets(begin,end);
+        }
+    };
+
+
+
+    /*! Union-find storage in two flat arrays indexed by id.
+     *  Use this when ids are dense, as they are for facets made by
+     *  Build_grid or add_from_file, where the id is px+py*width.
+     *  Finds use path halving and unions use union-by-rank, so there
+     *  are no allocations after reserve() and no hashing.
+     *  INDEX is the stored id type. A 32-bit INDEX halves memory
+     *  for rasters of fewer than 2^32 cells.
+     */
+    template<class INDEX=size_t>
+    class dense_disjoint_sets
+    {
+        std::vector<INDEX> parent_;
+        std::vector<unsigned char> rank_;
+    public:
+        typedef INDEX index_type;
+        //! Parent value for an id that has not been through make_set.
+        static const INDEX npos;
+
+        dense_disjoint_sets() {}
+        explicit dense_disjoint_sets(size_t n) : parent_(n,npos), rank_(n,0)
+        {
+        }
+
+        //! Allocate room for ids [0,n) so make_set never reallocates.
+        void reserve(size_t n) {
+            if (n>parent_.size()) {
+                parent_.resize(n,npos);
+                rank_.resize(n,0);
+            }
+        }
+
+        bool has_set(INDEX x) const {
+            return x<parent_.size() && parent_[x]!=npos;
+        }
+
+        void make_set(INDEX x) {
+            if (x>=parent_.size()) {
+                reserve(std::max(size_t(x)+1, 2*parent_.size()));
+            }
+            parent_[x]=x;
+            rank_[x]=0;
+        }
+
+        //! Find with path halving. Every other node points to its grandparent.
+        INDEX find_set(INDEX x) {
+            while (parent_[x]!=x) {
+                parent_[x]=parent_[parent_[x]];
+                x=parent_[x];
+            }
+            return x;
+        }
+
+        //! Link two roots by rank.
+        void link(INDEX x, INDEX y) {
+            if (x==y) return;
+            if (rank_[x]>rank_[y]) {
+                parent_[y]=x;
+            } else {
+                parent_[x]=y;
+                if (rank_[x]==rank_[y]) {
+                    rank_[y]++;
+                }
+            }
+        }
+
+        void union_set(INDEX x, INDEX y) {
+            link(find_set(x), find_set(y));
+        }
+
+        //! After this, every element points directly to its root.
+        template<class ITER>
+        void compress_sets(ITER begin, ITER end) {
+            for ( ; begin!=end; ++begin) {
+                parent_[*begin]=find_set(*begin);
+            }
+        }
+
+        /*! Make the representative of each set its smallest element,
+         *  so that labels are independent of the order of unions.
+         *  The iterator must visit elements in increasing order.
+         */
+        template<class ITER>
+        void normalize_sets(ITER begin, ITER end) {
+            for (ITER x=begin; x!=end; ++x) {
+                INDEX root=find_set(*x);
+                if (root > *x) {
+                    parent_[root]=*x;
+                    parent_[*x]=*x;
+                    rank_[*x]=rank_[root];
+                }
+            }
+            compress_sets(begin, end);
+        }
+
+        template<class ITER>
+        size_t count_sets(ITER begin, ITER end) const {
+            size_t cnt=0;
+            for ( ; begin!=end; ++begin) {
+                if (parent_[*begin]==*begin) {
+                    cnt++;
+                }
+            }
+            return cnt;
+        }
+
+        //! Number of ids with storage, whether or not they are sets.
+        size_t size() const { return parent_.size(); }
+
+        //! The parent array, for passes that walk labels in bulk.
+        const std::vector<INDEX>& parents() const { return parent_; }
+    };
+
+    template<class INDEX>
+    const INDEX dense_disjoint_sets<INDEX>::npos=
+                                    std::numeric_limits<INDEX>::max();
+
+}
+
+
+#endif // _DISJOINT_SETS_HPP_
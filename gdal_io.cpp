@@ -17,9 +17,116 @@ namespace geodec
         return pimpl->next_block();
     }
 
+    void gdal_file::set_order(cell_order order)
+    {
+        pimpl->set_block_order(order);
+        if (order==row_major_order) {
+            facet_ids_.reset();
+            vertex_ids_.reset();
+        } else {
+            facet_ids_.reset(new curve_numbering<size_t>(size_[0], size_[1],
+                                                         order));
+            vertex_ids_.reset(new curve_numbering<size_t>(size_[0]+1,
+                                                          size_[1]+1, order));
+        }
+    }
+
     std::vector<boost::array<double,3>> gdal_file::get_row(size_t iy)
     {
         return pimpl->get_row(iy);
     }
 
+    std::vector<boost::array<double,3>> gdal_file::get_row(size_t iy,
+                                                size_t x0, size_t cnt)
+    {
+        return pimpl->get_row(iy, x0, cnt);
+    }
+
+    void gdal_file::cache_coordinates(const boost::array<size_t,4>& ind)
+    {
+        pimpl->cache_coordinates(ind[0], ind[1], ind[2]+1, ind[3]+1);
+    }
+
+    void gdal_file::vertex_coordinates(const boost::array<size_t,4>& ind,
+                                       double* x, double* y, double* z)
+    {
+        pimpl->vertex_coordinates(ind[0], ind[1], ind[2]+1, ind[3]+1, x, y, z);
+    }
+
+    boost::array<size_t,2> gdal_file::block_size()
+    {
+        return pimpl->block_size();
+    }
+
+    boost::array<size_t,2> gdal_file::block_count()
+    {
+        return pimpl->block_count();
+    }
+
+    const unsigned char* gdal_file::read_block_data(size_t bx, size_t by)
+    {
+        return pimpl->read_block_data(bx, by);
+    }
+
+    void gdal_file::enable_tile_cache(const std::string& scratch_file,
+                                      size_t budget_bytes)
+    {
+        pimpl->enable_tile_cache(scratch_file, budget_bytes);
+    }
+
+    tile_cache_stats gdal_file::tile_cache_statistics() const
+    {
+        return pimpl->tile_cache_statistics();
+    }
+
+    size_t gdal_file::band_count()
+    {
+        return pimpl->band_count();
+    }
+
+    band_info gdal_file::band(size_t band)
+    {
+        return pimpl->band(band);
+    }
+
+    const void* gdal_file::read_block_data(size_t band, size_t bx, size_t by)
+    {
+        return pimpl->read_block_data(band, bx, by);
+    }
+
+    void gdal_file::require_type(size_t band, pixel_type type)
+    {
+        pimpl->require_type(band, type);
+    }
+
+    void gdal_file::read_band_data(size_t band, void* raster)
+    {
+        pimpl->read_band_data(band, raster);
+    }
+
+    size_t gdal_file::read_strip(size_t by, unsigned char* strip)
+    {
+        return pimpl->read_strip(by, strip);
+    }
+
+    void gdal_file::read_band(std::vector<unsigned char>& raster)
+    {
+        pimpl->read_band(raster);
+    }
+
+    void gdal_file::set_mask_band(size_t band)
+    {
+        pimpl->set_mask_band(band);
+    }
+
+    const unsigned char* gdal_file::block_validity(size_t bx, size_t by)
+    {
+        return pimpl->block_validity(bx, by);
+    }
+
+    void gdal_file::read_valid_cells(std::vector<bool>& valid)
+    {
+        pimpl->read_valid_cells(valid);
+    }
+
 }
@@ -1,9 +1,16 @@
 #ifndef _GDAL_IO_HPP_
 #define _GDAL_IO_HPP_ 1
 
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <memory>
+#include <vector>
 #include <boost/array.hpp>
 #include <boost/tuple/tuple.hpp>
+#include "tile_cache.hpp"
+#include "space_filling.hpp"
+#include "pixel_types.hpp"
 
 namespace geodec
 {
@@ -26,11 +33,129 @@ namespace geodec
         
         boost::array<size_t,2> size_;
         boost::array<double,6> transform_;
+        //! Numbering of cells and of vertices, absent for row-major ids.
+        std::unique_ptr<curve_numbering<size_t>> facet_ids_;
+        std::unique_ptr<curve_numbering<size_t>> vertex_ids_;
     public:
         gdal_file(const std::string& filename);
         ~gdal_file();
         boost::array<size_t,4> next_block();
+        /*! Visit blocks in next_block(), and number facets and vertices
+         *  for read_block(), in row-major, Morton or Hilbert order.
+         *  Call it before reading.
+         */
+        void set_order(cell_order order);
+        //! Id read_block() gives the facet of pixel (px,py).
+        size_t facet_id(size_t px, size_t py) const
+        {
+            return facet_ids_ ? facet_ids_->id(px, py) : px+py*size_[0];
+        }
+        //! Id read_block() gives the vertex at the lower corner of (ix,iy).
+        size_t vertex_id(size_t ix, size_t iy) const
+        {
+            return vertex_ids_ ? vertex_ids_->id(ix, iy) : ix+iy*(size_[0]+1);
+        }
+        //! The numbering of facets, for writing results as a raster.
+        const curve_numbering<size_t>* facet_numbering() const
+        {
+            return facet_ids_.get();
+        }
         std::vector<boost::array<double,3>> get_row(size_t iy);
+        std::vector<boost::array<double,3>> get_row(size_t iy, size_t x0,
+                                                    size_t cnt);
+        /*! Transform the vertices of a block, from next_block(), in one
+         *  batch so that get_row on its rows only copies.
+         */
+        void cache_coordinates(const boost::array<size_t,4>& ind);
+        /*! Coordinates of the vertices of a block, from next_block(),
+         *  into arrays of (ind[2]+1)*(ind[3]+1), row by row.
+         */
+        void vertex_coordinates(const boost::array<size_t,4>& ind,
+                                double* x, double* y, double* z);
+        //! Width and height of the raster in pixels.
+        boost::array<size_t,2> size() const { return size_; }
+        //! GDAL affine transform from pixel corner to projected coords.
+        const boost::array<double,6>& geo_transform() const { return transform_; }
+        boost::array<size_t,2> block_size();
+        boost::array<size_t,2> block_count();
+        /*! Decoded pixels of one block of band one, which must hold
+         *  bytes. Valid until the next read.
+         */
+        const unsigned char* read_block_data(size_t bx, size_t by);
+        size_t band_count();
+        //! Type and nodata value of a band, counted from one.
+        band_info band(size_t band);
+        /*! Decoded pixels of one block of a band, in the band's own
+         *  type. Each band has its own buffer, so blocks of different
+         *  bands can be held at once. Valid until the next read of
+         *  the same band.
+         */
+        const void* read_block_data(size_t band, size_t bx, size_t by);
+        /*! A typed view of the decoded block, with no copy. T must be
+         *  the band's type.
+         */
+        template<class T>
+        pixel_span<T> read_block_span(size_t band, size_t bx, size_t by)
+        {
+            require_type(band, pixel_type_of<T>::value);
+            boost::array<size_t,4> extent=block_extent(bx, by);
+            return pixel_span<T>(
+                static_cast<const T*>(read_block_data(band, bx, by)),
+                extent, block_size()[0]);
+        }
+        /*! Keep up to budget_bytes of decoded blocks in a scratch file
+         *  mapped into memory, so later passes reuse them. The block
+         *  last read from each band stays in the cache until the next
+         *  read of that band.
+         */
+        void enable_tile_cache(const std::string& scratch_file,
+                               size_t budget_bytes);
+        //! Hits and misses of the tile cache, all zero without one.
+        tile_cache_stats tile_cache_statistics() const;
+        /*! Read the row of blocks by into strip, which must hold
+         *  width*block_size()[1] bytes. Returns the rows read.
+         */
+        size_t read_strip(size_t by, unsigned char* strip);
+        //! Read the whole band as width*height bytes in row-major order.
+        void read_band(std::vector<unsigned char>& raster);
+        /*! Read a whole band in row-major order. T must be the band's
+         *  type. make_band_map(&raster[0]) views it as a property map.
+         */
+        template<class T>
+        void read_band(size_t band, std::vector<T>& raster)
+        {
+            require_type(band, pixel_type_of<T>::value);
+            raster.resize(size_[0]*size_[1]);
+            read_band_data(band, raster.data());
+        }
+        //! Throws unless the band exists and holds pixels of this type.
+        void require_type(size_t band, pixel_type type);
+        //! Read a whole band, in its own type, into width*height pixels.
+        void read_band_data(size_t band, void* raster);
+        /*! Leave out cells that the GDAL mask of a band marks invalid,
+         *  which come from its nodata value, a mask file or an alpha
+         *  band. Zero, the default, keeps every cell.
+         */
+        void set_mask_band(size_t band);
+        /*! One or zero for each cell of a block and of the ring of
+         *  cells around it, in rows of block width plus two, starting
+         *  at the cell below and left of the block. Null without a mask.
+         */
+        const unsigned char* block_validity(size_t bx, size_t by);
+        //! Validity of each cell in row-major order, empty without a mask.
+        void read_valid_cells(std::vector<bool>& valid);
+        /*! Id of the second vertex at (ix,iy) where two valid cells
+         *  meet only at that corner. The cells below it use this id so
+         *  that the surface stays manifold.
+         */
+        size_t pinched_vertex_id(size_t ix, size_t iy) const
+        {
+            return vertex_id(ix, iy)+(size_[0]+1)*(size_[1]+1);
+        }
+        /*! Send the vertices and faces of the next block to the builder.
+         *  With a mask band, invalid cells get no face, vertices touch
+         *  at least one valid cell, and ids are the same as without it.
+         */
         template<class BUILDER> bool read_block(BUILDER& builder)
         {
 			//identify<BUILDER> what(3);
@@ -40,21 +165,93 @@ namespace geodec
             if (ind[2]==0) {
                 return false;
             }
+            send_block(builder, ind);
+            return true;
+        }
+        /*! Send block (bx,by) to the builder, out of the order of
+         *  next_block(), as when stitching blocks one at a time.
+         */
+        template<class BUILDER>
+        void read_block(BUILDER& builder, size_t bx, size_t by)
+        {
+            send_block(builder, block_extent(bx, by));
+        }
+        //! Pixel extent x0, y0, width, height of block (bx,by).
+        boost::array<size_t,4> block_extent(size_t bx, size_t by)
+        {
+            boost::array<size_t,2> bs=block_size();
+            boost::array<size_t,2> cnt=block_count();
+            if (bx>=cnt[0] || by>=cnt[1]) {
+                std::stringstream msg;
+                msg << "Block " << bx << ", " << by << " is outside the "
+                    << cnt[0] << " by " << cnt[1] << " blocks of the file";
+                throw std::runtime_error(msg.str());
+            }
+            boost::array<size_t,4> extent;
+            extent[0]=bx*bs[0];
+            extent[1]=by*bs[1];
+            extent[2]=std::min(bs[0], size_[0]-extent[0]);
+            extent[3]=std::min(bs[1], size_[1]-extent[1]);
+            return extent;
+        }
+        //! Vertices and faces of the block with this extent.
+        template<class BUILDER>
+        void send_block(BUILDER& builder, const boost::array<size_t,4>& ind)
+        {
             std::cerr << "reading block " << ind[0] << ", " << ind[1] << std::endl;
             std::cerr << "end block " << ind[2] << ", " << ind[3] << std::endl;
-            size_t width=size_[0]; // width in x
+            boost::array<size_t,2> bs=block_size();
+            const unsigned char* valid=block_validity(ind[0]/bs[0],
+                                                      ind[1]/bs[1]);
+            // Validity of cell (px,py), which may be in the ring.
+            size_t hw=bs[0]+2;
+            auto cell=[&](size_t px, size_t py) -> bool {
+                return 0==valid || valid[(px+1-ind[0])+(py+1-ind[1])*hw];
+            };
+            if (valid) {
+                bool any=false;
+                for (size_t py=ind[1]; py<ind[1]+ind[3] && !any; py++) {
+                    for (size_t px=ind[0]; px<ind[0]+ind[2]; px++) {
+                        if (cell(px, py)) {
+                            any=true;
+                            break;
+                        }
+                    }
+                }
+                if (!any) {
+                    return;
+                }
+            }
+            // Diagonal pairs of valid cells that touch only at (ix,iy).
+            auto pinch_ne_sw=[&](size_t ix, size_t iy) -> bool {
+                return valid && cell(ix-1, iy-1) && cell(ix, iy)
+                    && !cell(ix, iy-1) && !cell(ix-1, iy);
+            };
+            auto pinch_nw_se=[&](size_t ix, size_t iy) -> bool {
+                return valid && cell(ix, iy-1) && cell(ix-1, iy)
+                    && !cell(ix-1, iy-1) && !cell(ix, iy);
+            };
             boost::array<double,3> loc;
+            cache_coordinates(ind);
             for (size_t iy=ind[1]; iy<ind[1]+ind[3]+1; iy++)
             {
                 std::cerr << "row " << iy << std::endl;
-                auto row = get_row(iy);
+                auto row = get_row(iy, ind[0], ind[2]+1);
 				size_t ix = ind[0];
                 for (auto pr=row.begin(); pr!=row.end(); pr++)
                 {
+                    if (valid && !(cell(ix-1, iy-1) || cell(ix, iy-1)
+                                   || cell(ix-1, iy) || cell(ix, iy))) {
+                        ix++;
+                        continue;
+                    }
                     loc[0]=pr->at(0);
                     loc[1]=pr->at(1);
                     loc[2]=0;
-                    builder.add_vertex( loc, ix+iy*width );
+                    builder.add_vertex( loc, vertex_id(ix, iy) );
+                    if (pinch_ne_sw(ix, iy) || pinch_nw_se(ix, iy)) {
+                        builder.add_vertex( loc, pinched_vertex_id(ix, iy) );
+                    }
 					ix++;
                 }
             }
@@ -64,15 +261,18 @@ namespace geodec
             {
                 for (size_t px=ind[0]; px<ind[0]+ind[2]; px++)
                 {
-                    verts[0]=px+py*width;
-                    verts[1]=(px+1)+py*width;
-                    verts[2]=(px+1)+(py+1)*width;
-                    verts[3]=px+(py+1)*width;
-                    builder.add_face( verts, px+py*width );
+                    if (!cell(px, py)) {
+                        continue;
+                    }
+                    verts[0]=vertex_id(px, py);
+                    verts[1]=vertex_id(px+1, py);
+                    verts[2]=pinch_ne_sw(px+1, py+1) ?
+                        pinched_vertex_id(px+1, py+1) : vertex_id(px+1, py+1);
+                    verts[3]=pinch_nw_se(px, py+1) ?
+                        pinched_vertex_id(px, py+1) : vertex_id(px, py+1);
+                    builder.add_face( verts, facet_id(px, py) );
                 }
             }
-
-            return true;
         }
     };
 
@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
 #include "ogrsf_frmts.h"
 #include "ogr_api.h"
 #include "gdal_io_impl.hpp"
@@ -11,6 +12,21 @@
 namespace geodec
 {
 
+    //! The pixel_type of a GDAL data type, or pixel_unknown.
+    static pixel_type gdal_pixel_type(GDALDataType type)
+    {
+        switch (type) {
+        case GDT_Byte: return pixel_uint8;
+        case GDT_UInt16: return pixel_uint16;
+        case GDT_Int32: return pixel_int32;
+        case GDT_Float32: return pixel_float32;
+        case GDT_Float64: return pixel_float64;
+        default: return pixel_unknown;
+        }
+    }
+
+
+
     gdal_file::impl::impl(const std::string& filename) {
         OGRRegisterAll();
         GDALAllRegister();
@@ -36,11 +52,30 @@ namespace geodec
             block_cnt_[cr]=(size_[cr] + block_size_[cr] - 1)/
                 block_size_[cr];
         }
-        int item_bytes=1;
-        block_buffer_=(unsigned char*) CPLMalloc(
-                                  block_size_[0]*block_size_[1]*item_bytes);
+        // Buffers are allocated on a band's first read, so unused
+        // bands cost nothing.
+        for (int b=1; b<=dataset_->GetRasterCount(); b++) {
+            band_state state;
+            state.band=dataset_->GetRasterBand(b);
+            state.info.type=gdal_pixel_type(state.band->GetRasterDataType());
+            int has_nodata=0;
+            state.info.nodata=state.band->GetNoDataValue(&has_nodata);
+            state.info.has_nodata=(has_nodata!=0);
+            int bx, by;
+            state.band->GetBlockSize( &bx, &by );
+            state.block_bytes=0;
+            if (size_t(bx)==block_size_[0] && size_t(by)==block_size_[1]) {
+                state.block_bytes=bx*by*pixel_bytes(state.info.type);
+            }
+            state.buffer=0;
+            bands_.push_back(state);
+        }
         block_order_=choose_block(block_cnt_);
+        mask_band_=0;
+        mask_=0;
 
+        cached_extent_[2]=0;
+        cached_extent_[3]=0;
         geo_xform_=coord_projected_transform();
         this->coordinate_transform(); // sets coord_xform_
     }
@@ -48,7 +83,9 @@ namespace geodec
 
     gdal_file::impl::~impl() {
         OGRCoordinateTransformation::DestroyCT(coord_xform_);
-        CPLFree(block_buffer_);
+        for (size_t b=0; b<bands_.size(); b++) {
+            CPLFree(bands_[b].buffer);
+        }
         GDALClose(dataset_);
     }
 
@@ -74,6 +111,12 @@ namespace geodec
     }
 
 
+    void gdal_file::impl::set_block_order(cell_order order)
+    {
+        block_order_=choose_block(block_cnt_, order);
+    }
+
+
 	/*! Loads data from a block and returns its extents.
 	 *  Before this is called, there is no loaded data.
 	 *  \returns Array of (x start, y start, x width, y height)
@@ -85,14 +128,13 @@ namespace geodec
         boost::array<size_t,4> indices;
         boost::array<size_t,2> block_idx=block_order_.next();
         if (block_idx!=block_order_.end()) {
-            raster_band_->ReadBlock( block_idx[0], block_idx[1],
-                                    block_buffer_);
+            read_block_data(1, block_idx[0], block_idx[1]);
             for (size_t c=0; c<2; c++) {
                 indices[c]=block_idx[c]*block_size_[c];
 				// Last block in a row or col may be smaller.
 				indices[c+2]=block_size_[c];
                 if (indices[c]+indices[c+2] > size_[c]) {
-                    indices[c+2]=size_[c]-indices[c]*block_size_[c];
+                    indices[c+2]=size_[c]-indices[c];
                 }
             }
         } else {
@@ -102,24 +144,460 @@ namespace geodec
     };
 
 
+	/*! Apply the affine geotransform to a row of cnt vertices starting
+	 *  at (x0,iy). Each coordinate is its own loop with no loads, so
+	 *  the compiler vectorizes it.
+	 */
+    void gdal_file::impl::affine_row(size_t x0, size_t iy, size_t cnt,
+                                     double* x, double* y) const
+    {
+        double base_x=geo_xform_[0]+x0*geo_xform_[1]+iy*geo_xform_[2];
+        double base_y=geo_xform_[3]+x0*geo_xform_[4]+iy*geo_xform_[5];
+        double step_x=geo_xform_[1];
+        double step_y=geo_xform_[4];
+        for (size_t ix=0; ix<cnt; ix++) {
+            x[ix]=base_x+ix*step_x;
+        }
+        for (size_t ix=0; ix<cnt; ix++) {
+            y[ix]=base_y+ix*step_y;
+        }
+    }
+
+
+	/*! Transform n points in place with one call to OGR.
+	 *  Without a coordinate transformation the points stay projected.
+	 */
+    void gdal_file::impl::transform_points(size_t n, double* x, double* y,
+                                           double* z)
+    {
+        if (0==coord_xform_ || 0==n) return;
+        if (!coord_xform_->Transform( n, x, y, z )) {
+            std::cerr << "Coordinate transformation failed for some points."
+                << std::endl;
+        }
+    }
+
+
+	/*! Coordinates of nx by ny vertices from (x0,y0), row by row,
+	 *  into arrays of nx*ny.
+	 */
+    void gdal_file::impl::vertex_coordinates(size_t x0, size_t y0, size_t nx,
+                                size_t ny, double* x, double* y, double* z)
+    {
+        for (size_t iy=0; iy<ny; iy++) {
+            affine_row(x0, y0+iy, nx, x+iy*nx, y+iy*nx);
+        }
+        std::fill(z, z+nx*ny, 0.0);
+        transform_points(nx*ny, x, y, z);
+    }
+
+
+	/*! Compute and keep coordinates of the vertices of a block.
+	 *  Vertices run from (x0,y0) for nx by ny. Later calls to get_row
+	 *  for rows inside this block copy from the cache.
+	 */
+    void gdal_file::impl::cache_coordinates(size_t x0, size_t y0, size_t nx,
+                                            size_t ny)
+    {
+        size_t n=nx*ny;
+        cache_x_.resize(n);
+        cache_y_.resize(n);
+        cache_z_.resize(n);
+        vertex_coordinates(x0, y0, nx, ny, &cache_x_[0], &cache_y_[0],
+                           &cache_z_[0]);
+        cached_extent_[0]=x0;
+        cached_extent_[1]=y0;
+        cached_extent_[2]=nx;
+        cached_extent_[3]=ny;
+    }
+
+
+	/*! Coordinates of cnt vertices in row iy, starting at column x0.
+	 *  Vertices are the corners of pixels, so a raster row has
+	 *  width+1 of them.
+	 */
+    std::vector<boost::array<double,3>>
+    gdal_file::impl::get_row(size_t iy, size_t x0, size_t cnt)
+    {
+        std::vector<boost::array<double,3> > coords(cnt);
+        const boost::array<size_t,4>& c=cached_extent_;
+        bool cached = iy>=c[1] && iy<c[1]+c[3]
+                      && x0>=c[0] && x0+cnt<=c[0]+c[2];
+        if (cached) {
+            size_t off=(iy-c[1])*c[2]+(x0-c[0]);
+            for (size_t ix=0; ix<cnt; ix++) {
+                coords[ix][0]=cache_x_[off+ix];
+                coords[ix][1]=cache_y_[off+ix];
+                coords[ix][2]=cache_z_[off+ix];
+            }
+            return coords;
+        }
+
+        std::vector<double> x(cnt), y(cnt), z(cnt, 0.0);
+        affine_row(x0, iy, cnt, &x[0], &y[0]);
+        transform_points(cnt, &x[0], &y[0], &z[0]);
+        for (size_t ix=0; ix<cnt; ix++) {
+            coords[ix][0]=x[ix];
+            coords[ix][1]=y[ix];
+            coords[ix][2]=z[ix];
+        }
+		return coords;
+    }
+
+
     std::vector<boost::array<double,3>>
     gdal_file::impl::get_row(size_t iy)
     {
-        std::vector<boost::array<double,3> > coords(block_size_[0]);
+        return get_row(iy, 0, size_[0]+1);
+    }
+
+
+
+    boost::array<size_t,2> gdal_file::impl::block_size() { return block_size_; }
 
-        size_t off=iy*size_[0];
+    boost::array<size_t,2> gdal_file::impl::block_count() { return block_cnt_; }
 
-        for (size_t ix=0; ix<block_size_[0]; ix++)
-        {
-            double proj_x, proj_y;
-            proj_x=geo_xform_[0]+ix*geo_xform_[1]+iy*geo_xform_[2];
-            proj_y=geo_xform_[3]+ix*geo_xform_[4]+iy*geo_xform_[5];
-            
-            coord_xform_->Transform( 1, &coords[ix][0],
-					&coords[ix][1], &coords[ix][2]);
+
+    size_t gdal_file::impl::band_count() const { return bands_.size(); }
+
+
+    gdal_file::impl::band_state& gdal_file::impl::checked_band(size_t band)
+    {
+        if (band<1 || band>bands_.size()) {
+            std::stringstream msg;
+            msg << "No band " << band << " in a file of " << bands_.size();
+            throw std::runtime_error(msg.str());
+        }
+        band_state& state=bands_[band-1];
+        if (0==state.block_bytes) {
+            std::stringstream msg;
+            msg << "Band " << band << " has type "
+                << pixel_type_name(state.info.type)
+                << " or blocks unlike those of band 1";
+            throw std::runtime_error(msg.str());
         }
+        return state;
+    }
 
-		return coords;
+
+    band_info gdal_file::impl::band(size_t band)
+    {
+        if (band<1 || band>bands_.size()) {
+            std::stringstream msg;
+            msg << "No band " << band << " in a file of " << bands_.size();
+            throw std::runtime_error(msg.str());
+        }
+        return bands_[band-1].info;
+    }
+
+
+    void gdal_file::impl::require_type(size_t band, pixel_type type)
+    {
+        band_state& state=checked_band(band);
+        if (state.info.type!=type) {
+            std::stringstream msg;
+            msg << "Band " << band << " holds "
+                << pixel_type_name(state.info.type) << ", not "
+                << pixel_type_name(type);
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    void gdal_file::impl::decode_block(size_t band, size_t bx, size_t by,
+                                       unsigned char* buffer)
+    {
+        CPLErr err=bands_[band-1].band->ReadBlock( bx, by, buffer );
+        if (err!=CE_None) {
+            std::stringstream msg;
+            msg << "Could not read block " << bx << ", " << by
+                << " of band " << band;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    const void*
+    gdal_file::impl::read_block_data(size_t band, size_t bx, size_t by)
+    {
+        band_state& state=checked_band(band);
+        if (tile_cache_) {
+            return tile_cache_->get(band-1, bx, by, [&](unsigned char* buffer) {
+                this->decode_block(band, bx, by, buffer);
+            });
+        }
+        if (0==state.buffer) {
+            state.buffer=(unsigned char*) CPLMalloc(state.block_bytes);
+        }
+        decode_block(band, bx, by, state.buffer);
+        return state.buffer;
+    }
+
+
+    const unsigned char*
+    gdal_file::impl::read_block_data(size_t bx, size_t by)
+    {
+        require_type(1, pixel_uint8);
+        return static_cast<const unsigned char*>(read_block_data(1, bx, by));
+    }
+
+
+	/*! Blocks decode straight into slots of the cache. The budget is
+	 *  rounded down to whole blocks of the widest band, and holds at
+	 *  least one block per band so that a block of every band can be
+	 *  in use at once. A second call starts over with an empty cache.
+	 */
+    void gdal_file::impl::enable_tile_cache(const std::string& scratch_file,
+                                            size_t budget_bytes)
+    {
+        size_t tile_bytes=block_size_[0]*block_size_[1];
+        for (size_t b=0; b<bands_.size(); b++) {
+            tile_bytes=std::max(tile_bytes, bands_[b].block_bytes);
+        }
+        budget_bytes=std::max(budget_bytes, tile_bytes*bands_.size());
+        tile_cache_.reset();
+        tile_cache_.reset(new tile_cache(scratch_file, tile_bytes,
+                      bands_.size(), block_cnt_[0], block_cnt_[1],
+                      budget_bytes));
+    }
+
+
+    tile_cache_stats gdal_file::impl::tile_cache_statistics() const
+    {
+        if (tile_cache_) {
+            return tile_cache_->stats();
+        }
+        tile_cache_stats none={ 0, 0, 0, 0 };
+        return none;
+    }
+
+
+	/*! Copy one row of blocks into strip, which holds width times
+	 *  the valid rows of that block row. Blocks on the right and bottom
+	 *  edges are only partly inside the raster, so copy just the part
+	 *  that is inside.
+	 *  \returns the number of rows copied.
+	 */
+    size_t gdal_file::impl::read_strip(size_t band, size_t by,
+                                       unsigned char* strip)
+    {
+        size_t item_bytes=pixel_bytes(checked_band(band).info.type);
+        size_t y0=by*block_size_[1];
+        size_t valid_y=std::min(block_size_[1], size_[1]-y0);
+        size_t row_bytes=block_size_[0]*item_bytes;
+        for (size_t bx=0; bx<block_cnt_[0]; bx++) {
+            const unsigned char* block=static_cast<const unsigned char*>(
+                read_block_data(band, bx, by));
+            size_t x0=bx*block_size_[0];
+            size_t valid_bytes=std::min(block_size_[0], size_[0]-x0)*item_bytes;
+            for (size_t iy=0; iy<valid_y; iy++) {
+                std::copy(block+iy*row_bytes, block+iy*row_bytes+valid_bytes,
+                          strip+(x0+iy*size_[0])*item_bytes);
+            }
+        }
+        return valid_y;
+    }
+
+
+    size_t gdal_file::impl::read_strip(size_t by, unsigned char* strip)
+    {
+        require_type(1, pixel_uint8);
+        return read_strip(1, by, strip);
+    }
+
+
+    void gdal_file::impl::read_band_data(size_t band, void* raster)
+    {
+        size_t item_bytes=pixel_bytes(checked_band(band).info.type);
+        unsigned char* bytes=static_cast<unsigned char*>(raster);
+        for (size_t by=0; by<block_cnt_[1]; by++) {
+            read_strip(band, by, bytes+by*block_size_[1]*size_[0]*item_bytes);
+        }
+    }
+
+
+    void gdal_file::impl::read_band(std::vector<unsigned char>& raster)
+    {
+        require_type(1, pixel_uint8);
+        raster.resize(size_[0]*size_[1]);
+        read_band_data(1, raster.data());
+    }
+
+
+
+	/*! GDAL gives every band a mask band, which comes from its nodata
+	 *  value, a mask file or an alpha band, and is zero where a cell
+	 *  is invalid. A band with no nodata or mask needs no masking.
+	 */
+    void gdal_file::impl::set_mask_band(size_t band)
+    {
+        mask_band_=0;
+        mask_=0;
+        mask_edges_.clear();
+        if (0==band) return;
+        band_state& state=checked_band(band);
+        if (state.band->GetMaskFlags() & GMF_ALL_VALID) return;
+        GDALRasterBand* mask=state.band->GetMaskBand();
+        int bx, by;
+        mask->GetBlockSize( &bx, &by );
+        if (size_t(bx)!=block_size_[0] || size_t(by)!=block_size_[1]) {
+            std::stringstream msg;
+            msg << "Mask of band " << band << " has blocks of " << bx
+                << " by " << by << ", unlike the band";
+            throw std::runtime_error(msg.str());
+        }
+        mask_band_=band;
+        mask_=mask;
+        mask_buffer_.resize(block_size_[0]*block_size_[1]);
+        halo_.resize((block_size_[0]+2)*(block_size_[1]+2));
+    }
+
+
+    const unsigned char* gdal_file::impl::read_mask_block(size_t bx, size_t by)
+    {
+        if (0==mask_) return 0;
+        CPLErr err=mask_->ReadBlock( bx, by, &mask_buffer_[0] );
+        if (err!=CE_None) {
+            std::stringstream msg;
+            msg << "Could not read mask block " << bx << ", " << by;
+            throw std::runtime_error(msg.str());
+        }
+        return &mask_buffer_[0];
+    }
+
+
+    void gdal_file::impl::keep_mask_edges(size_t bx, size_t by,
+                                          const unsigned char* mask)
+    {
+        size_t key=bx+by*block_cnt_[0];
+        if (mask_edges_.count(key)) return;
+        size_t bw=block_size_[0], bh=block_size_[1];
+        size_t valid_w=std::min(bw, size_[0]-bx*bw);
+        size_t valid_h=std::min(bh, size_[1]-by*bh);
+        std::vector<unsigned char>& edges=mask_edges_[key];
+        edges.assign(2*bw+2*bh, 0);
+        for (size_t ix=0; ix<valid_w; ix++) {
+            edges[ix]=mask[ix]!=0;
+            edges[bw+ix]=mask[ix+(valid_h-1)*bw]!=0;
+        }
+        for (size_t iy=0; iy<valid_h; iy++) {
+            edges[2*bw+iy]=mask[iy*bw]!=0;
+            edges[2*bw+bh+iy]=mask[valid_w-1+iy*bw]!=0;
+        }
+    }
+
+
+    const std::vector<unsigned char>&
+    gdal_file::impl::mask_edges(size_t bx, size_t by)
+    {
+        size_t key=bx+by*block_cnt_[0];
+        auto found=mask_edges_.find(key);
+        if (found!=mask_edges_.end()) return found->second;
+        keep_mask_edges(bx, by, read_mask_block(bx, by));
+        return mask_edges_[key];
+    }
+
+
+	/*! Validity, one or zero, of the cells of a block and of the ring
+	 *  of cells around it, in rows of block width plus two. Cells
+	 *  outside the raster are invalid. The ring comes from the edges of
+	 *  neighboring blocks, which are kept once read, and a neighbor is
+	 *  read only where this block has a valid cell next to it.
+	 */
+    const unsigned char* gdal_file::impl::block_validity(size_t bx, size_t by)
+    {
+        if (0==mask_) return 0;
+        size_t bw=block_size_[0], bh=block_size_[1];
+        size_t hw=bw+2;
+        size_t valid_w=std::min(bw, size_[0]-bx*bw);
+        size_t valid_h=std::min(bh, size_[1]-by*bh);
+        std::fill(halo_.begin(), halo_.end(), 0);
+        const unsigned char* own=read_mask_block(bx, by);
+        for (size_t iy=0; iy<valid_h; iy++) {
+            for (size_t ix=0; ix<valid_w; ix++) {
+                halo_[(ix+1)+(iy+1)*hw]=own[ix+iy*bw]!=0;
+            }
+        }
+        keep_mask_edges(bx, by, own);
+
+        // Whether this block has a valid cell along each side.
+        bool west=false, east=false, south=false, north=false;
+        for (size_t iy=1; iy<=valid_h; iy++) {
+            west|=halo_[1+iy*hw]!=0;
+            east|=halo_[valid_w+iy*hw]!=0;
+        }
+        for (size_t ix=1; ix<=valid_w; ix++) {
+            south|=halo_[ix+hw]!=0;
+            north|=halo_[ix+valid_h*hw]!=0;
+        }
+        bool more_x=bx+1<block_cnt_[0], more_y=by+1<block_cnt_[1];
+        if (west && bx>0) {
+            const std::vector<unsigned char>& e=mask_edges(bx-1, by);
+            for (size_t iy=0; iy<valid_h; iy++) {
+                halo_[(iy+1)*hw]=e[2*bw+bh+iy];
+            }
+        }
+        if (east && more_x) {
+            const std::vector<unsigned char>& e=mask_edges(bx+1, by);
+            for (size_t iy=0; iy<valid_h; iy++) {
+                halo_[(valid_w+1)+(iy+1)*hw]=e[2*bw+iy];
+            }
+        }
+        if (south && by>0) {
+            const std::vector<unsigned char>& e=mask_edges(bx, by-1);
+            for (size_t ix=0; ix<valid_w; ix++) {
+                halo_[ix+1]=e[bw+ix];
+            }
+        }
+        if (north && more_y) {
+            const std::vector<unsigned char>& e=mask_edges(bx, by+1);
+            for (size_t ix=0; ix<valid_w; ix++) {
+                halo_[(ix+1)+(valid_h+1)*hw]=e[ix];
+            }
+        }
+        // Corners, from the diagonal neighbors' corner cells. A corner
+        // cell decides a pinch where this block's corner cell is valid
+        // or where both ring cells beside it are.
+        size_t sw=0, se=valid_w+1;
+        size_t nw=(valid_h+1)*hw, ne=(valid_w+1)+(valid_h+1)*hw;
+        if ((halo_[1+hw] || (halo_[sw+1] && halo_[sw+hw]))
+                && bx>0 && by>0) {
+            halo_[sw]=mask_edges(bx-1, by-1)[bw+bw-1];
+        }
+        if ((halo_[valid_w+hw] || (halo_[se-1] && halo_[se+hw]))
+                && more_x && by>0) {
+            halo_[se]=mask_edges(bx+1, by-1)[bw];
+        }
+        if ((halo_[1+valid_h*hw] || (halo_[nw+1] && halo_[nw-hw]))
+                && bx>0 && more_y) {
+            halo_[nw]=mask_edges(bx-1, by+1)[bw-1];
+        }
+        if ((halo_[valid_w+valid_h*hw] || (halo_[ne-1] && halo_[ne-hw]))
+                && more_x && more_y) {
+            halo_[ne]=mask_edges(bx+1, by+1)[0];
+        }
+        return &halo_[0];
+    }
+
+
+    void gdal_file::impl::read_valid_cells(std::vector<bool>& valid)
+    {
+        valid.clear();
+        if (0==mask_) return;
+        valid.resize(size_[0]*size_[1]);
+        size_t bw=block_size_[0], bh=block_size_[1];
+        for (size_t by=0; by<block_cnt_[1]; by++) {
+            for (size_t bx=0; bx<block_cnt_[0]; bx++) {
+                const unsigned char* mask=read_mask_block(bx, by);
+                size_t valid_w=std::min(bw, size_[0]-bx*bw);
+                size_t valid_h=std::min(bh, size_[1]-by*bh);
+                for (size_t iy=0; iy<valid_h; iy++) {
+                    for (size_t ix=0; ix<valid_w; ix++) {
+                        valid[bx*bw+ix+(by*bh+iy)*size_[0]]=mask[ix+iy*bw]!=0;
+                    }
+                }
+            }
+        }
     }
 
 
@@ -1,6 +1,9 @@
 #ifndef _GDAL_IO_IMPL_HPP_
 #define _GDAL_IO_IMPL_HPP_ 1
 
+#include <memory>
+#include <vector>
+#include <map>
 #include <boost/array.hpp>
 #include <boost/tuple/tuple.hpp>
 #include "gdal/gdal.h"
@@ -16,23 +19,39 @@ namespace geodec
 
 	/*! This iterates over a matrix of blocks.
 	 *  It does not embody iterator concepts. More ad-hoc.
+	 *  Curve orders list the blocks up front. There are few of them.
 	 */
     class choose_block {
         boost::array<size_t,2> cnt_;
         boost::array<size_t,2> cur_;
+        std::vector<boost::array<size_t,2>> sequence_;
+        size_t at_;
     public:
         choose_block() {}
-        choose_block(boost::array<size_t,2> cnt) : cnt_(cnt)
+        choose_block(boost::array<size_t,2> cnt,
+                     cell_order order=row_major_order) : cnt_(cnt), at_(0)
         {
             cur_[0]=0;
             cur_[1]=0;
+            if (order!=row_major_order) {
+                for_each_cell(order, cnt[0], cnt[1], [&](size_t bx, size_t by) {
+                    boost::array<size_t,2> block = {{ bx, by }};
+                    sequence_.push_back(block);
+                });
+            }
         }
         boost::array<size_t,2> next() {
+            if (!sequence_.empty()) {
+                return at_<sequence_.size() ? sequence_[at_++] : cnt_;
+            }
+            if (cur_[1]>=cnt_[1]) {
+                return cnt_;
+            }
             auto val=cur_;
             cur_[0]++;
-            if (cur_[0]>cnt_[0]) {
+            if (cur_[0]>=cnt_[0]) {
                 cur_[0]=0;
-                cnt_[1]++;
+                cur_[1]++;
             }
             return val;
         }
@@ -43,28 +62,107 @@ namespace geodec
 
     class gdal_file::impl
     {
+        //! A band and the buffer its blocks decode into.
+        struct band_state
+        {
+            GDALRasterBand* band;
+            band_info info;
+            //! Zero if its blocks differ in size from band one's.
+            size_t block_bytes;
+            unsigned char* buffer;
+        };
+
         GDALDataset* dataset_;
         GDALRasterBand* raster_band_;
         boost::array<size_t,2> block_size_;
         boost::array<size_t,2> block_cnt_;
         boost::array<size_t,2> size_;
-        unsigned char* block_buffer_;
+        std::vector<band_state> bands_;
+        std::unique_ptr<tile_cache> tile_cache_;
+        //! Band whose GDAL mask hides cells, zero for none.
+        size_t mask_band_;
+        GDALRasterBand* mask_;
+        std::vector<unsigned char> mask_buffer_;
+        //! Validity of a block and a ring of one cell around it.
+        std::vector<unsigned char> halo_;
+        /*! Bottom row, top row, left column and right column of the
+         *  validity of each block whose mask has been read.
+         */
+        std::map<size_t,std::vector<unsigned char>> mask_edges_;
         choose_block block_order_;
         OGRSpatialReference UTM_;
         OGRCoordinateTransformation* coord_xform_;
         boost::array<double,6> geo_xform_;
+        //! Vertex extent x0, y0, nx, ny of cached coordinates.
+        boost::array<size_t,4> cached_extent_;
+        std::vector<double> cache_x_;
+        std::vector<double> cache_y_;
+        std::vector<double> cache_z_;
+
+        void affine_row(size_t x0, size_t iy, size_t cnt,
+                        double* x, double* y) const;
+        void transform_points(size_t n, double* x, double* y, double* z);
+        void decode_block(size_t band, size_t bx, size_t by,
+                          unsigned char* buffer);
+        band_state& checked_band(size_t band);
+        const std::vector<unsigned char>& mask_edges(size_t bx, size_t by);
+        void keep_mask_edges(size_t bx, size_t by, const unsigned char* mask);
     public:
         impl(const std::string& filename);
         ~impl();
 		//! Gets the coordinates of the next block to read and loads data.
         boost::array<size_t,4> next_block();
-		//! Retrieve a row of data from that block.
+		//! Start next_block() over, visiting blocks in this order.
+        void set_block_order(cell_order order);
+		//! Coordinates of all width+1 vertices in row iy.
         std::vector<boost::array<double,3>> get_row(size_t iy);
+		//! Coordinates of cnt vertices in row iy starting at column x0.
+        std::vector<boost::array<double,3>> get_row(size_t iy, size_t x0,
+                                                    size_t cnt);
+		//! Transform vertex coordinates of a block in one batch.
+        void cache_coordinates(size_t x0, size_t y0, size_t nx, size_t ny);
+		//! Transform vertex coordinates of a block into the caller's arrays.
+        void vertex_coordinates(size_t x0, size_t y0, size_t nx, size_t ny,
+                                double* x, double* y, double* z);
 		//! The extent of the whole data array.
         boost::array<size_t,2> size();
 		//! GDAL params to transform from matrix location to projected coords.
         boost::array<double,6> coord_projected_transform();
 		void coordinate_transform();
+		//! Size of a native block in pixels.
+        boost::array<size_t,2> block_size();
+		//! Number of blocks in x and y.
+        boost::array<size_t,2> block_count();
+		//! Decode one block. The pointer is valid until the next read.
+        const unsigned char* read_block_data(size_t bx, size_t by);
+		//! Number of bands in the dataset.
+        size_t band_count() const;
+		//! Type and nodata value of a band, counted from one.
+        band_info band(size_t band);
+		//! Decode one block of a band into that band's buffer.
+        const void* read_block_data(size_t band, size_t bx, size_t by);
+		//! Throws unless the band holds pixels of this type.
+        void require_type(size_t band, pixel_type type);
+		//! Copy a row of blocks of a band into width*block height pixels.
+        size_t read_strip(size_t band, size_t by, unsigned char* strip);
+		//! Copy a whole band, in its own type, into width*height pixels.
+        void read_band_data(size_t band, void* raster);
+		//! Hide cells the GDAL mask of this band marks invalid. Zero for none.
+        void set_mask_band(size_t band);
+		//! Mask values of a block, zero where invalid, or null if all valid.
+        const unsigned char* read_mask_block(size_t bx, size_t by);
+		//! Validity of a block with a one-cell ring, or null if all valid.
+        const unsigned char* block_validity(size_t bx, size_t by);
+		//! Validity of every cell, row-major, or empty if all valid.
+        void read_valid_cells(std::vector<bool>& valid);
+		//! Serve blocks through an LRU cache in a mapped scratch file.
+        void enable_tile_cache(const std::string& scratch_file,
+                               size_t budget_bytes);
+        tile_cache_stats tile_cache_statistics() const;
+		//! Copy a row of blocks into a buffer of width*block height.
+        size_t read_strip(size_t by, unsigned char* strip);
+		//! Copy the whole band into a row-major array of width*height.
+        void read_band(std::vector<unsigned char>& raster);
     };
 }
 
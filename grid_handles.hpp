@@ -0,0 +1,226 @@
+#ifndef _GRID_HANDLES_HPP_
+#define _GRID_HANDLES_HPP_ 1
+
+#include <cstddef>
+
+
+namespace geodec
+{
+
+    /*! Handles and iterators for meshes whose elements are integers.
+     *  They let code written for a CGAL Polyhedron, such as
+     *  disjoint_set_cluster, run on a mesh that computes adjacency
+     *  arithmetically. A handle is a mesh pointer and an index, and
+     *  operator-> returns the handle itself, so h->opposite() works.
+     *
+     *  MESH must provide
+     *    facet_halfedge(f), next_facet(f), next_vertex(v), next_halfedge(h),
+     *    halfedge_next(h), halfedge_prev(h), halfedge_opposite(h),
+     *    halfedge_facet(h), halfedge_vertex(h), halfedge_is_border(h),
+     *    facet_id(f), vertex_id(v), point(v)
+     *  and the type Point_3.
+     */
+    template<class MESH> class grid_halfedge_handle;
+
+
+    template<class MESH>
+    class grid_vertex_handle
+    {
+    protected:
+        const MESH* mesh_;
+        size_t idx_;
+    public:
+        grid_vertex_handle() : mesh_(0), idx_(0) {}
+        grid_vertex_handle(const MESH* mesh, size_t idx)
+            : mesh_(mesh), idx_(idx) {}
+
+        const grid_vertex_handle* operator->() const { return this; }
+        const grid_vertex_handle& operator*() const { return *this; }
+
+        size_t id() const { return mesh_->vertex_id(idx_); }
+        typename MESH::Point_3 point() const { return mesh_->point(idx_); }
+        size_t index() const { return idx_; }
+
+        bool operator==(const grid_vertex_handle& o) const {
+            return idx_==o.idx_;
+        }
+        bool operator!=(const grid_vertex_handle& o) const {
+            return idx_!=o.idx_;
+        }
+        bool operator<(const grid_vertex_handle& o) const {
+            return idx_<o.idx_;
+        }
+    };
+
+
+
+    template<class MESH>
+    class grid_facet_handle
+    {
+    protected:
+        const MESH* mesh_;
+        size_t idx_;
+    public:
+        grid_facet_handle() : mesh_(0), idx_(0) {}
+        grid_facet_handle(const MESH* mesh, size_t idx)
+            : mesh_(mesh), idx_(idx) {}
+
+        const grid_facet_handle* operator->() const { return this; }
+        const grid_facet_handle& operator*() const { return *this; }
+
+        size_t id() const { return mesh_->facet_id(idx_); }
+        size_t index() const { return idx_; }
+        grid_halfedge_handle<MESH> halfedge() const {
+            return grid_halfedge_handle<MESH>(mesh_,
+                                              mesh_->facet_halfedge(idx_));
+        }
+        grid_halfedge_handle<MESH> facet_begin() const { return halfedge(); }
+
+        bool operator==(const grid_facet_handle& o) const {
+            return idx_==o.idx_;
+        }
+        bool operator!=(const grid_facet_handle& o) const {
+            return idx_!=o.idx_;
+        }
+        bool operator<(const grid_facet_handle& o) const {
+            return idx_<o.idx_;
+        }
+    };
+
+
+
+    /*! A halfedge handle is also the circulator around its facet,
+     *  so ++ moves to the next halfedge of the same facet.
+     */
+    template<class MESH>
+    class grid_halfedge_handle
+    {
+    protected:
+        const MESH* mesh_;
+        size_t idx_;
+    public:
+        grid_halfedge_handle() : mesh_(0), idx_(0) {}
+        grid_halfedge_handle(const MESH* mesh, size_t idx)
+            : mesh_(mesh), idx_(idx) {}
+
+        const grid_halfedge_handle* operator->() const { return this; }
+        const grid_halfedge_handle& operator*() const { return *this; }
+
+        size_t index() const { return idx_; }
+        grid_halfedge_handle next() const {
+            return grid_halfedge_handle(mesh_, mesh_->halfedge_next(idx_));
+        }
+        grid_halfedge_handle prev() const {
+            return grid_halfedge_handle(mesh_, mesh_->halfedge_prev(idx_));
+        }
+        grid_halfedge_handle opposite() const {
+            return grid_halfedge_handle(mesh_, mesh_->halfedge_opposite(idx_));
+        }
+        bool is_border() const { return mesh_->halfedge_is_border(idx_); }
+        //! The facet of a border halfedge is not valid.
+        grid_facet_handle<MESH> facet() const {
+            return grid_facet_handle<MESH>(mesh_, mesh_->halfedge_facet(idx_));
+        }
+        //! The vertex at the head of the halfedge.
+        grid_vertex_handle<MESH> vertex() const {
+            return grid_vertex_handle<MESH>(mesh_,
+                                            mesh_->halfedge_vertex(idx_));
+        }
+
+        grid_halfedge_handle& operator++() {
+            idx_=mesh_->halfedge_next(idx_);
+            return *this;
+        }
+        grid_halfedge_handle operator++(int) {
+            grid_halfedge_handle was(*this);
+            ++(*this);
+            return was;
+        }
+        grid_halfedge_handle& operator--() {
+            idx_=mesh_->halfedge_prev(idx_);
+            return *this;
+        }
+
+        bool operator==(const grid_halfedge_handle& o) const {
+            return idx_==o.idx_;
+        }
+        bool operator!=(const grid_halfedge_handle& o) const {
+            return idx_!=o.idx_;
+        }
+        bool operator<(const grid_halfedge_handle& o) const {
+            return idx_<o.idx_;
+        }
+    };
+
+
+
+    /*! Iterators are handles that step through the mesh's storage
+     *  order instead of around a facet. They convert from handles,
+     *  as CGAL's do.
+     */
+    template<class MESH>
+    class grid_facet_iterator : public grid_facet_handle<MESH>
+    {
+    public:
+        grid_facet_iterator() {}
+        grid_facet_iterator(const MESH* mesh, size_t idx)
+            : grid_facet_handle<MESH>(mesh, idx) {}
+        grid_facet_iterator(const grid_facet_handle<MESH>& h)
+            : grid_facet_handle<MESH>(h) {}
+        grid_facet_iterator& operator++() {
+            this->idx_=this->mesh_->next_facet(this->idx_);
+            return *this;
+        }
+        grid_facet_iterator operator++(int) {
+            grid_facet_iterator was(*this);
+            ++(*this);
+            return was;
+        }
+    };
+
+
+    template<class MESH>
+    class grid_vertex_iterator : public grid_vertex_handle<MESH>
+    {
+    public:
+        grid_vertex_iterator() {}
+        grid_vertex_iterator(const MESH* mesh, size_t idx)
+            : grid_vertex_handle<MESH>(mesh, idx) {}
+        grid_vertex_iterator(const grid_vertex_handle<MESH>& h)
+            : grid_vertex_handle<MESH>(h) {}
+        grid_vertex_iterator& operator++() {
+            this->idx_=this->mesh_->next_vertex(this->idx_);
+            return *this;
+        }
+        grid_vertex_iterator operator++(int) {
+            grid_vertex_iterator was(*this);
+            ++(*this);
+            return was;
+        }
+    };
+
+
+    template<class MESH>
+    class grid_halfedge_iterator : public grid_halfedge_handle<MESH>
+    {
+    public:
+        grid_halfedge_iterator() {}
+        grid_halfedge_iterator(const MESH* mesh, size_t idx)
+            : grid_halfedge_handle<MESH>(mesh, idx) {}
+        grid_halfedge_iterator(const grid_halfedge_handle<MESH>& h)
+            : grid_halfedge_handle<MESH>(h) {}
+        grid_halfedge_iterator& operator++() {
+            this->idx_=this->mesh_->next_halfedge(this->idx_);
+            return *this;
+        }
+        grid_halfedge_iterator operator++(int) {
+            grid_halfedge_iterator was(*this);
+            ++(*this);
+            return was;
+        }
+    };
+
+}
+
+
+#endif // _GRID_HANDLES_HPP_
@@ -3,16 +3,46 @@
 
 #include <stdexcept>
 #include <sstream>
+#include <vector>
+#include <iterator>
+#include <algorithm>
 #include <boost/array.hpp>
+#include <boost/type_traits/is_same.hpp>
 
 #include "hdf5.h"
 
-class HDF_cluster_grid_file
+/*! Maps a C++ type to the HDF5 type for it in memory. */
+template<class T> struct hdf_native_type;
+template<> struct hdf_native_type<unsigned char> {
+    static hid_t get() { return H5T_NATIVE_UCHAR; } };
+template<> struct hdf_native_type<int> {
+    static hid_t get() { return H5T_NATIVE_INT; } };
+template<> struct hdf_native_type<unsigned int> {
+    static hid_t get() { return H5T_NATIVE_UINT; } };
+template<> struct hdf_native_type<long> {
+    static hid_t get() { return H5T_NATIVE_LONG; } };
+template<> struct hdf_native_type<unsigned long> {
+    static hid_t get() { return H5T_NATIVE_ULONG; } };
+template<> struct hdf_native_type<long long> {
+    static hid_t get() { return H5T_NATIVE_LLONG; } };
+template<> struct hdf_native_type<unsigned long long> {
+    static hid_t get() { return H5T_NATIVE_ULLONG; } };
+template<> struct hdf_native_type<float> {
+    static hid_t get() { return H5T_NATIVE_FLOAT; } };
+template<> struct hdf_native_type<double> {
+    static hid_t get() { return H5T_NATIVE_DOUBLE; } };
+
+
+
+/*! An HDF5 file of named arrays, created empty. Groups and datasets
+ *  are written whole, or appended to a piece at a time.
+ */
+class HDF_array_file
 {
+protected:
     hid_t file_id_;
-    hid_t dataset_;
 public:
-    HDF_cluster_grid_file(const std::string& filename, size_t w, size_t h)
+    HDF_array_file(const std::string& filename)
     {
         H5open();
         file_id_ = H5Fcreate( filename.c_str(), H5F_ACC_TRUNC,
@@ -22,16 +52,231 @@ public:
             msg << "Could not open file. Exception " << file_id_;
             throw std::runtime_error(msg.str());
         }
+    }
+
+
+    //! Make a group, such as region_graph or persistence.
+    void create_group(const std::string& name)
+    {
+        hid_t group = H5Gcreate2(file_id_, name.c_str(), H5P_DEFAULT,
+                                 H5P_DEFAULT, H5P_DEFAULT);
+        if (group<0) {
+            std::stringstream msg;
+            msg << "Could not create group " << name << ". Error " << group;
+            throw std::runtime_error(msg.str());
+        }
+        H5Gclose(group);
+    }
+
+
+    /*! Write a contiguous dataset of values.size()/cols rows and
+     *  cols columns, stored as T.
+     */
+    template<class T>
+    void write_array(const std::string& name, const std::vector<T>& values,
+                     size_t cols=1)
+    {
+        hsize_t dims[2] = { values.size()/cols, cols };
+        int rank = (cols>1) ? 2 : 1;
+        hid_t space = H5Screate_simple(rank, dims, NULL);
+        hid_t mtype = hdf_native_type<T>::get();
+        hid_t dataset = H5Dcreate2(file_id_, name.c_str(), mtype, space,
+                                   H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        herr_t ret = dataset;
+        if (dataset>=0) {
+            if (!values.empty()) {
+                ret = H5Dwrite(dataset, mtype, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                               &values[0]);
+            }
+            H5Dclose(dataset);
+        }
+        H5Sclose(space);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not write " << name << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    /*! Make an empty one-dimensional dataset of T that grows with
+     *  append_array, stored in chunks of chunk values.
+     */
+    template<class T>
+    void create_appendable(const std::string& name, size_t chunk=65536)
+    {
+        hsize_t dims[1] = { 0 };
+        hsize_t max_dims[1] = { H5S_UNLIMITED };
+        hsize_t chunk_dims[1] = { chunk };
+        hid_t space = H5Screate_simple(1, dims, max_dims);
+        hid_t create_list = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(create_list, 1, chunk_dims);
+        hid_t dataset = H5Dcreate2(file_id_, name.c_str(),
+                                   hdf_native_type<T>::get(), space,
+                                   H5P_DEFAULT, create_list, H5P_DEFAULT);
+        H5Pclose(create_list);
+        H5Sclose(space);
+        if (dataset<0) {
+            std::stringstream msg;
+            msg << "Could not create " << name << ". Error " << dataset;
+            throw std::runtime_error(msg.str());
+        }
+        H5Dclose(dataset);
+    }
+
+
+    //! Add n values to the end of a dataset from create_appendable.
+    template<class T>
+    void append_array(const std::string& name, const T* values, size_t n)
+    {
+        if (n==0) return;
+        hsize_t start[1] = { array_size(name) };
+        hsize_t dims[1] = { start[0]+n };
+        hid_t dataset = H5Dopen2(file_id_, name.c_str(), H5P_DEFAULT);
+        herr_t ret = H5Dset_extent(dataset, dims);
+        if (ret>=0) {
+            ret = transfer_slice(dataset, start[0], n, const_cast<T*>(values),
+                                 true);
+        }
+        H5Dclose(dataset);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not append " << n << " values to " << name
+                << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    //! Read values [start, start+n) of a one-dimensional dataset.
+    template<class T>
+    void read_array(const std::string& name, size_t start, size_t n,
+                    T* values)
+    {
+        if (n==0) return;
+        hid_t dataset = H5Dopen2(file_id_, name.c_str(), H5P_DEFAULT);
+        herr_t ret = dataset;
+        if (dataset>=0) {
+            ret = transfer_slice(dataset, start, n, values, false);
+            H5Dclose(dataset);
+        }
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not read " << n << " values at " << start
+                << " of " << name << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    //! Number of values in a one-dimensional dataset.
+    size_t array_size(const std::string& name)
+    {
+        hid_t dataset = H5Dopen2(file_id_, name.c_str(), H5P_DEFAULT);
+        if (dataset<0) {
+            std::stringstream msg;
+            msg << "Could not open " << name << ". Error " << dataset;
+            throw std::runtime_error(msg.str());
+        }
+        hid_t space = H5Dget_space(dataset);
+        hsize_t dims[1] = { 0 };
+        H5Sget_simple_extent_dims(space, dims, NULL);
+        H5Sclose(space);
+        H5Dclose(dataset);
+        return dims[0];
+    }
+
+
+    /*! Take a dataset or group out of the file. Its space is not
+     *  reclaimed until the file is repacked.
+     */
+    void remove(const std::string& name)
+    {
+        herr_t ret = H5Ldelete(file_id_, name.c_str(), H5P_DEFAULT);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not remove " << name << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    ~HDF_array_file() {
+        if (file_id_>=0) {
+            H5Fclose(file_id_);
+        }
+    }
+
+private:
+    template<class T>
+    herr_t transfer_slice(hid_t dataset, size_t start, size_t n, T* values,
+                          bool write)
+    {
+        hsize_t offset[1] = { start };
+        hsize_t count[1] = { n };
+        hid_t mspace = H5Screate_simple(1, count, NULL);
+        hid_t fspace = H5Dget_space(dataset);
+        herr_t ret = H5Sselect_hyperslab(fspace, H5S_SELECT_SET, offset, NULL,
+                                         count, NULL);
+        if (ret>=0) {
+            hid_t mtype = hdf_native_type<T>::get();
+            if (write) {
+                ret = H5Dwrite(dataset, mtype, mspace, fspace, H5P_DEFAULT,
+                               values);
+            } else {
+                ret = H5Dread(dataset, mtype, mspace, fspace, H5P_DEFAULT,
+                              values);
+            }
+        }
+        H5Sclose(fspace);
+        H5Sclose(mspace);
+        return ret;
+    }
+};
+
+
+
+/*! Cluster ids for a w x h raster, stored as int in cluster_ids.
+ *  Large or compressed grids are stored in 256 x 256 chunks, and
+ *  write_tile and write_grid write whole chunks at a time. Without
+ *  compression, a whole chunk of int goes straight to the file with
+ *  H5Dwrite_chunk, skipping selection, conversion and the chunk cache,
+ *  so do not mix it with row writes to the same chunk.
+ */
+class HDF_cluster_grid_file : public HDF_array_file
+{
+    hid_t dataset_;
+    size_t w_, h_;
+    bool chunked_;
+    size_t chunk_[2];
+    int compression_;
+    std::vector<int> chunk_buffer_;
+public:
+    //! compression is a deflate level from 1 to 9, or 0 for none.
+    HDF_cluster_grid_file(const std::string& filename, size_t w, size_t h,
+                          int compression=0)
+        : HDF_array_file(filename),
+          w_(w), h_(h), chunked_(compression>0 || h>512 || w>512),
+          compression_(compression)
+    {
+        chunk_[0]=std::min<size_t>(256, std::max<size_t>(h, 1));
+        chunk_[1]=std::min<size_t>(256, std::max<size_t>(w, 1));
 
         hsize_t dset_dims[2] = { h, w };
         hid_t dset_create_param_list = H5Pcreate(H5P_DATASET_CREATE);
-        if (h>512 || w>512) {
-            hsize_t chunk_dims[2] = { 256, 256 };
+        // The chunk cache is a property of access, not creation.
+        hid_t dset_access_param_list = H5Pcreate(H5P_DATASET_ACCESS);
+        if (chunked_) {
+            hsize_t chunk_dims[2] = { chunk_[0], chunk_[1] };
             H5Pset_chunk(dset_create_param_list, 2, chunk_dims);
+            if (compression_>0) {
+                H5Pset_shuffle(dset_create_param_list);
+                H5Pset_deflate(dset_create_param_list, compression_);
+            }
             size_t num_chunk_slots = 521;
             size_t cache_bytes = 512*1024*1024;
             herr_t cache_err = H5Pset_chunk_cache(
-                                                  dset_create_param_list,
+                                                  dset_access_param_list,
                                                   num_chunk_slots,
                                                   cache_bytes,
                                                   H5D_CHUNK_CACHE_W0_DEFAULT
@@ -50,9 +295,9 @@ public:
             throw std::runtime_error(msg.str());
         }
 
-        hid_t dataset_ = H5Dcreate( file_id_, "cluster_ids", 
-                                   H5T_NATIVE_INT, dataspace,
-                                   dset_create_param_list, H5P_DEFAULT);
+        dataset_ = H5Dcreate2( file_id_, "cluster_ids",
+                               H5T_NATIVE_INT, dataspace, H5P_DEFAULT,
+                               dset_create_param_list, dset_access_param_list);
         if (dataset_<0) {
             std::stringstream msg;
             msg << "Could not create dataset. " << dataset_;
@@ -61,45 +306,232 @@ public:
 
         H5Sclose(dataspace);
         H5Pclose(dset_create_param_list);
+        H5Pclose(dset_access_param_list);
     }
 
     
     /*!
      * http://www.hdfgroup.org/HDF5/doc/H5.intro.html#Intro-PMSelectPoints
+     * ITER iterates over facets whose ids are x+y*w.
      */
     template<class ITER, class PMAP>
     void write_points(ITER begin, ITER end, const PMAP& vals)
     {
-        std::vector<boost::array<size_t,2> > indices;
-        std::vector<size_t> usage;
+        std::vector<hsize_t> indices;
+        std::vector<int> usage;
+        size_t hint=size_hint(begin, end,
+            typename std::iterator_traits<ITER>::iterator_category());
+        indices.reserve(2*hint);
+        usage.reserve(hint);
         while (begin!=end) {
-            indices.push_back({ *begin });
-            usage.push_back( vals(begin->id()) );
+            size_t id=begin->id();
+            indices.push_back(id / w_);
+            indices.push_back(id % w_);
+            usage.push_back( vals(id) );
+            ++begin;
         }
-        
-        hsize_t dim2[] = { indices.size() };
+        if (usage.empty()) return;
+
+        hsize_t dim2[] = { usage.size() };
         hsize_t mspace_rank = 1;
         hid_t mid2 = H5Screate_simple( mspace_rank, dim2, NULL);
-        
-        herr_t ret = H5Sselect_elements(fid, H5S_SELECT_SET, indices.size(),
-                                        (const hsize_t **) indices.front());
-        ret = H5Dwrite(dataset, H5T_NATIVE_INT, mid2, fid, H5P_DEFAULT, values);
+        hid_t fid = H5Dget_space(dataset_);
 
+        herr_t ret = H5Sselect_elements(fid, H5S_SELECT_SET, usage.size(),
+                                        &indices[0]);
+        if (ret>=0) {
+            ret = H5Dwrite(dataset_, H5T_NATIVE_INT, mid2, fid, H5P_DEFAULT,
+                           &usage[0]);
+        }
+        H5Sclose(fid);
         H5Sclose(mid2);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not write points " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    /*! Write rows [y0, y0+rows) of the grid from a row-major buffer
+     *  of rows*w values. HDF converts T to the stored int.
+     */
+    template<class T>
+    void write_rows(size_t y0, size_t rows, const T* data)
+    {
+        transfer_rows(y0, rows, const_cast<T*>(data), true);
+    }
+
+
+    //! Read rows [y0, y0+rows) of the grid into a buffer of rows*w.
+    template<class T>
+    void read_rows(size_t y0, size_t rows, T* data)
+    {
+        transfer_rows(y0, rows, data, false);
+    }
+
+
+    /*! Write a tw x th tile with lower corner (x0,y0) from a
+     *  row-major buffer of tw*th values. A tile that is exactly one
+     *  chunk, or the part of an edge chunk inside the grid, is written
+     *  as a whole chunk.
+     */
+    template<class T>
+    void write_tile(size_t x0, size_t y0, size_t tw, size_t th,
+                    const T* data)
+    {
+        if (tw==0 || th==0) return;
+        if (chunked_ && compression_==0 && boost::is_same<T,int>::value
+                && is_chunk(x0, y0, tw, th)) {
+            write_chunk(x0, y0, tw, th, reinterpret_cast<const int*>(data));
+            return;
+        }
+        hsize_t start[2] = { y0, x0 };
+        hsize_t count[2] = { th, tw };
+        hid_t mspace = H5Screate_simple( 2, count, NULL );
+        hid_t fspace = H5Dget_space(dataset_);
+        herr_t ret = H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL,
+                                         count, NULL);
+        if (ret>=0) {
+            ret = H5Dwrite(dataset_, hdf_native_type<T>::get(), mspace,
+                           fspace, H5P_DEFAULT, data);
+        }
+        H5Sclose(fspace);
+        H5Sclose(mspace);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not write tile at " << x0 << ", " << y0
+                << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+
+    /*! Write a strip of full rows starting at a chunk boundary, one
+     *  chunk-sized tile at a time. rows is the chunk height, or less
+     *  at the end of the grid.
+     */
+    template<class T>
+    void write_strip(size_t y0, size_t rows, const T* data)
+    {
+        if (!chunked_) {
+            write_rows(y0, rows, data);
+            return;
+        }
+        std::vector<T> tile(chunk_[0]*chunk_[1]);
+        for (size_t x0=0; x0<w_; x0+=chunk_[1]) {
+            size_t tw=std::min(chunk_[1], w_-x0);
+            for (size_t iy=0; iy<rows; iy++) {
+                std::copy(data+iy*w_+x0, data+iy*w_+x0+tw, &tile[iy*tw]);
+            }
+            write_tile(x0, y0, tw, rows, &tile[0]);
+        }
     }
 
 
+    //! Write the whole grid from a row-major buffer of w*h values.
+    template<class T>
+    void write_grid(const T* data)
+    {
+        for (size_t y0=0; y0<h_; y0+=chunk_[0]) {
+            write_strip(y0, std::min(chunk_[0], h_-y0), data+y0*w_);
+        }
+    }
+
+
+    //! Chunk height and width. An unchunked grid reports its size.
+    boost::array<size_t,2> chunk_size() const
+    {
+        boost::array<size_t,2> size;
+        size[0] = chunked_ ? chunk_[0] : h_;
+        size[1] = chunked_ ? chunk_[1] : w_;
+        return size;
+    }
+
+
+    size_t width() const { return w_; }
+    size_t height() const { return h_; }
+
+
     ~HDF_cluster_grid_file() {
         if (dataset_>=0) {
             H5Dclose(dataset_);
         }
-        if (file_id_>=0) {
-            H5Fclose(file_id_);
+    }
+
+
+private:
+    template<class ITER>
+    static size_t size_hint(ITER begin, ITER end,
+                            std::random_access_iterator_tag)
+    {
+        return end-begin;
+    }
+    template<class ITER, class TAG>
+    static size_t size_hint(ITER, ITER, TAG) { return 0; }
+
+
+    bool is_chunk(size_t x0, size_t y0, size_t tw, size_t th) const
+    {
+        return x0%chunk_[1]==0 && y0%chunk_[0]==0
+            && tw==std::min(chunk_[1], w_-x0) && th==std::min(chunk_[0], h_-y0);
+    }
+
+
+    //! A chunk at the edge is padded to full size, as HDF5 stores it.
+    void write_chunk(size_t x0, size_t y0, size_t tw, size_t th,
+                     const int* data)
+    {
+        const int* chunk=data;
+        if (tw!=chunk_[1] || th!=chunk_[0]) {
+            chunk_buffer_.assign(chunk_[0]*chunk_[1], 0);
+            for (size_t iy=0; iy<th; iy++) {
+                std::copy(data+iy*tw, data+(iy+1)*tw,
+                          &chunk_buffer_[iy*chunk_[1]]);
+            }
+            chunk=&chunk_buffer_[0];
+        }
+        hsize_t offset[2] = { y0, x0 };
+        herr_t ret = H5Dwrite_chunk(dataset_, H5P_DEFAULT, 0, offset,
+                                    chunk_[0]*chunk_[1]*sizeof(int), chunk);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not write chunk at " << x0 << ", " << y0
+                << ". Error " << ret;
+            throw std::runtime_error(msg.str());
         }
     }
 
 
-    
+    template<class T>
+    void transfer_rows(size_t y0, size_t rows, T* data, bool write)
+    {
+        if (rows==0) return;
+        hsize_t start[2] = { y0, 0 };
+        hsize_t count[2] = { rows, w_ };
+        hid_t mspace = H5Screate_simple( 2, count, NULL );
+        hid_t fspace = H5Dget_space(dataset_);
+        herr_t ret = H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL,
+                                         count, NULL);
+        if (ret>=0) {
+            hid_t mtype=hdf_native_type<T>::get();
+            if (write) {
+                ret = H5Dwrite(dataset_, mtype, mspace, fspace, H5P_DEFAULT,
+                               data);
+            } else {
+                ret = H5Dread(dataset_, mtype, mspace, fspace, H5P_DEFAULT,
+                              data);
+            }
+        }
+        H5Sclose(fspace);
+        H5Sclose(mspace);
+        if (ret<0) {
+            std::stringstream msg;
+            msg << "Could not transfer rows " << y0 << " to " << y0+rows
+                << ". Error " << ret;
+            throw std::runtime_error(msg.str());
+        }
+    }
 };
 
 
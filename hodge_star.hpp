@@ -0,0 +1,143 @@
+#ifndef _HODGE_STAR_HPP_
+#define _HODGE_STAR_HPP_ 1
+
+#include <vector>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "dec_operators.hpp"
+
+
+namespace geodec
+{
+
+    /*! Diagonal Hodge stars of a quad complex, one entry per id.
+     *  star0 is the area of the dual cell of a vertex, star1 the
+     *  ratio of dual to primal edge length, and star2 one over the
+     *  area of a face. Missing elements have zero entries.
+     */
+    struct diagonal_hodge
+    {
+        std::vector<double> star0;
+        std::vector<double> star1;
+        std::vector<double> star2;
+    };
+
+
+
+    /*! Hodge stars of a quad_mesh from its geotransform.
+     *  The dual of a face is its centroid, so each face gives a
+     *  quarter of its area to each corner and a dual edge of half the
+     *  crossing side to each of its edges. Edges and vertices on the
+     *  border of the mesh get only the part that lies inside it.
+     */
+    template<class Kernel>
+    void grid_hodge_stars(const quad_mesh<Kernel>& mesh, diagonal_hodge& hodge)
+    {
+        const grid_geometry& geometry=mesh.geometry();
+        double area=geometry.cell_area();
+        double row_length=geometry.row_edge_length();
+        double column_length=geometry.column_edge_length();
+        size_t w=mesh.width();
+        size_t h=mesh.height();
+        size_t npos=quad_mesh<Kernel>::npos;
+
+        hodge.star0.resize(mesh.vertex_count());
+        hodge.star1.resize(mesh.edge_count());
+        hodge.star2.resize(mesh.face_count());
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.vertex_count()),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t v=range.begin(); v!=range.end(); v++) {
+                size_t ix=v%(w+1), iy=v/(w+1);
+                // Faces touching the vertex, shifted by one so the
+                // face below and west of vertex 0 is (0,0).
+                int faces=0;
+                for (int corner=0; corner<4; corner++) {
+                    size_t fx=ix+corner%2, fy=iy+corner/2;
+                    if (fx>=1 && fy>=1 && fx<=w && fy<=h
+                            && mesh.facet_exists((fx-1)+(fy-1)*w)) {
+                        faces++;
+                    }
+                }
+                hodge.star0[v]=faces*area/4;
+            }
+        });
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.edge_count()),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t e=range.begin(); e!=range.end(); e++) {
+                boost::array<size_t,2> faces=mesh.edge_faces(e);
+                int inside=(faces[0]!=npos)+(faces[1]!=npos);
+                if (mesh.is_row_edge(e)) {
+                    hodge.star1[e]=0.5*inside*column_length/row_length;
+                } else {
+                    hodge.star1[e]=0.5*inside*row_length/column_length;
+                }
+            }
+        });
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.face_count()),
+            [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t f=range.begin(); f!=range.end(); f++) {
+                hodge.star2[f] = mesh.facet_exists(f) ? 1/area : 0;
+            }
+        });
+    }
+
+
+
+    /*! The Laplace-de Rham operator on 0-forms,
+     *  L = star0^-1 d0^T star1 d0, which is positive semi-definite,
+     *  so diffusion is du/dt = -D L u. It is assembled directly as a
+     *  five-point stencil in CSR form, with columns in increasing order:
+     *  south, west, the vertex, east, north. Assemble once and reuse
+     *  it every time step.
+     */
+    template<class Kernel, class VALUE, class INDEX>
+    void grid_laplacian(const quad_mesh<Kernel>& mesh,
+                        const diagonal_hodge& hodge,
+                        csr_matrix<VALUE,INDEX>& laplacian)
+    {
+        // vertex_edges lists east, north, west, south.
+        static const int edge_order[4]={3,2,0,1};
+        size_t npos=quad_mesh<Kernel>::npos;
+        assemble_rows(mesh.vertex_count(), mesh.vertex_count(), 5,
+            [&](size_t v) -> size_t {
+                if (hodge.star0[v]==0) return 0;
+                boost::array<size_t,4> edges=mesh.vertex_edges(v);
+                size_t cnt=1;
+                for (int i=0; i<4; i++) {
+                    if (edges[i]!=npos) cnt++;
+                }
+                return cnt;
+            },
+            [&](size_t v, INDEX* cols, VALUE* vals) {
+                if (hodge.star0[v]==0) return;
+                boost::array<size_t,4> edges=mesh.vertex_edges(v);
+                double inverse_area=1/hodge.star0[v];
+                double diagonal=0;
+                int k=0;
+                for (int i=0; i<4; i++) {
+                    size_t e=edges[edge_order[i]];
+                    if (i==2) {
+                        cols[k]=v;
+                        k++;
+                    }
+                    if (e==npos) continue;
+                    boost::array<size_t,2> ends=mesh.edge_vertices(e);
+                    double weight=hodge.star1[e]*inverse_area;
+                    cols[k]=(ends[0]==v) ? ends[1] : ends[0];
+                    vals[k]=-weight;
+                    diagonal+=weight;
+                    k++;
+                }
+                for (int i=0; i<k; i++) {
+                    if (cols[i]==v) vals[i]=diagonal;
+                }
+            }, laplacian);
+    }
+
+}
+
+
+#endif // _HODGE_STAR_HPP_
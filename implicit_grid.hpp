@@ -0,0 +1,326 @@
+#ifndef _IMPLICIT_GRID_HPP_
+#define _IMPLICIT_GRID_HPP_ 1
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <boost/array.hpp>
+#include "grid_handles.hpp"
+#include "gdal_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! Positions on a regular grid from a GDAL geotransform.
+     *  Vertex (ix,iy) is the corner of pixels, at
+     *  x = t[0] + ix*t[1] + iy*t[2], y = t[3] + ix*t[4] + iy*t[5].
+     *  Every position, length, and area comes from those six numbers,
+     *  so nothing is stored per vertex or per cell.
+     */
+    class grid_geometry
+    {
+        boost::array<double,6> xform_;
+    public:
+        //! x is the column and y the row, as in Build_grid.
+        grid_geometry()
+        {
+            xform_[0]=0; xform_[1]=1; xform_[2]=0;
+            xform_[3]=0; xform_[4]=0; xform_[5]=1;
+        }
+        grid_geometry(const boost::array<double,6>& xform) : xform_(xform) {}
+
+        const boost::array<double,6>& transform() const { return xform_; }
+
+        //! Position of a vertex, or of any fractional grid location.
+        boost::array<double,2> location(double ix, double iy) const
+        {
+            boost::array<double,2> loc;
+            loc[0]=xform_[0]+ix*xform_[1]+iy*xform_[2];
+            loc[1]=xform_[3]+ix*xform_[4]+iy*xform_[5];
+            return loc;
+        }
+
+        //! Center of the cell whose lower corner is vertex (ix,iy).
+        boost::array<double,2> cell_centroid(size_t ix, size_t iy) const
+        {
+            return location(ix+0.5, iy+0.5);
+        }
+
+        //! Length of an edge from (ix,iy) to (ix+1,iy).
+        double row_edge_length() const
+        {
+            return std::sqrt(xform_[1]*xform_[1]+xform_[4]*xform_[4]);
+        }
+
+        //! Length of an edge from (ix,iy) to (ix,iy+1).
+        double column_edge_length() const
+        {
+            return std::sqrt(xform_[2]*xform_[2]+xform_[5]*xform_[5]);
+        }
+
+        //! Every cell is the same parallelogram.
+        double cell_area() const
+        {
+            return std::fabs(xform_[1]*xform_[5]-xform_[2]*xform_[4]);
+        }
+    };
+
+
+
+    /*! A w x h grid of quadrilaterals that stores only its size and a
+     *  grid_geometry. Facet ids are ix+iy*w and vertex ids are
+     *  ix+iy*(w+1), the same as Build_grid, and facets list their
+     *  vertices in the same order. Attributes belong in property maps
+     *  keyed by those ids, so a cell costs only its attributes.
+     *
+     *  It has the Polyhedron types and members that disjoint_set_cluster,
+     *  write_complex and examine_polyhedron_grid use.
+     *
+     *  An optional mask, one bit per cell, marks cells that are
+     *  missing. Missing cells are skipped by iteration and act like
+     *  the outside of the grid, so their neighbors get border
+     *  halfedges. Ids of the remaining cells do not change.
+     *
+     *  Halfedges are numbered 4*cell+side over a grid with a ring of
+     *  virtual cells around it. Side k of a cell runs from corner k to
+     *  corner k+1, where the corners are (0,0), (0,1), (1,1), (1,0)
+     *  from the cell's lower corner. The halfedges of virtual cells
+     *  that face real cells are the border halfedges. Next and prev
+     *  of a border halfedge stay within its virtual cell, unlike CGAL,
+     *  which walks the border.
+     */
+    template<class Kernel>
+    class implicit_grid
+    {
+    public:
+        typedef Kernel Traits;
+        typedef typename Kernel::Point_3 Point_3;
+        typedef implicit_grid<Kernel> self;
+        typedef grid_facet_handle<self> Facet_const_handle;
+        typedef grid_facet_iterator<self> Facet_const_iterator;
+        typedef grid_halfedge_handle<self> Halfedge_const_handle;
+        typedef grid_halfedge_iterator<self> Halfedge_const_iterator;
+        typedef Halfedge_const_handle Halfedge_around_facet_const_circulator;
+        typedef grid_vertex_handle<self> Vertex_const_handle;
+        typedef grid_vertex_iterator<self> Vertex_const_iterator;
+    protected:
+        size_t w_, h_;
+        grid_geometry geometry_;
+        //! True for cells that exist. Empty means all exist.
+        std::vector<bool> mask_;
+        size_t facet_cnt_;
+        size_t vertex_cnt_;
+        size_t halfedge_cnt_;
+
+        // Cell offset across each side, and corner offsets.
+        static int dx(int side) { static const int d[4]={-1,0,1,0}; return d[side]; }
+        static int dy(int side) { static const int d[4]={0,1,0,-1}; return d[side]; }
+        static int cx(int corner) { static const int c[4]={0,0,1,1}; return c[corner]; }
+        static int cy(int corner) { static const int c[4]={0,1,1,0}; return c[corner]; }
+
+        size_t ext_width() const { return w_+2; }
+        size_t halfedge_end() const { return 4*(w_+2)*(h_+2); }
+
+        //! Is the cell at extended coordinates a real facet?
+        bool is_cell(long ex, long ey) const {
+            return ex>=1 && ey>=1 && ex<=long(w_) && ey<=long(h_)
+                && facet_exists((ex-1)+(ey-1)*w_);
+        }
+        bool keep_halfedge(size_t h) const {
+            long ex=(h/4)%ext_width();
+            long ey=(h/4)/ext_width();
+            int side=h%4;
+            return is_cell(ex, ey) || is_cell(ex+dx(side), ey+dy(side));
+        }
+    public:
+        implicit_grid(size_t w, size_t h,
+                      const grid_geometry& geometry=grid_geometry())
+            : w_(w), h_(h), geometry_(geometry), facet_cnt_(w*h),
+              vertex_cnt_((w+1)*(h+1)), halfedge_cnt_(2*(w*(h+1)+h*(w+1)))
+        {
+        }
+
+        //! mask has w*h entries, true where a cell exists.
+        implicit_grid(size_t w, size_t h, const std::vector<bool>& mask,
+                      const grid_geometry& geometry=grid_geometry())
+            : w_(w), h_(h), geometry_(geometry), mask_(mask)
+        {
+            count_elements();
+        }
+
+        size_t width() const { return w_; }
+        size_t height() const { return h_; }
+        const grid_geometry& geometry() const { return geometry_; }
+
+        size_t size_of_facets() const { return facet_cnt_; }
+        size_t size_of_vertices() const { return vertex_cnt_; }
+        size_t size_of_halfedges() const { return halfedge_cnt_; }
+
+        bool facet_exists(size_t f) const {
+            return mask_.empty() || mask_[f];
+        }
+        //! A vertex exists if any of its four cells exists.
+        bool vertex_exists(size_t v) const {
+            if (mask_.empty()) return true;
+            long ex=v%(w_+1);
+            long ey=v/(w_+1);
+            return is_cell(ex,ey) || is_cell(ex+1,ey)
+                || is_cell(ex,ey+1) || is_cell(ex+1,ey+1);
+        }
+
+        Facet_const_iterator facets_begin() const {
+            size_t f=0;
+            if (w_*h_>0 && !facet_exists(f)) f=next_facet(f);
+            return Facet_const_iterator(this, f);
+        }
+        Facet_const_iterator facets_end() const {
+            return Facet_const_iterator(this, w_*h_);
+        }
+        Vertex_const_iterator vertices_begin() const {
+            size_t v=0;
+            if (!vertex_exists(v)) v=next_vertex(v);
+            return Vertex_const_iterator(this, v);
+        }
+        Vertex_const_iterator vertices_end() const {
+            return Vertex_const_iterator(this, (w_+1)*(h_+1));
+        }
+        Halfedge_const_iterator halfedges_begin() const {
+            size_t h=0;
+            if (!keep_halfedge(h)) h=next_halfedge(h);
+            return Halfedge_const_iterator(this, h);
+        }
+        Halfedge_const_iterator halfedges_end() const {
+            return Halfedge_const_iterator(this, halfedge_end());
+        }
+
+        // Arithmetic adjacency used by the handles.
+        size_t next_facet(size_t f) const {
+            do {
+                f++;
+            } while (f<w_*h_ && !facet_exists(f));
+            return f;
+        }
+        size_t next_vertex(size_t v) const {
+            do {
+                v++;
+            } while (v<(w_+1)*(h_+1) && !vertex_exists(v));
+            return v;
+        }
+        size_t next_halfedge(size_t h) const {
+            do {
+                h++;
+            } while (h<halfedge_end() && !keep_halfedge(h));
+            return h;
+        }
+        size_t facet_id(size_t f) const { return f; }
+        size_t vertex_id(size_t v) const { return v; }
+
+        size_t facet_halfedge(size_t f) const {
+            return 4*((f%w_+1)+(f/w_+1)*ext_width());
+        }
+        size_t halfedge_next(size_t h) const { return (h & ~size_t(3)) | ((h+1)&3); }
+        size_t halfedge_prev(size_t h) const { return (h & ~size_t(3)) | ((h+3)&3); }
+        size_t halfedge_opposite(size_t h) const {
+            int side=h%4;
+            long cell=h/4 + dx(side) + dy(side)*long(ext_width());
+            return 4*cell + (side+2)%4;
+        }
+        bool halfedge_is_border(size_t h) const {
+            return !is_cell((h/4)%ext_width(), (h/4)/ext_width());
+        }
+        //! Facet index, or w*h, past every raster index, for a border halfedge.
+        size_t halfedge_facet(size_t h) const {
+            if (halfedge_is_border(h)) return w_*h_;
+            return ((h/4)%ext_width()-1) + ((h/4)/ext_width()-1)*w_;
+        }
+        size_t halfedge_vertex(size_t h) const {
+            int corner=(h+1)%4;
+            size_t ix=(h/4)%ext_width()+cx(corner)-1;
+            size_t iy=(h/4)/ext_width()+cy(corner)-1;
+            return ix+iy*(w_+1);
+        }
+
+        // Geometry, computed from the index.
+        Point_3 point(size_t v) const {
+            boost::array<double,2> loc=geometry_.location(v%(w_+1), v/(w_+1));
+            return Point_3(loc[0], loc[1], 0);
+        }
+        Point_3 facet_centroid(size_t f) const {
+            boost::array<double,2> loc=geometry_.cell_centroid(f%w_, f/w_);
+            return Point_3(loc[0], loc[1], 0);
+        }
+        double facet_area(size_t) const { return geometry_.cell_area(); }
+        //! Sides 0 and 2 run along a column, sides 1 and 3 along a row.
+        double edge_length(size_t h) const {
+            if (h%2==0) return geometry_.column_edge_length();
+            return geometry_.row_edge_length();
+        }
+
+        //! Checks that opposite and next are inverses of themselves.
+        bool is_valid(bool verbose=false) const {
+            for (auto h=halfedges_begin(); h!=halfedges_end(); ++h) {
+                size_t idx=h.index();
+                bool good = halfedge_opposite(halfedge_opposite(idx))==idx
+                    && halfedge_prev(halfedge_next(idx))==idx
+                    && halfedge_vertex(idx)!=
+                       halfedge_vertex(halfedge_opposite(idx));
+                if (!good) {
+                    if (verbose) {
+                        std::cerr << "bad halfedge " << idx << std::endl;
+                    }
+                    return false;
+                }
+            }
+            return true;
+        }
+        bool is_pure_quad() const { return true; }
+
+    private:
+        void count_elements() {
+            facet_cnt_=0;
+            for (size_t f=0; f<w_*h_; f++) {
+                if (facet_exists(f)) facet_cnt_++;
+            }
+            vertex_cnt_=0;
+            for (size_t v=0; v<(w_+1)*(h_+1); v++) {
+                if (vertex_exists(v)) vertex_cnt_++;
+            }
+            halfedge_cnt_=0;
+            for (auto h=halfedges_begin(); h!=halfedges_end(); ++h) {
+                halfedge_cnt_++;
+            }
+        }
+    };
+
+
+
+    /*! An implicit grid with the size and geotransform of a file. */
+    template<class Kernel>
+    implicit_grid<Kernel> implicit_grid_from_file(gdal_file& reader)
+    {
+        boost::array<size_t,2> size=reader.size();
+        return implicit_grid<Kernel>(size[0], size[1],
+                                     grid_geometry(reader.geo_transform()));
+    }
+
+
+    /*! An implicit grid of the cells a band's nodata value or mask
+     *  marks valid, with the size and geotransform of a file.
+     */
+    template<class Kernel>
+    implicit_grid<Kernel> implicit_grid_from_file(gdal_file& reader,
+                                                  size_t mask_band)
+    {
+        boost::array<size_t,2> size=reader.size();
+        std::vector<bool> valid;
+        reader.set_mask_band(mask_band);
+        reader.read_valid_cells(valid);
+        return implicit_grid<Kernel>(size[0], size[1], valid,
+                                     grid_geometry(reader.geo_transform()));
+    }
+
+}
+
+
+#endif // _IMPLICIT_GRID_HPP_
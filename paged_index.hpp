@@ -0,0 +1,143 @@
+#ifndef _PAGED_INDEX_HPP_
+#define _PAGED_INDEX_HPP_ 1
+
+#include <vector>
+#include <memory>
+#include <limits>
+#include <algorithm>
+
+
+namespace geodec
+{
+
+    /*! Map from dense ids, such as raster vertex ids, to indices.
+     *  Ids are split into pages of 2^PAGE_BITS entries, each allocated
+     *  the first time an id in it is set, so a raster read a block at a
+     *  time, or one with much nodata, pays only for the pages it
+     *  touches. Unset ids read as npos. A page whose ids are all
+     *  erased is freed, so a window swept over a raster holds only
+     *  the pages under it.
+     *
+     *  The page of the last lookup is kept. Neighboring facets and
+     *  vertices of a block mostly share pages, so most lookups skip
+     *  the page table.
+     */
+    template<class INDEX=size_t, unsigned int PAGE_BITS=12>
+    class paged_index
+    {
+        std::vector<std::unique_ptr<INDEX[]>> pages_;
+        //! Ids set in each page.
+        std::vector<size_t> counts_;
+        size_t last_page_;
+        INDEX* last_;
+        size_t size_;
+
+        static const size_t page_size=size_t(1)<<PAGE_BITS;
+
+        INDEX* page(size_t id)
+        {
+            size_t p=id>>PAGE_BITS;
+            if (p==last_page_) return last_;
+            if (p>=pages_.size() || !pages_[p]) return 0;
+            last_page_=p;
+            last_=pages_[p].get();
+            return last_;
+        }
+    public:
+        typedef INDEX index_type;
+        //! Value of an id that has not been set.
+        static const INDEX npos;
+
+        paged_index()
+            : last_page_(std::numeric_limits<size_t>::max()), last_(0), size_(0)
+        {
+        }
+
+        //! Room in the page table for ids [0,n), without allocating pages.
+        void reserve(size_t n)
+        {
+            size_t cnt=(n+page_size-1)>>PAGE_BITS;
+            if (cnt>pages_.size()) {
+                pages_.resize(cnt);
+                counts_.resize(cnt, 0);
+            }
+        }
+
+        INDEX find(size_t id)
+        {
+            INDEX* p=page(id);
+            return p ? p[id & (page_size-1)] : npos;
+        }
+
+        bool contains(size_t id) { return find(id)!=npos; }
+
+        void set(size_t id, INDEX index)
+        {
+            INDEX* p=page(id);
+            if (0==p) {
+                size_t pi=id>>PAGE_BITS;
+                if (pi>=pages_.size()) {
+                    pages_.resize(pi+1);
+                    counts_.resize(pi+1, 0);
+                }
+                pages_[pi].reset(new INDEX[page_size]);
+                p=pages_[pi].get();
+                std::fill(p, p+page_size, npos);
+                last_page_=pi;
+                last_=p;
+            }
+            INDEX& entry=p[id & (page_size-1)];
+            if (entry==npos) {
+                size_++;
+                counts_[id>>PAGE_BITS]++;
+            }
+            entry=index;
+        }
+
+
+        void erase(size_t id)
+        {
+            INDEX* p=page(id);
+            if (0==p || p[id & (page_size-1)]==npos) return;
+            p[id & (page_size-1)]=npos;
+            size_--;
+            size_t pi=id>>PAGE_BITS;
+            if (--counts_[pi]==0) {
+                pages_[pi].reset();
+                last_page_=std::numeric_limits<size_t>::max();
+                last_=0;
+            }
+        }
+
+        //! Ids that have been set.
+        size_t size() const { return size_; }
+
+        //! Bytes held by allocated pages.
+        size_t page_bytes() const
+        {
+            size_t cnt=0;
+            for (size_t p=0; p<pages_.size(); p++) {
+                if (pages_[p]) cnt++;
+            }
+            return cnt*page_size*sizeof(INDEX);
+        }
+
+        void clear()
+        {
+            pages_.clear();
+            counts_.clear();
+            last_page_=std::numeric_limits<size_t>::max();
+            last_=0;
+            size_=0;
+        }
+    };
+
+
+    template<class INDEX, unsigned int PAGE_BITS>
+    const INDEX paged_index<INDEX,PAGE_BITS>::npos=
+        std::numeric_limits<INDEX>::max();
+
+}
+
+
+#endif // _PAGED_INDEX_HPP_
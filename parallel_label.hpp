@@ -0,0 +1,224 @@
+#ifndef _PARALLEL_LABEL_HPP_
+#define _PARALLEL_LABEL_HPP_ 1
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/task_arena.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "raster_label.hpp"
+
+
+namespace geodec
+{
+
+    /*! Labels clusters of a raster by tiles on a TBB thread pool.
+     *  The result is identical to label_raster, the smallest cell id
+     *  of each cluster, for any tile size or thread count.
+     *
+     *  Phase one labels each tile independently with label_tile.
+     *  Phase two compares cells across each seam between tiles, in
+     *  parallel, and records pairs of tile roots that must be joined.
+     *  Those pairs are few, proportional to the length of the seams,
+     *  so they are joined serially in the label array itself.
+     *  Phase three points every cell at its final root, in parallel.
+     *  Only tile roots are read across tiles in phase three, and
+     *  tile roots already hold their final value, so tiles never
+     *  write what another tile reads.
+     */
+    template<class LABEL>
+    class parallel_labeler
+    {
+        size_t width_, height_;
+        size_t tile_w_, tile_h_;
+        size_t tile_cnt_[2];
+        int thread_cnt_;
+
+        typedef std::vector<std::pair<LABEL,LABEL>> pair_list;
+    public:
+        //! thread_cnt of zero lets TBB decide.
+        parallel_labeler(size_t width, size_t height, size_t tile_w,
+                         size_t tile_h, int thread_cnt=0)
+            : width_(width), height_(height), tile_w_(tile_w), tile_h_(tile_h),
+              thread_cnt_(thread_cnt)
+        {
+            tile_cnt_[0]=(width_+tile_w_-1)/tile_w_;
+            tile_cnt_[1]=(height_+tile_h_-1)/tile_h_;
+        }
+
+
+        template<class COMPARE>
+        void operator()(COMPARE compare, std::vector<LABEL>& labels)
+        {
+            if (width_*height_ > size_t(std::numeric_limits<LABEL>::max())) {
+                throw std::runtime_error("Label type too small for raster");
+            }
+            labels.resize(width_*height_);
+            if (labels.empty()) return;
+
+            tbb::task_arena arena(thread_cnt_>0 ? thread_cnt_ :
+                                  tbb::task_arena::automatic);
+            arena.execute([&] {
+                this->label_tiles(compare, &labels[0]);
+                this->merge_seams(compare, &labels[0]);
+                this->flatten(&labels[0]);
+            });
+        }
+
+    private:
+        //! Extent of tile number t as x0, y0, width, height.
+        boost::array<size_t,4> tile(size_t t) const
+        {
+            boost::array<size_t,4> extent;
+            extent[0]=(t % tile_cnt_[0])*tile_w_;
+            extent[1]=(t / tile_cnt_[0])*tile_h_;
+            extent[2]=std::min(tile_w_, width_-extent[0]);
+            extent[3]=std::min(tile_h_, height_-extent[1]);
+            return extent;
+        }
+
+
+        template<class COMPARE>
+        void label_tiles(COMPARE& compare, LABEL* labels)
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,
+                                            tile_cnt_[0]*tile_cnt_[1]),
+                [&](const tbb::blocked_range<size_t>& r) {
+                    COMPARE local_compare(compare);
+                    for (size_t t=r.begin(); t!=r.end(); t++) {
+                        auto ext=this->tile(t);
+                        label_tile<LABEL>(width_, ext[0], ext[1], ext[2],
+                                          ext[3], local_compare, labels);
+                    }
+                });
+        }
+
+
+        /*! Seams are numbered with vertical seams, at x=k*tile_w,
+         *  first and horizontal seams, at y=k*tile_h, after.
+         */
+        template<class COMPARE>
+        void merge_seams(COMPARE& compare, LABEL* labels)
+        {
+            size_t vertical_cnt=tile_cnt_[0]-1;
+            size_t seam_cnt=vertical_cnt+tile_cnt_[1]-1;
+            tbb::enumerable_thread_specific<pair_list> found;
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, seam_cnt),
+                [&](const tbb::blocked_range<size_t>& r) {
+                    COMPARE local_compare(compare);
+                    pair_list& pairs=found.local();
+                    for (size_t seam=r.begin(); seam!=r.end(); seam++) {
+                        if (seam<vertical_cnt) {
+                            // Cells west of the seam, against the east.
+                            size_t x=(seam+1)*tile_w_-1;
+                            this->seam_pairs(local_compare, labels, x,
+                                             1, width_, height_, pairs);
+                        } else {
+                            // Cells south of the seam, against the north.
+                            size_t y=(seam-vertical_cnt+1)*tile_h_-1;
+                            this->seam_pairs(local_compare, labels, y*width_,
+                                             width_, 1, width_, pairs);
+                        }
+                    }
+                });
+
+            for (auto pl=found.begin(); pl!=found.end(); pl++) {
+                for (auto p=pl->begin(); p!=pl->end(); p++) {
+                    label_union<LABEL>(labels, p->first, p->second);
+                }
+            }
+            for (auto pl=found.begin(); pl!=found.end(); pl++) {
+                for (auto p=pl->begin(); p!=pl->end(); p++) {
+                    labels[p->first]=label_root<LABEL>(labels, p->first);
+                    labels[p->second]=label_root<LABEL>(labels, p->second);
+                }
+            }
+        }
+
+
+        /*! Walk cnt cells along a seam, starting at first and moving
+         *  by step. Each is compared with the cell across at +across.
+         *  Consecutive repeats of a pair are dropped.
+         */
+        template<class COMPARE>
+        void seam_pairs(COMPARE& compare, const LABEL* labels, size_t first,
+                        size_t across, size_t step, size_t cnt,
+                        pair_list& pairs) const
+        {
+            for (size_t i=0; i<cnt; i++) {
+                size_t a=first+i*step;
+                size_t b=a+across;
+                if (compare(a, b) && labels[a]!=labels[b]) {
+                    std::pair<LABEL,LABEL> p(labels[a], labels[b]);
+                    if (pairs.empty() || pairs.back()!=p) {
+                        pairs.push_back(p);
+                    }
+                }
+            }
+        }
+
+
+        void flatten(LABEL* labels)
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,
+                                            tile_cnt_[0]*tile_cnt_[1]),
+                [&](const tbb::blocked_range<size_t>& r) {
+                    for (size_t t=r.begin(); t!=r.end(); t++) {
+                        auto ext=this->tile(t);
+                        for (size_t iy=ext[1]; iy<ext[1]+ext[3]; iy++) {
+                            LABEL* row=labels+iy*width_;
+                            for (size_t ix=ext[0]; ix<ext[0]+ext[2]; ix++) {
+                                LABEL tile_root=row[ix];
+                                LABEL root=labels[tile_root];
+                                if (root!=tile_root) {
+                                    row[ix]=root;
+                                }
+                            }
+                        }
+                    }
+                });
+        }
+    };
+
+
+
+    /*! Label clusters of a width x height raster in parallel.
+     *  Tiles are tile_w by tile_h cells.
+     */
+    template<class LABEL, class COMPARE>
+    void parallel_label_raster(size_t width, size_t height, size_t tile_w,
+                               size_t tile_h, COMPARE compare,
+                               std::vector<LABEL>& labels, int thread_cnt=0)
+    {
+        parallel_labeler<LABEL> labeler(width, height, tile_w, tile_h,
+                                        thread_cnt);
+        labeler(compare, labels);
+    }
+
+
+
+    /*! Read the first band of a raster file and label it in parallel,
+     *  using the file's native GDAL blocks as tiles.
+     *  \returns width and height of the raster.
+     */
+    template<class LABEL>
+    boost::array<size_t,2> parallel_label_file(gdal_file& reader,
+                                std::vector<LABEL>& labels, int thread_cnt=0)
+    {
+        std::vector<unsigned char> values;
+        reader.read_band(values);
+        boost::array<size_t,2> size=reader.size();
+        boost::array<size_t,2> block=reader.block_size();
+        raster_values_equal<unsigned char> compare(values.data());
+        parallel_label_raster(size[0], size[1], block[0], block[1], compare,
+                              labels, thread_cnt);
+        return size;
+    }
+
+}
+
+
+#endif // _PARALLEL_LABEL_HPP_
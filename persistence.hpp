@@ -0,0 +1,353 @@
+#ifndef _PERSISTENCE_HPP_
+#define _PERSISTENCE_HPP_ 1
+
+#include <vector>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <stdint.h>
+#include "disjoint_sets.hpp"
+#include "rips_complex.hpp"
+#include "hdf_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! Birth and death of homology classes of a filtration, one entry
+     *  per class in each array. Simplices are positions in the
+     *  filtration. A class that never dies has an infinite death and
+     *  no death simplex.
+     */
+    struct persistence_diagram
+    {
+        std::vector<int> dimension;
+        std::vector<double> birth;
+        std::vector<double> death;
+        std::vector<uint64_t> birth_simplex;
+        std::vector<uint64_t> death_simplex;
+
+        static const uint64_t npos=uint64_t(-1);
+
+        void add(int dim, double b, double d, uint64_t bs, uint64_t ds)
+        {
+            dimension.push_back(dim);
+            birth.push_back(b);
+            death.push_back(d);
+            birth_simplex.push_back(bs);
+            death_simplex.push_back(ds);
+        }
+
+        size_t size() const { return dimension.size(); }
+
+        void clear()
+        {
+            dimension.clear();
+            birth.clear();
+            death.clear();
+            birth_simplex.clear();
+            death_simplex.clear();
+        }
+    };
+
+
+
+    /*! A set of row keys held as bits, for reducing one column at a
+     *  time. Each level has a bit for each nonzero word of the level
+     *  below, so the highest key is found from the top down without
+     *  scanning empty words. Adding a column flips its keys. Taking
+     *  the keys out, highest first, leaves the set empty for the next
+     *  column.
+     */
+    class bit_column
+    {
+        std::vector<std::vector<uint64_t>> levels_;
+
+        static int highest_bit(uint64_t word)
+        {
+            return 63-__builtin_clzll(word);
+        }
+    public:
+        explicit bit_column(size_t key_cnt)
+        {
+            size_t n=std::max<size_t>(key_cnt, 1);
+            do {
+                n=(n+63)/64;
+                levels_.push_back(std::vector<uint64_t>(n, 0));
+            } while (n>1);
+        }
+
+        void flip(size_t key)
+        {
+            for (size_t l=0; l<levels_.size(); l++) {
+                uint64_t& word=levels_[l][key/64];
+                bool was_empty=(word==0);
+                word^=uint64_t(1)<<(key%64);
+                // A word above changes only if this one became or
+                // stopped being empty.
+                if (was_empty==(word==0)) break;
+                key/=64;
+            }
+        }
+
+        bool empty() const { return levels_.back()[0]==0; }
+
+        //! The largest key in the set, which must not be empty.
+        size_t highest() const
+        {
+            size_t key=0;
+            for (size_t l=levels_.size(); l-->0; ) {
+                key=key*64+highest_bit(levels_[l][key]);
+            }
+            return key;
+        }
+
+        //! Move the keys into out, highest first, emptying the set.
+        void drain(std::vector<uint32_t>& out)
+        {
+            while (!empty()) {
+                size_t key=highest();
+                out.push_back(uint32_t(key));
+                flip(key);
+            }
+        }
+    };
+
+
+
+    namespace detail
+    {
+        /*! Positions in the filtration of its edges, found by their
+         *  vertices. Rows are by lower vertex, sorted by upper vertex.
+         */
+        class edge_lookup
+        {
+            std::vector<size_t> offsets_;
+            //! Upper vertex and rank among edges, together for one miss.
+            std::vector<std::pair<int,uint32_t>> row_;
+        public:
+            //! edges holds the filtration position of each edge, in order.
+            edge_lookup(const std::vector<filtered_simplex>& filtration,
+                        const std::vector<size_t>& edges, size_t vertex_cnt)
+                : offsets_(vertex_cnt+1, 0), row_(edges.size())
+            {
+                for (size_t e=0; e<edges.size(); e++) {
+                    offsets_[filtration[edges[e]].vertex[0]+1]++;
+                }
+                for (size_t v=0; v<vertex_cnt; v++) {
+                    offsets_[v+1]+=offsets_[v];
+                }
+                std::vector<size_t> next(offsets_.begin(), offsets_.end()-1);
+                for (size_t e=0; e<edges.size(); e++) {
+                    const filtered_simplex& s=filtration[edges[e]];
+                    row_[next[s.vertex[0]]++]=
+                        std::make_pair(s.vertex[1], uint32_t(e));
+                }
+                for (size_t v=0; v<vertex_cnt; v++) {
+                    std::sort(row_.begin()+offsets_[v],
+                              row_.begin()+offsets_[v+1]);
+                }
+            }
+
+            //! Rank among edges of (a,b), a<b.
+            uint32_t rank(int a, int b) const
+            {
+                auto begin=row_.begin()+offsets_[a];
+                auto end=row_.begin()+offsets_[a+1];
+                auto found=std::lower_bound(begin, end,
+                                            std::make_pair(b, uint32_t(0)));
+                if (found==end || found->first!=b) {
+                    std::stringstream msg;
+                    msg << "Edge " << a << ", " << b << " of a triangle is "
+                        << "not in the filtration";
+                    throw std::runtime_error(msg.str());
+                }
+                return found->second;
+            }
+        };
+    }
+
+
+
+    /*! Persistence of classes in dimensions zero and one of a
+     *  filtration, such as rips_complex::filtration() gives. Simplices
+     *  must come in filtration order with dense vertex ids. Simplices
+     *  above dimension two are ignored. Pairs that are born and die at
+     *  the same value are left out.
+     *
+     *  Dimension zero is union-find over the edges. When an edge joins
+     *  two components, the younger one dies there.
+     *
+     *  Dimension one reduces the coboundary matrix, whose columns are
+     *  edges and whose rows are the triangles on them. Its persistence
+     *  pairs are the same as those of the boundary matrix. Edges are
+     *  reduced from last to first, and the pivot of each column is the
+     *  earliest triangle left in it. The edges that joined components
+     *  in dimension zero would reduce to zero, so they are cleared,
+     *  never built. That leaves about one column per independent
+     *  cycle of the neighborhood graph. The column being reduced is a
+     *  bit_column. Columns that became pivots are kept sparse, as
+     *  sorted triangle keys in one pool.
+     */
+    inline void persistence(const std::vector<filtered_simplex>& filtration,
+                            persistence_diagram& diagram)
+    {
+        diagram.clear();
+        const double infinity=std::numeric_limits<double>::infinity();
+        std::vector<size_t> by_dimension[3];
+        int vertex_cnt=0;
+        for (size_t i=0; i<filtration.size(); i++) {
+            const filtered_simplex& s=filtration[i];
+            if (s.dimension<3) by_dimension[s.dimension].push_back(i);
+            if (s.dimension==0) vertex_cnt=std::max(vertex_cnt, s.vertex[0]+1);
+        }
+        if (by_dimension[2].size()>size_t(std::numeric_limits<uint32_t>::max())) {
+            throw std::runtime_error("Too many triangles for persistence");
+        }
+        const std::vector<size_t>& vertices=by_dimension[0];
+        const std::vector<size_t>& edges=by_dimension[1];
+        const std::vector<size_t>& triangles=by_dimension[2];
+
+        // Dimension zero. Each root knows the oldest vertex of its set.
+        dense_disjoint_sets<unsigned int> dset(vertex_cnt);
+        std::vector<uint64_t> oldest(vertex_cnt);
+        for (size_t i=0; i<vertices.size(); i++) {
+            int v=filtration[vertices[i]].vertex[0];
+            dset.make_set(v);
+            oldest[v]=vertices[i];
+        }
+        std::vector<bool> cleared(edges.size(), false);
+        for (size_t e=0; e<edges.size(); e++) {
+            const filtered_simplex& s=filtration[edges[e]];
+            unsigned int a=dset.find_set(s.vertex[0]);
+            unsigned int b=dset.find_set(s.vertex[1]);
+            if (a==b) continue;
+            uint64_t elder=std::min(oldest[a], oldest[b]);
+            uint64_t younger=std::max(oldest[a], oldest[b]);
+            if (filtration[younger].value<s.value) {
+                diagram.add(0, filtration[younger].value, s.value, younger,
+                            edges[e]);
+            }
+            dset.link(a, b);
+            oldest[dset.find_set(a)]=elder;
+            cleared[e]=true;
+        }
+        for (int v=0; v<vertex_cnt; v++) {
+            if (dset.has_set(v) && dset.find_set(v)==unsigned(v)) {
+                diagram.add(0, filtration[oldest[v]].value, infinity,
+                            oldest[v], persistence_diagram::npos);
+            }
+        }
+
+        // Coboundaries of the edges left, as triangle keys. The key of
+        // the earliest triangle is the highest.
+        size_t tri_cnt=triangles.size();
+        detail::edge_lookup lookup(filtration, edges, vertex_cnt);
+        std::vector<size_t> cob_offsets(edges.size()+1, 0);
+        std::vector<uint32_t> tri_edges(3*tri_cnt);
+        for (size_t t=0; t<tri_cnt; t++) {
+            const filtered_simplex& s=filtration[triangles[t]];
+            int v0=s.vertex[0], v1=s.vertex[1], v2=s.vertex[2];
+            uint32_t faces[3]={ lookup.rank(v0, v1), lookup.rank(v0, v2),
+                                lookup.rank(v1, v2) };
+            for (int f=0; f<3; f++) {
+                tri_edges[3*t+f]=faces[f];
+                if (!cleared[faces[f]]) cob_offsets[faces[f]+1]++;
+            }
+        }
+        for (size_t e=0; e<edges.size(); e++) {
+            cob_offsets[e+1]+=cob_offsets[e];
+        }
+        std::vector<uint32_t> coboundary(cob_offsets[edges.size()]);
+        {
+            std::vector<size_t> next(cob_offsets.begin(), cob_offsets.end()-1);
+            for (size_t t=0; t<tri_cnt; t++) {
+                for (int f=0; f<3; f++) {
+                    uint32_t e=tri_edges[3*t+f];
+                    if (!cleared[e]) coboundary[next[e]++]=uint32_t(tri_cnt-1-t);
+                }
+            }
+        }
+        std::vector<uint32_t>().swap(tri_edges);
+
+        // Reduce. pivot_column holds, for each triangle key that is a
+        // pivot, the slot of the reduced column that has it.
+        const uint32_t none=uint32_t(-1);
+        std::vector<uint32_t> pivot_column(tri_cnt, none);
+        std::vector<size_t> reduced_offsets(1, 0);
+        std::vector<uint32_t> reduced;
+        bit_column working(tri_cnt);
+        for (size_t e=edges.size(); e-->0; ) {
+            if (cleared[e]) continue;
+            for (size_t k=cob_offsets[e]; k<cob_offsets[e+1]; k++) {
+                working.flip(coboundary[k]);
+            }
+            while (!working.empty()) {
+                size_t low=working.highest();
+                uint32_t slot=pivot_column[low];
+                if (slot==none) break;
+                for (size_t k=reduced_offsets[slot]; k<reduced_offsets[slot+1];
+                     k++) {
+                    working.flip(reduced[k]);
+                }
+            }
+            double born=filtration[edges[e]].value;
+            if (working.empty()) {
+                diagram.add(1, born, infinity, edges[e],
+                            persistence_diagram::npos);
+                continue;
+            }
+            size_t low=working.highest();
+            pivot_column[low]=uint32_t(reduced_offsets.size()-1);
+            working.drain(reduced);
+            reduced_offsets.push_back(reduced.size());
+            uint64_t killer=triangles[tri_cnt-1-low];
+            if (born<filtration[killer].value) {
+                diagram.add(1, born, filtration[killer].value, edges[e], killer);
+            }
+        }
+    }
+
+
+
+    /*! Betti numbers of one dimension at each threshold, the number of
+     *  classes born at or before it that die after it, so one diagram
+     *  answers how connected sites are at every distance.
+     */
+    inline void betti_curve(const persistence_diagram& diagram, int dimension,
+                            const std::vector<double>& thresholds,
+                            std::vector<size_t>& betti)
+    {
+        betti.assign(thresholds.size(), 0);
+        for (size_t i=0; i<diagram.size(); i++) {
+            if (diagram.dimension[i]!=dimension) continue;
+            for (size_t t=0; t<thresholds.size(); t++) {
+                if (diagram.birth[i]<=thresholds[t]
+                        && thresholds[t]<diagram.death[i]) {
+                    betti[t]++;
+                }
+            }
+        }
+    }
+
+
+
+    /*! Writes the diagram to a persistence group, one dataset per
+     *  array, in a file of its own or beside cluster_ids.
+     */
+    inline void write_persistence(HDF_array_file& file,
+                                  const persistence_diagram& diagram)
+    {
+        file.create_group("persistence");
+        file.write_array("persistence/dimension", diagram.dimension);
+        file.write_array("persistence/birth", diagram.birth);
+        file.write_array("persistence/death", diagram.death);
+        file.write_array("persistence/birth_simplex", diagram.birth_simplex);
+        file.write_array("persistence/death_simplex", diagram.death_simplex);
+    }
+
+}
+
+
+#endif // _PERSISTENCE_HPP_
@@ -0,0 +1,174 @@
+#ifndef _PIXEL_TYPES_HPP_
+#define _PIXEL_TYPES_HPP_ 1
+
+#include <cstddef>
+#include <stdint.h>
+#include <boost/array.hpp>
+#include <boost/property_map/property_map.hpp>
+
+
+namespace geodec
+{
+
+    //! Pixel types gdal_file can hand out without conversion.
+    enum pixel_type { pixel_unknown, pixel_uint8, pixel_uint16, pixel_int32,
+                      pixel_float32, pixel_float64 };
+
+
+    inline size_t pixel_bytes(pixel_type type)
+    {
+        switch (type) {
+        case pixel_uint8: return 1;
+        case pixel_uint16: return 2;
+        case pixel_int32: return 4;
+        case pixel_float32: return 4;
+        case pixel_float64: return 8;
+        default: return 0;
+        }
+    }
+
+
+    inline const char* pixel_type_name(pixel_type type)
+    {
+        switch (type) {
+        case pixel_uint8: return "uint8";
+        case pixel_uint16: return "uint16";
+        case pixel_int32: return "int32";
+        case pixel_float32: return "float32";
+        case pixel_float64: return "float64";
+        default: return "unknown";
+        }
+    }
+
+
+    //! The pixel_type of a C++ type, as pixel_type_of<T>::value.
+    template<class T> struct pixel_type_of;
+    template<> struct pixel_type_of<uint8_t>
+    { static const pixel_type value=pixel_uint8; };
+    template<> struct pixel_type_of<uint16_t>
+    { static const pixel_type value=pixel_uint16; };
+    template<> struct pixel_type_of<int32_t>
+    { static const pixel_type value=pixel_int32; };
+    template<> struct pixel_type_of<float>
+    { static const pixel_type value=pixel_float32; };
+    template<> struct pixel_type_of<double>
+    { static const pixel_type value=pixel_float64; };
+
+
+
+    //! What a band holds. Bands are numbered from one, as in GDAL.
+    struct band_info
+    {
+        pixel_type type;
+        bool has_nodata;
+        double nodata;
+    };
+
+
+    /*! True if value is the band's nodata value. A NaN nodata value
+     *  matches NaN pixels.
+     */
+    template<class T>
+    bool is_nodata(T value, const band_info& info)
+    {
+        if (!info.has_nodata) return false;
+        if (info.nodata!=info.nodata) return value!=value;
+        return double(value)==info.nodata;
+    }
+
+
+
+    /*! Typed pixels of one decoded block, read in place. The extent is
+     *  x0, y0, width, height of the part inside the raster, as from
+     *  next_block, and rows are stride pixels apart.
+     */
+    template<class T>
+    class pixel_span
+    {
+        const T* data_;
+        boost::array<size_t,4> extent_;
+        size_t stride_;
+    public:
+        typedef T value_type;
+
+        pixel_span() : data_(0), stride_(0) { extent_.fill(0); }
+        pixel_span(const T* data, const boost::array<size_t,4>& extent,
+                   size_t stride)
+            : data_(data), extent_(extent), stride_(stride) {}
+
+        //! Pixel at (ix,iy) within the block.
+        const T& operator()(size_t ix, size_t iy) const
+        {
+            return data_[ix+iy*stride_];
+        }
+
+        const T* row(size_t iy) const { return data_+iy*stride_; }
+        const T* data() const { return data_; }
+        size_t width() const { return extent_[2]; }
+        size_t height() const { return extent_[3]; }
+        size_t stride() const { return stride_; }
+        const boost::array<size_t,4>& extent() const { return extent_; }
+
+        //! True if raster cell (x,y) lies in this block.
+        bool contains(size_t x, size_t y) const
+        {
+            return x>=extent_[0] && x<extent_[0]+extent_[2]
+                && y>=extent_[1] && y<extent_[1]+extent_[3];
+        }
+
+        //! Pixel at raster cell (x,y), which must lie in this block.
+        const T& at(size_t x, size_t y) const
+        {
+            return data_[(x-extent_[0])+(y-extent_[1])*stride_];
+        }
+    };
+
+
+
+    /*! Readable property map from raster cell id, x+y*raster_width, to
+     *  a pixel in a block, for compare_land_uses or the simulation
+     *  coefficients when cells are visited a block at a time.
+     */
+    template<class T>
+    class span_cell_map
+    {
+        pixel_span<T> span_;
+        size_t raster_width_;
+    public:
+        typedef size_t key_type;
+        typedef T value_type;
+        typedef const T& reference;
+        typedef boost::readable_property_map_tag category;
+
+        span_cell_map(const pixel_span<T>& span, size_t raster_width)
+            : span_(span), raster_width_(raster_width) {}
+
+        friend reference get(const span_cell_map& map, size_t cell)
+        {
+            return map.span_.at(cell%map.raster_width_,
+                                cell/map.raster_width_);
+        }
+    };
+
+
+
+    //! A whole band in row-major order, as a map from raster cell id.
+    template<class T>
+    struct band_map
+    {
+        typedef boost::iterator_property_map<const T*,
+            boost::identity_property_map, T, const T&> type;
+    };
+
+
+    template<class T>
+    typename band_map<T>::type make_band_map(const T* values)
+    {
+        return typename band_map<T>::type(values,
+                                          boost::identity_property_map());
+    }
+
+}
+
+
+#endif // _PIXEL_TYPES_HPP_
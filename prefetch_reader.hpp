@@ -0,0 +1,251 @@
+#ifndef _PREFETCH_READER_HPP_
+#define _PREFETCH_READER_HPP_ 1
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <exception>
+#include <algorithm>
+#include <boost/array.hpp>
+#include "gdal_io.hpp"
+
+
+namespace geodec
+{
+
+    //! One decoded block, as handed out by block_prefetcher.
+    struct raster_block
+    {
+        size_t bx, by;
+        //! Pixel extent x0, y0, width, height, as from next_block.
+        boost::array<size_t,4> extent;
+        //! Pixels with a stride of the block width, as from read_block_data.
+        std::vector<unsigned char> pixels;
+        //! Vertex coordinates, (width+1)*(height+1) each, if requested.
+        std::vector<double> x, y, z;
+    };
+
+
+
+    /*! Decodes blocks on background threads ahead of the consumer,
+     *  which takes them in row-major block order from next().
+     *
+     *  Blocks pass through a ring of in_flight slots. Each slot has a
+     *  sequence number that says whose turn it is: the worker decoding
+     *  ticket t waits for the slot to reach t, fills it and stores t+1,
+     *  and the consumer waits for t+1 and gives the slot back as
+     *  t+in_flight. Tickets come from one atomic counter. No locks are
+     *  taken, and a side that finds nothing to do spins briefly, then
+     *  sleeps in short steps so it leaves the cores to the other side.
+     *
+     *  DECODER has operator()(bx, by, raster_block&). Each worker makes
+     *  its own with make_decoder(), on its own thread, because GDAL
+     *  handles must not be shared between threads. An exception from
+     *  the factory or decoder comes out of next() for that block.
+     */
+    template<class DECODER>
+    class block_prefetcher
+    {
+        struct slot
+        {
+            std::atomic<size_t> seq;
+            raster_block block;
+            std::exception_ptr error;
+        };
+
+        size_t block_cnt_[2];
+        size_t total_;
+        size_t in_flight_;
+        std::unique_ptr<slot[]> slots_;
+        std::atomic<size_t> next_ticket_;
+        std::atomic<bool> stop_;
+        size_t consumed_;
+        double wait_seconds_;
+        std::vector<std::thread> workers_;
+
+        block_prefetcher(const block_prefetcher&);
+        block_prefetcher& operator=(const block_prefetcher&);
+    public:
+        /*! make_decoder returns a std::unique_ptr<DECODER>.
+         *  in_flight is at least the number of workers.
+         */
+        template<class FACTORY>
+        block_prefetcher(size_t block_cnt_x, size_t block_cnt_y,
+                         size_t in_flight, size_t workers,
+                         FACTORY make_decoder)
+            : total_(block_cnt_x*block_cnt_y),
+              in_flight_(std::max<size_t>(std::max(in_flight, workers), 1)),
+              slots_(new slot[in_flight_]),
+              next_ticket_(0), stop_(false), consumed_(0), wait_seconds_(0)
+        {
+            block_cnt_[0]=block_cnt_x;
+            block_cnt_[1]=block_cnt_y;
+            for (size_t i=0; i<in_flight_; i++) {
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+            }
+            workers=std::max<size_t>(workers, 1);
+            for (size_t w=0; w<workers; w++) {
+                workers_.push_back(std::thread([this,make_decoder] () {
+                    std::unique_ptr<DECODER> decode;
+                    std::exception_ptr failed;
+                    try {
+                        decode=make_decoder();
+                    } catch (...) {
+                        failed=std::current_exception();
+                    }
+                    this->work(decode.get(), failed);
+                }));
+            }
+        }
+
+
+        ~block_prefetcher()
+        {
+            stop_.store(true);
+            for (size_t w=0; w<workers_.size(); w++) {
+                workers_[w].join();
+            }
+        }
+
+
+        /*! The next block in row-major order, or null after the last.
+         *  The block is valid until the next call.
+         */
+        const raster_block* next()
+        {
+            if (consumed_>0) {
+                size_t done=consumed_-1;
+                slots_[done%in_flight_].seq.store(done+in_flight_,
+                                                  std::memory_order_release);
+            }
+            if (consumed_>=total_) {
+                return 0;
+            }
+            size_t t=consumed_++;
+            slot& s=slots_[t%in_flight_];
+            if (s.seq.load(std::memory_order_acquire)!=t+1) {
+                auto start=std::chrono::steady_clock::now();
+                wait_for(s.seq, t+1);
+                std::chrono::duration<double> waited=
+                    std::chrono::steady_clock::now()-start;
+                wait_seconds_+=waited.count();
+            }
+            if (s.error) {
+                std::rethrow_exception(s.error);
+            }
+            return &s.block;
+        }
+
+
+        //! Seconds next() spent waiting for a block to be decoded.
+        double wait_seconds() const { return wait_seconds_; }
+        size_t block_total() const { return total_; }
+
+    private:
+        /*! Waits until seq reaches value. Returns false if the
+         *  prefetcher is stopping first.
+         */
+        bool wait_for(const std::atomic<size_t>& seq, size_t value) const
+        {
+            for (size_t spin=0; seq.load(std::memory_order_acquire)!=value;
+                 spin++) {
+                if (stop_.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                if (spin<64) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+            }
+            return true;
+        }
+
+
+        void work(DECODER* decode, std::exception_ptr failed)
+        {
+            for (;;) {
+                size_t t=next_ticket_.fetch_add(1);
+                if (t>=total_) {
+                    return;
+                }
+                slot& s=slots_[t%in_flight_];
+                if (!wait_for(s.seq, t)) {
+                    return;
+                }
+                s.block.bx=t%block_cnt_[0];
+                s.block.by=t/block_cnt_[0];
+                s.error=failed;
+                if (decode) {
+                    try {
+                        (*decode)(s.block.bx, s.block.by, s.block);
+                    } catch (...) {
+                        s.error=std::current_exception();
+                    }
+                }
+                s.seq.store(t+1, std::memory_order_release);
+            }
+        }
+    };
+
+
+
+    /*! Decodes blocks of band one of a GeoTIFF, with the projected
+     *  coordinates of their vertices if asked, for block_prefetcher.
+     */
+    class gdal_block_decoder
+    {
+        gdal_file file_;
+        bool coordinates_;
+    public:
+        gdal_block_decoder(const std::string& filename, bool coordinates)
+            : file_(filename), coordinates_(coordinates) {}
+
+        void operator()(size_t bx, size_t by, raster_block& block)
+        {
+            boost::array<size_t,2> bs=file_.block_size();
+            boost::array<size_t,2> size=file_.size();
+            const unsigned char* data=file_.read_block_data(bx, by);
+            block.pixels.assign(data, data+bs[0]*bs[1]);
+            block.extent[0]=bx*bs[0];
+            block.extent[1]=by*bs[1];
+            block.extent[2]=std::min(bs[0], size[0]-block.extent[0]);
+            block.extent[3]=std::min(bs[1], size[1]-block.extent[1]);
+            if (coordinates_) {
+                size_t n=(block.extent[2]+1)*(block.extent[3]+1);
+                block.x.resize(n);
+                block.y.resize(n);
+                block.z.resize(n);
+                file_.vertex_coordinates(block.extent, &block.x[0],
+                                         &block.y[0], &block.z[0]);
+            }
+        }
+    };
+
+
+
+    /*! Makes gdal_block_decoders that each open their own handle on
+     *  a file, for block_prefetcher<gdal_block_decoder>.
+     */
+    struct gdal_decoder_factory
+    {
+        std::string filename;
+        bool coordinates;
+
+        gdal_decoder_factory(const std::string& name, bool coords)
+            : filename(name), coordinates(coords) {}
+
+        std::unique_ptr<gdal_block_decoder> operator()() const
+        {
+            return std::unique_ptr<gdal_block_decoder>(
+                new gdal_block_decoder(filename, coordinates));
+        }
+    };
+
+}
+
+
+#endif // _PREFETCH_READER_HPP_
@@ -4,10 +4,17 @@
 #include <memory>
 #include <set>
 #include <utility>
+#include <map>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
 #include <boost/array.hpp>
+#include <boost/unordered_map.hpp>
 #include "CGAL/Modifier_base.h"
 #include "CGAL/Polyhedron_incremental_builder_3.h"
+#include "CGAL/HalfedgeDS_decorator.h"
 #include "gdal_io.hpp"
+#include "paged_index.hpp"
 
 namespace geodec
 {
@@ -148,11 +155,14 @@ bool examine_polyhedron_grid(const Poly3& P)
      *  class that tracks vertices that were already in the Polyhedron, so that, when
      *  adding new polygons, any vertices that already are loaded are used, instead of
      *  being created new.
+     *
+     *  Vertex ids from the reader are dense, so the map from id to the
+     *  builder's absolute index is a paged array, not a tree.
      */
     template<class HDS, class READER>
     class add_from_file : public CGAL::Modifier_base<HDS> {
         READER& reader_;
-        std::map<size_t,size_t> id_to_index_;
+        paged_index<size_t> id_to_index_;
         size_t running_vertex_;
         CGAL::Polyhedron_incremental_builder_3<HDS>* B_;
     public:
@@ -162,13 +172,19 @@ bool examine_polyhedron_grid(const Poly3& P)
             
             running_vertex_=0;
             for (auto v=hds.vertices_begin(); v!=hds.vertices_end(); v++) {
-                id_to_index_[v->id()]=running_vertex_;
+                id_to_index_.set(v->id(), running_vertex_);
                 running_vertex_++;
             }
             std::cout << "Starting with " << running_vertex_ << " vertices in the Polyhedron."
                 << std::endl;
 
-            B_->begin_surface(0, 0, 0, B_->ABSOLUTE_INDEXING);
+            // Room for one block, added to what the HDS already holds.
+            boost::array<size_t,2> bs=reader_.block_size();
+            size_t facet_cnt=bs[0]*bs[1];
+            size_t vertex_cnt=(bs[0]+1)*(bs[1]+1);
+            size_t halfedge_cnt=2*(bs[0]*(bs[1]+1)+bs[1]*(bs[0]+1));
+            B_->begin_surface(vertex_cnt, facet_cnt, halfedge_cnt,
+                              B_->ABSOLUTE_INDEXING);
 			// Could pass the builder, B_, but we need only a limited part of its
 			// interface, so passing _this_ keeps toolkits separate.
 			bool success = reader_.read_block(*this);
@@ -181,10 +197,10 @@ bool examine_polyhedron_grid(const Poly3& P)
         {
             typedef typename HDS::Vertex::Point Point;
             // if vertex doesn't already exist:
-			if (id_to_index_.find(id)==id_to_index_.end()) {
+			if (!id_to_index_.contains(id)) {
 				auto add_vert_a = B_->add_vertex( Point(loc[0], loc[1], loc[2]) );
             	add_vert_a->id()=id;
-            	id_to_index_[id]=running_vertex_;
+            	id_to_index_.set(id, running_vertex_);
             	running_vertex_++;
 			}
         }
@@ -194,7 +210,7 @@ bool examine_polyhedron_grid(const Poly3& P)
         {
             auto facet=B_->begin_facet();
             for (auto pid=ids.cbegin(); pid<ids.cend(); pid++) {
-                B_->add_vertex_to_facet(id_to_index_[*pid]);
+                B_->add_vertex_to_facet(id_to_index_.find(*pid));
             }
             facet->id()=id;
             B_->end_facet();
@@ -203,19 +219,385 @@ bool examine_polyhedron_grid(const Poly3& P)
 
 
 
+    /*! Loads blocks of a raster into a live Polyhedron one at a time,
+     *  and evicts them again, so a window of blocks can sweep a raster
+     *  larger than memory.
+     *
+     *  Adding a block costs time in proportion to the block. Faces are
+     *  linked into the HDS directly, not through the incremental
+     *  builder, which scans the whole HDS each time it starts. Vertices
+     *  come from a paged_index on their ids, and a hash of the border
+     *  halfedges of the complex, keyed by the ids at their ends, finds
+     *  the seam a new face shares with a loaded neighbor. The halfedges
+     *  on that seam become the new face's, so seam vertices and edges
+     *  are reused. Border halfedges are relinked by walking the faces
+     *  around each corner of a new or evicted face.
+     *
+     *  READER has read_block(builder, bx, by) and block_count(), as
+     *  gdal_file does. A vertex is made when a face first uses it, and
+     *  removed when its last face is evicted.
+     */
+    template<class POLY, class READER=gdal_file>
+    class block_stitcher : public CGAL::Modifier_base<typename POLY::HalfedgeDS>
+    {
+    public:
+        typedef typename POLY::HalfedgeDS HDS;
+    private:
+        typedef typename HDS::Vertex Vertex;
+        typedef typename HDS::Halfedge Halfedge;
+        typedef typename HDS::Face Face;
+        typedef typename HDS::Vertex_handle Vertex_handle;
+        typedef typename HDS::Halfedge_handle Halfedge_handle;
+        typedef typename HDS::Face_handle Face_handle;
+        typedef typename Halfedge::Base HBase;
+        typedef typename Vertex::Point Point;
+        typedef std::pair<size_t,size_t> edge_key;
+
+        struct vertex_slot
+        {
+            Vertex_handle vertex;
+            size_t face_cnt;
+        };
+
+        POLY& P_;
+        READER& reader_;
+        HDS* hds_;
+        paged_index<size_t> id_to_slot_;
+        std::vector<vertex_slot> slots_;
+        std::vector<size_t> free_slots_;
+        //! Border halfedges by the ids of their tail and head.
+        boost::unordered_map<edge_key,Halfedge_handle> border_;
+        //! Locations read for the block being added, by vertex id.
+        boost::unordered_map<size_t,Point> pending_;
+        //! Faces of each loaded block, by bx+by*block_count()[0].
+        std::map<size_t,std::vector<Face_handle>> blocks_;
+        std::vector<Face_handle>* current_;
+        size_t block_cnt_x_;
+        bool evicting_;
+        size_t block_key_;
+
+        block_stitcher(const block_stitcher&);
+        block_stitcher& operator=(const block_stitcher&);
+    public:
+        block_stitcher(POLY& P, READER& reader)
+            : P_(P), reader_(reader), hds_(0), current_(0),
+              block_cnt_x_(reader.block_count()[0]), evicting_(false),
+              block_key_(0)
+        {
+        }
+
+
+        //! Read block (bx,by) and join it to the blocks already loaded.
+        void add_block(size_t bx, size_t by)
+        {
+            block_key_=bx+by*block_cnt_x_;
+            if (blocks_.count(block_key_)) {
+                std::stringstream msg;
+                msg << "Block " << bx << ", " << by << " is already loaded";
+                throw std::runtime_error(msg.str());
+            }
+            evicting_=false;
+            P_.delegate(*this);
+        }
+
+
+        //! Remove the faces of a block, and vertices no other block uses.
+        void evict_block(size_t bx, size_t by)
+        {
+            block_key_=bx+by*block_cnt_x_;
+            if (!blocks_.count(block_key_)) return;
+            evicting_=true;
+            P_.delegate(*this);
+        }
+
+
+        bool has_block(size_t bx, size_t by) const
+        {
+            return blocks_.count(bx+by*block_cnt_x_)>0;
+        }
+
+
+        /*! Load rows of blocks from the bottom up, keeping window_rows
+         *  of them. After each row is added, visit(P, by) sees the
+         *  complex of rows by+1-window_rows to by.
+         */
+        template<class VISIT>
+        void sweep(size_t window_rows, VISIT visit)
+        {
+            boost::array<size_t,2> cnt=reader_.block_count();
+            window_rows=std::max<size_t>(window_rows, 1);
+            for (size_t by=0; by<cnt[1]; by++) {
+                for (size_t bx=0; bx<cnt[0]; bx++) {
+                    add_block(bx, by);
+                }
+                visit(P_, by);
+                if (by+1>=window_rows) {
+                    for (size_t bx=0; bx<cnt[0]; bx++) {
+                        evict_block(bx, by+1-window_rows);
+                    }
+                }
+            }
+        }
+
+
+        //! Vertices held for loaded blocks.
+        size_t vertex_count() const { return id_to_slot_.size(); }
+        //! Border halfedges of the loaded complex.
+        size_t border_count() const { return border_.size(); }
+
+
+        void operator() (HDS& hds)
+        {
+            hds_=&hds;
+            if (evicting_) {
+                std::vector<Face_handle>& faces=blocks_[block_key_];
+                for (size_t f=0; f<faces.size(); f++) {
+                    erase_face(faces[f]);
+                }
+                blocks_.erase(block_key_);
+            } else {
+                current_=&blocks_[block_key_];
+                pending_.clear();
+                try {
+                    reader_.read_block(*this, block_key_%block_cnt_x_,
+                                       block_key_/block_cnt_x_);
+                } catch (...) {
+                    std::vector<Face_handle>& faces=*current_;
+                    for (size_t f=faces.size(); f>0; f--) {
+                        erase_face(faces[f-1]);
+                    }
+                    blocks_.erase(block_key_);
+                    current_=0;
+                    throw;
+                }
+                current_=0;
+                pending_.clear();
+            }
+        }
+
+
+		//! Interface for the file reader. Vertices are made when used.
+        void add_vertex( boost::array<double,3> loc, size_t id)
+        {
+            if (!id_to_slot_.contains(id)) {
+                pending_[id]=Point(loc[0], loc[1], loc[2]);
+            }
+        }
+
+
+		//! Interface for the file reader to add faces to the Polyhedron.
+        void add_face( const boost::array<size_t,4>& ids, size_t id)
+        {
+            CGAL::HalfedgeDS_decorator<HDS> D(*hds_);
+            const size_t n=4;
+            // Check the whole face before changing anything, so a face
+            // that is refused leaves no stray vertices or edges.
+            for (size_t k=0; k<n; k++) {
+                size_t a=ids[k], b=ids[(k+1)%n];
+                if (!id_to_slot_.contains(a) && !pending_.count(a)) {
+                    std::stringstream msg;
+                    msg << "A face uses vertex " << a << " before it was read";
+                    throw std::runtime_error(msg.str());
+                }
+                if (!border_.count(edge_key(a, b))
+                        && border_.count(edge_key(b, a))) {
+                    std::stringstream msg;
+                    msg << "Face " << id << " repeats the edge from "
+                        << a << " to " << b;
+                    throw std::runtime_error(msg.str());
+                }
+            }
+            Vertex_handle v[n];
+            bool made[n];
+            for (size_t k=0; k<n; k++) {
+                made[k]=!id_to_slot_.contains(ids[k]);
+                v[k]=vertex_of(ids[k]);
+            }
+            Halfedge_handle h[n];
+            for (size_t k=0; k<n; k++) {
+                size_t a=ids[k], b=ids[(k+1)%n];
+                auto seam=border_.find(edge_key(a, b));
+                if (seam!=border_.end()) {
+                    h[k]=seam->second;
+                    border_.erase(seam);
+                } else {
+                    h[k]=hds_->edges_push_back(Halfedge(), Halfedge());
+                    Halfedge_handle g=h[k]->opposite();
+                    D.set_vertex(h[k], v[(k+1)%n]);
+                    D.set_vertex(g, v[k]);
+                    D.set_face(g, Face_handle());
+                    border_[edge_key(b, a)]=g;
+                }
+            }
+            Face_handle face=hds_->faces_push_back(Face());
+            face->id()=id;
+            D.set_face_halfedge(face, h[0]);
+            for (size_t k=0; k<n; k++) {
+                D.set_face(h[k], face);
+                h[k]->HBase::set_next(h[(k+1)%n]);
+                D.set_prev(h[(k+1)%n], h[k]);
+                if (made[(k+1)%n]) {
+                    D.set_vertex_halfedge(v[(k+1)%n], h[k]);
+                }
+                slots_[id_to_slot_.find(ids[k])].face_cnt++;
+            }
+            for (size_t k=0; k<n; k++) {
+                link_fan(h[k]);
+            }
+            current_->push_back(face);
+        }
+
+    private:
+        Vertex_handle vertex_of(size_t id)
+        {
+            size_t slot=id_to_slot_.find(id);
+            if (slot!=id_to_slot_.npos) {
+                return slots_[slot].vertex;
+            }
+            auto loc=pending_.find(id);
+            if (loc==pending_.end()) {
+                std::stringstream msg;
+                msg << "A face uses vertex " << id << " before it was read";
+                throw std::runtime_error(msg.str());
+            }
+            Vertex_handle v=hds_->vertices_push_back(Vertex(loc->second));
+            v->id()=id;
+            vertex_slot made={ v, 0 };
+            if (free_slots_.empty()) {
+                slot=slots_.size();
+                slots_.push_back(made);
+            } else {
+                slot=free_slots_.back();
+                free_slots_.pop_back();
+                slots_[slot]=made;
+            }
+            id_to_slot_.set(id, slot);
+            return v;
+        }
+
+
+        /*! The faces around a vertex that are joined by edges form a fan.
+         *  Given a face halfedge out of the vertex, walk the fan both ways
+         *  to the border halfedge in and the border halfedge out, and
+         *  make one follow the other. Returns the border halfedge in,
+         *  or a null handle if the fan closes around the vertex.
+         */
+        Halfedge_handle link_fan(Halfedge_handle out)
+        {
+            Halfedge_handle border_out=out;
+            do {
+                border_out=border_out->prev()->opposite();
+                if (border_out==out) return Halfedge_handle();
+            } while (!border_out->is_border());
+            Halfedge_handle border_in=out->opposite();
+            while (!border_in->is_border()) {
+                border_in=border_in->next()->opposite();
+            }
+            border_in->HBase::set_next(border_out);
+            CGAL::HalfedgeDS_decorator<HDS>(*hds_).set_prev(border_out,
+                                                           border_in);
+            return border_in;
+        }
+
+
+        //! Border halfedge into a vertex, found by search. Rarely needed.
+        Halfedge_handle border_into(Vertex_handle v) const
+        {
+            for (auto b=border_.begin(); b!=border_.end(); b++) {
+                if (b->second->vertex()==v) return b->second;
+            }
+            return Halfedge_handle();
+        }
+
+
+        /*! Remove a face. Its edges that border no other face go, as do
+         *  corners left with no face, and the rest become border.
+         */
+        void erase_face(Face_handle face)
+        {
+            CGAL::HalfedgeDS_decorator<HDS> D(*hds_);
+            const size_t n=4;
+            Halfedge_handle h[n];
+            Vertex_handle v[n];
+            bool kept[n];
+            h[0]=face->halfedge();
+            for (size_t k=1; k<n; k++) {
+                h[k]=h[k-1]->next();
+            }
+            for (size_t k=0; k<n; k++) {
+                v[k]=h[(k+n-1)%n]->vertex();
+                kept[k]=!h[k]->opposite()->is_border();
+            }
+            hds_->faces_erase(face);
+            for (size_t k=0; k<n; k++) {
+                D.set_face(h[k], Face_handle());
+                size_t a=v[k]->id(), b=v[(k+1)%n]->id();
+                if (kept[k]) {
+                    border_[edge_key(a, b)]=h[k];
+                } else {
+                    border_.erase(edge_key(b, a));
+                }
+            }
+            for (size_t k=0; k<n; k++) {
+                size_t slot=id_to_slot_.find(v[k]->id());
+                if (--slots_[slot].face_cnt>0) {
+                    size_t before=(k+n-1)%n;
+                    Halfedge_handle in=Halfedge_handle();
+                    if (kept[before]) {
+                        in=link_fan(h[before]->opposite());
+                    }
+                    if (kept[k]) {
+                        in=link_fan(h[k]->opposite()->next());
+                    }
+                    if (in==Halfedge_handle()) {
+                        // The face was alone in its fan at a pinched vertex.
+                        in=border_into(v[k]);
+                    }
+                    D.set_vertex_halfedge(v[k], in);
+                }
+            }
+            for (size_t k=0; k<n; k++) {
+                if (!kept[k]) {
+                    hds_->edges_erase(h[k]);
+                }
+            }
+            for (size_t k=0; k<n; k++) {
+                size_t id=v[k]->id();
+                size_t slot=id_to_slot_.find(id);
+                if (slot!=id_to_slot_.npos && slots_[slot].face_cnt==0) {
+                    hds_->vertices_erase(v[k]);
+                    id_to_slot_.erase(id);
+                    free_slots_.push_back(slot);
+                }
+            }
+        }
+    };
+
+
+
     /*! Makes a grid from a raster datafile.
      *  POLY is a Polyhedron_3.
+     *  With a mask band, cells that band's nodata value or mask marks
+     *  invalid get no facet, and their edges become border halfedges.
      *  \returns unique_ptr to a polyhedral structure. This means that who
      *  gets it owns it.
      */
     template<class POLY>
-    std::unique_ptr<POLY> grid_from_file(const std::string& filename)
+    std::unique_ptr<POLY> grid_from_file(const std::string& filename,
+                                         size_t mask_band=0)
     {
         // Make a complex to which to add blocks.
         std::unique_ptr<POLY> P(new POLY);
 		gdal_file reader(filename);
-        add_from_file<typename POLY::HalfedgeDS,gdal_file> build_grid(reader);
-        P->delegate( build_grid );
+        reader.set_mask_band(mask_band);
+        block_stitcher<POLY> stitch(*P, reader);
+        boost::array<size_t,2> cnt=reader.block_count();
+        for (size_t by=0; by<cnt[1]; by++) {
+            for (size_t bx=0; bx<cnt[0]; bx++) {
+                stitch.add_block(bx, by);
+            }
+        }
+        P->normalize_border();
         examine_polyhedron_grid<POLY>(*P);
         return P;
     }
@@ -0,0 +1,178 @@
+#ifndef _QUAD_MESH_HPP_
+#define _QUAD_MESH_HPP_ 1
+
+#include <vector>
+#include <boost/array.hpp>
+#include "implicit_grid.hpp"
+
+
+namespace geodec
+{
+
+    /*! A quad complex for structured rasters where vertices, edges and
+     *  faces are integer ranges and adjacency is arithmetic.
+     *  The only array is the optional mask of missing cells, one bit
+     *  per cell, so a 40k x 40k raster needs 200 MB for the mask and
+     *  nothing else.
+     *
+     *  Vertex v=ix+iy*(w+1) is at grid corner (ix,iy).
+     *  Face f=ix+iy*w has lower corner (ix,iy).
+     *  Row edges come first, e=ix+iy*w for 0<=iy<=h, and run from
+     *  (ix,iy) to (ix+1,iy). Column edges follow, e=R+ix+iy*(w+1)
+     *  with R=w*(h+1), and run from (ix,iy) to (ix,iy+1).
+     *
+     *  A face's edges are listed in the order of its halfedges in the
+     *  Polyhedron interface, west, north, east, south, and face_edge_sign
+     *  says whether the face traverses each edge along or against it.
+     *
+     *  The Polyhedron-style handles come from implicit_grid, so
+     *  disjoint_set_cluster, write_complex and examine_polyhedron_grid
+     *  work on a quad_mesh.
+     */
+    template<class Kernel>
+    class quad_mesh : public implicit_grid<Kernel>
+    {
+        typedef implicit_grid<Kernel> base;
+    public:
+        //! Index of a missing neighbor.
+        static const size_t npos;
+
+        quad_mesh(size_t w, size_t h,
+                  const grid_geometry& geometry=grid_geometry())
+            : base(w, h, geometry) {}
+        quad_mesh(size_t w, size_t h, const std::vector<bool>& mask,
+                  const grid_geometry& geometry=grid_geometry())
+            : base(w, h, mask, geometry) {}
+
+        // Sizes of the integer ranges, including masked elements.
+        size_t vertex_count() const { return (this->w_+1)*(this->h_+1); }
+        size_t face_count() const { return this->w_*this->h_; }
+        size_t row_edge_count() const { return this->w_*(this->h_+1); }
+        size_t edge_count() const {
+            return row_edge_count()+(this->w_+1)*this->h_;
+        }
+
+        bool is_row_edge(size_t e) const { return e<row_edge_count(); }
+
+        //! Tail and head vertex of an edge.
+        boost::array<size_t,2> edge_vertices(size_t e) const
+        {
+            size_t vw=this->w_+1;
+            boost::array<size_t,2> verts;
+            if (is_row_edge(e)) {
+                size_t ix=e%this->w_, iy=e/this->w_;
+                verts[0]=ix+iy*vw;
+                verts[1]=verts[0]+1;
+            } else {
+                e-=row_edge_count();
+                size_t ix=e%vw, iy=e/vw;
+                verts[0]=ix+iy*vw;
+                verts[1]=verts[0]+vw;
+            }
+            return verts;
+        }
+
+
+        /*! The face that traverses the edge along its direction, then
+         *  the face that traverses it against. Either may be npos.
+         */
+        boost::array<size_t,2> edge_faces(size_t e) const
+        {
+            size_t w=this->w_, h=this->h_;
+            boost::array<size_t,2> faces;
+            if (is_row_edge(e)) {
+                size_t ix=e%w, iy=e/w;
+                // Along for the face below, whose north side it is.
+                faces[0] = iy>0 ? ix+(iy-1)*w : npos;
+                faces[1] = iy<h ? ix+iy*w : npos;
+            } else {
+                e-=row_edge_count();
+                size_t ix=e%(w+1), iy=e/(w+1);
+                // Along for the face to the east, whose west side it is.
+                faces[0] = ix<w ? ix+iy*w : npos;
+                faces[1] = ix>0 ? (ix-1)+iy*w : npos;
+            }
+            for (int i=0; i<2; i++) {
+                if (faces[i]!=npos && !this->facet_exists(faces[i])) {
+                    faces[i]=npos;
+                }
+            }
+            return faces;
+        }
+
+
+        //! Edges of a face as west, north, east, south.
+        boost::array<size_t,4> face_edges(size_t f) const
+        {
+            size_t w=this->w_;
+            size_t ix=f%w, iy=f/w;
+            size_t col=row_edge_count();
+            boost::array<size_t,4> edges;
+            edges[0]=col+ix+iy*(w+1);
+            edges[1]=ix+(iy+1)*w;
+            edges[2]=col+(ix+1)+iy*(w+1);
+            edges[3]=ix+iy*w;
+            return edges;
+        }
+
+
+        //! +1 if the face traverses its side along the edge, else -1.
+        static int face_edge_sign(int side)
+        {
+            static const int sign[4]={1,1,-1,-1};
+            return sign[side];
+        }
+
+
+        /*! Edges at a vertex, as east, north, west, south.
+         *  Edges outside the grid are npos. The vertex is the tail of
+         *  the east and north edges and the head of the others.
+         */
+        boost::array<size_t,4> vertex_edges(size_t v) const
+        {
+            size_t w=this->w_, h=this->h_;
+            size_t ix=v%(w+1), iy=v/(w+1);
+            size_t col=row_edge_count();
+            boost::array<size_t,4> edges;
+            edges[0] = ix<w ? ix+iy*w : npos;
+            edges[1] = iy<h ? col+ix+iy*(w+1) : npos;
+            edges[2] = ix>0 ? (ix-1)+iy*w : npos;
+            edges[3] = iy>0 ? col+ix+(iy-1)*(w+1) : npos;
+            for (int i=0; i<4; i++) {
+                if (edges[i]!=npos && !edge_exists(edges[i])) {
+                    edges[i]=npos;
+                }
+            }
+            return edges;
+        }
+
+
+        //! An edge exists if a face on either side exists.
+        bool edge_exists(size_t e) const
+        {
+            boost::array<size_t,2> faces=edge_faces(e);
+            return faces[0]!=npos || faces[1]!=npos;
+        }
+
+
+        double edge_length(size_t e) const
+        {
+            if (is_row_edge(e)) return this->geometry_.row_edge_length();
+            return this->geometry_.column_edge_length();
+        }
+
+
+        //! Bytes used by the mesh, which is the object and its mask.
+        size_t memory_bytes() const
+        {
+            return sizeof(*this) + this->mask_.capacity()/8;
+        }
+    };
+
+    template<class Kernel>
+    const size_t quad_mesh<Kernel>::npos=size_t(-1);
+
+}
+
+
+#endif // _QUAD_MESH_HPP_
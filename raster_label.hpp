@@ -0,0 +1,149 @@
+#ifndef _RASTER_LABEL_HPP_
+#define _RASTER_LABEL_HPP_ 1
+
+#include <vector>
+#include <stdexcept>
+#include <limits>
+#include "gdal_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! Compares two cells by their values in a row-major buffer.
+     *  This plays the role compare_land_uses plays for a Polyhedron,
+     *  but reads straight from the bytes gdal_file decodes.
+     */
+    template<class T>
+    class raster_values_equal
+    {
+        const T* values_;
+    public:
+        raster_values_equal(const T* values) : values_(values) {}
+        bool operator()(size_t a, size_t b) {
+            return values_[a]==values_[b];
+        }
+    };
+
+
+
+    /*! Root of a cell in a label array that doubles as a parent array.
+     *  Parents always have smaller ids than children, so the root is
+     *  the smallest cell id in the cluster. Uses path halving.
+     */
+    template<class LABEL>
+    LABEL label_root(LABEL* labels, LABEL x)
+    {
+        while (labels[x]!=x) {
+            labels[x]=labels[labels[x]];
+            x=labels[x];
+        }
+        return x;
+    }
+
+
+    //! Join two clusters so that the smaller root becomes the parent.
+    template<class LABEL>
+    void label_union(LABEL* labels, LABEL a, LABEL b)
+    {
+        a=label_root(labels, a);
+        b=label_root(labels, b);
+        if (a<b) {
+            labels[b]=a;
+        } else if (b<a) {
+            labels[a]=b;
+        }
+    }
+
+
+
+    /*! Connected-component labeling of one rectangle of a raster.
+     *  Cells are 4-connected, which is the same adjacency as two
+     *  quads sharing an edge in Build_grid or add_from_file.
+     *  Each cell's label is the smallest cell id, x+y*width, of its
+     *  cluster within the tile. That is the representative
+     *  disjoint_set_cluster gives after normalize_sets.
+     *
+     *  The first pass joins each cell to its west and south neighbors,
+     *  using the label array as the union-find parent array. The
+     *  second pass walks in id order, so each parent is final before
+     *  its children read it. Time is linear in the cells and the only
+     *  memory is the label array.
+     *
+     *  width is the width of the whole raster. (x0,y0) is the corner
+     *  of the tile and (tw,th) its size. compare(a,b) takes two cell
+     *  ids. labels is indexed by cell id over the whole raster, and
+     *  only cells in the tile are written.
+     */
+    template<class LABEL, class COMPARE>
+    void label_tile(size_t width, size_t x0, size_t y0, size_t tw, size_t th,
+                    COMPARE& compare, LABEL* labels)
+    {
+        for (size_t iy=y0; iy<y0+th; iy++) {
+            for (size_t ix=x0; ix<x0+tw; ix++) {
+                LABEL cell=ix+iy*width;
+                bool west = (ix>x0) && compare(cell-1, cell);
+                bool south = (iy>y0) && compare(cell-width, cell);
+                if (west) {
+                    labels[cell]=labels[cell-1];
+                    // If the southwest cell matches, west and south
+                    // are already in the same cluster.
+                    if (south && !compare(cell-width-1, cell)) {
+                        label_union<LABEL>(labels, cell-1, cell-width);
+                    }
+                } else if (south) {
+                    labels[cell]=labels[cell-width];
+                } else {
+                    labels[cell]=cell;
+                }
+            }
+        }
+
+        for (size_t iy=y0; iy<y0+th; iy++) {
+            for (size_t ix=x0; ix<x0+tw; ix++) {
+                LABEL cell=ix+iy*width;
+                labels[cell]=labels[labels[cell]];
+            }
+        }
+    }
+
+
+
+    /*! Label every cell of a width x height raster with its cluster id.
+     *  LABEL is the stored label type. Four bytes per cell suffices
+     *  for rasters under 2^32 cells.
+     */
+    template<class LABEL, class COMPARE>
+    void label_raster(size_t width, size_t height, COMPARE compare,
+                      std::vector<LABEL>& labels)
+    {
+        if (width*height > size_t(std::numeric_limits<LABEL>::max())) {
+            throw std::runtime_error("Label type too small for raster");
+        }
+        labels.resize(width*height);
+        if (labels.empty()) return;
+        label_tile<LABEL>(width, 0, 0, width, height, compare, &labels[0]);
+    }
+
+
+
+    /*! Read the first band of a raster file and label its clusters
+     *  of equal value without building a Polyhedron.
+     *  \returns width and height of the raster.
+     */
+    template<class LABEL>
+    boost::array<size_t,2> label_file(gdal_file& reader,
+                                      std::vector<LABEL>& labels)
+    {
+        std::vector<unsigned char> values;
+        reader.read_band(values);
+        boost::array<size_t,2> size=reader.size();
+        raster_values_equal<unsigned char> compare(values.data());
+        label_raster(size[0], size[1], compare, labels);
+        return size;
+    }
+
+}
+
+
+#endif // _RASTER_LABEL_HPP_
@@ -0,0 +1,267 @@
+#ifndef _REGION_GRAPH_HPP_
+#define _REGION_GRAPH_HPP_ 1
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "union_find.hpp"
+#include "hdf_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! The graph of clusters as compressed sparse rows.
+     *  Neighbors of cluster i are neighbors[offsets[i]] to
+     *  neighbors[offsets[i+1]-1], in increasing order, and each pair
+     *  appears in both rows with the length of their shared border.
+     *  Per-cluster attributes are parallel arrays indexed by cluster.
+     */
+    struct region_graph
+    {
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> neighbors;
+        std::vector<double> border_length;
+
+        std::vector<uint64_t> cluster_id;
+        std::vector<uint64_t> cell_count;
+        std::vector<double> area;
+        //! x and y of each cluster, interleaved.
+        std::vector<double> centroid;
+        std::vector<uint64_t> representative;
+        std::vector<uint8_t> border;
+
+        size_t node_count() const { return cluster_id.size(); }
+        size_t edge_count() const { return neighbors.size(); }
+    };
+
+
+
+    /*! Builds the region graph from what disjoint_set_cluster found.
+     *  adjacency holds each pair once, sorted, so a counting pass and
+     *  a fill pass give rows already in order.
+     */
+    inline void make_region_graph(const std::vector<cluster_summary>& clusters,
+                    const std::vector<cluster_adjacency>& adjacency,
+                    region_graph& graph)
+    {
+        size_t n=clusters.size();
+        if (n>size_t(std::numeric_limits<uint32_t>::max())) {
+            throw std::runtime_error("Too many clusters for region graph");
+        }
+        graph.cluster_id.resize(n);
+        graph.cell_count.resize(n);
+        graph.area.resize(n);
+        graph.centroid.resize(2*n);
+        graph.representative.resize(n);
+        graph.border.resize(n);
+        for (size_t i=0; i<n; i++) {
+            graph.cluster_id[i]=clusters[i].id;
+            graph.cell_count[i]=clusters[i].cell_count;
+            graph.area[i]=clusters[i].area;
+            graph.centroid[2*i]=clusters[i].centroid[0];
+            graph.centroid[2*i+1]=clusters[i].centroid[1];
+            graph.representative[i]=clusters[i].representative;
+            graph.border[i]=clusters[i].border;
+        }
+
+        graph.offsets.assign(n+1, 0);
+        for (auto e=adjacency.begin(); e!=adjacency.end(); ++e) {
+            graph.offsets[e->a+1]++;
+            graph.offsets[e->b+1]++;
+        }
+        for (size_t i=0; i<n; i++) {
+            graph.offsets[i+1]+=graph.offsets[i];
+        }
+        graph.neighbors.resize(graph.offsets[n]);
+        graph.border_length.resize(graph.offsets[n]);
+        // Rows fill in order: a row gets its smaller neighbors while
+        // the scan passes their pairs, then its larger ones in order.
+        std::vector<uint64_t> next(graph.offsets.begin(), graph.offsets.end()-1);
+        for (auto e=adjacency.begin(); e!=adjacency.end(); ++e) {
+            graph.neighbors[next[e->a]]=e->b;
+            graph.border_length[next[e->a]++]=e->border_length;
+            graph.neighbors[next[e->b]]=e->a;
+            graph.border_length[next[e->b]++]=e->border_length;
+        }
+    }
+
+
+
+    /*! Writes the graph to a region_graph group beside cluster_ids,
+     *  one dataset per array.
+     */
+    inline void write_region_graph(HDF_cluster_grid_file& file,
+                                   const region_graph& graph)
+    {
+        file.create_group("region_graph");
+        file.write_array("region_graph/offsets", graph.offsets);
+        file.write_array("region_graph/neighbors", graph.neighbors);
+        file.write_array("region_graph/border_length", graph.border_length);
+        file.write_array("region_graph/cluster_id", graph.cluster_id);
+        file.write_array("region_graph/cell_count", graph.cell_count);
+        file.write_array("region_graph/area", graph.area);
+        file.write_array("region_graph/centroid", graph.centroid, 2);
+        file.write_array("region_graph/representative", graph.representative);
+        file.write_array("region_graph/border", graph.border);
+    }
+
+
+
+    /*! Start of a flat region graph file. Sections are byte offsets
+     *  from the start of the file to each array, in the order of
+     *  region_graph's members, each aligned to eight bytes. Numbers
+     *  are in the byte order of the machine that wrote them.
+     */
+    struct region_graph_header
+    {
+        char magic[8];
+        uint64_t version;
+        uint64_t node_count;
+        uint64_t edge_count;
+        uint64_t section[9];
+    };
+
+    static const char region_graph_magic[8]={'G','E','O','D','R','G','F','1'};
+
+
+
+    namespace detail
+    {
+        template<class T>
+        void append_section(std::ofstream& out, const std::vector<T>& data,
+                            uint64_t& section)
+        {
+            uint64_t at=out.tellp();
+            static const char zeros[8]={0,0,0,0,0,0,0,0};
+            out.write(zeros, (8-at%8)%8);
+            section=out.tellp();
+            if (!data.empty()) {
+                out.write(reinterpret_cast<const char*>(&data[0]),
+                          data.size()*sizeof(T));
+            }
+        }
+    }
+
+
+
+    //! Writes the graph so that mapped_region_graph can map it.
+    inline void write_region_graph_file(const std::string& filename,
+                                        const region_graph& graph)
+    {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("Could not open "+filename);
+        }
+        region_graph_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, region_graph_magic, 8);
+        header.version=1;
+        header.node_count=graph.node_count();
+        header.edge_count=graph.edge_count();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        detail::append_section(out, graph.offsets, header.section[0]);
+        detail::append_section(out, graph.neighbors, header.section[1]);
+        detail::append_section(out, graph.border_length, header.section[2]);
+        detail::append_section(out, graph.cluster_id, header.section[3]);
+        detail::append_section(out, graph.cell_count, header.section[4]);
+        detail::append_section(out, graph.area, header.section[5]);
+        detail::append_section(out, graph.centroid, header.section[6]);
+        detail::append_section(out, graph.representative, header.section[7]);
+        detail::append_section(out, graph.border, header.section[8]);
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!out) {
+            throw std::runtime_error("Could not write "+filename);
+        }
+    }
+
+
+
+    /*! A region graph file mapped into memory. Opening it checks the
+     *  header and sizes and reads nothing else, so loading costs the
+     *  same for any size. Pages come in as the arrays are used.
+     */
+    class mapped_region_graph
+    {
+        void* data_;
+        size_t bytes_;
+        const region_graph_header* header_;
+
+        mapped_region_graph(const mapped_region_graph&);
+        mapped_region_graph& operator=(const mapped_region_graph&);
+    public:
+        mapped_region_graph(const std::string& filename)
+            : data_(MAP_FAILED), bytes_(0)
+        {
+            int fd=open(filename.c_str(), O_RDONLY);
+            if (fd<0) {
+                throw std::runtime_error("Could not open "+filename);
+            }
+            struct stat info;
+            if (fstat(fd, &info)==0 && size_t(info.st_size)>=sizeof(region_graph_header)) {
+                bytes_=info.st_size;
+                data_=mmap(0, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (data_==MAP_FAILED) {
+                throw std::runtime_error("Could not map "+filename);
+            }
+            header_=static_cast<const region_graph_header*>(data_);
+            if (std::memcmp(header_->magic, region_graph_magic, 8)!=0
+                    || header_->version!=1 || !sections_fit()) {
+                munmap(data_, bytes_);
+                throw std::runtime_error("Not a region graph file "+filename);
+            }
+        }
+
+        ~mapped_region_graph() { munmap(data_, bytes_); }
+
+        size_t node_count() const { return header_->node_count; }
+        size_t edge_count() const { return header_->edge_count; }
+
+        const uint64_t* offsets() const { return section<uint64_t>(0); }
+        const uint32_t* neighbors() const { return section<uint32_t>(1); }
+        const double* border_length() const { return section<double>(2); }
+        const uint64_t* cluster_id() const { return section<uint64_t>(3); }
+        const uint64_t* cell_count() const { return section<uint64_t>(4); }
+        const double* area() const { return section<double>(5); }
+        const double* centroid() const { return section<double>(6); }
+        const uint64_t* representative() const { return section<uint64_t>(7); }
+        const uint8_t* border() const { return section<uint8_t>(8); }
+
+    private:
+        template<class T>
+        const T* section(int i) const
+        {
+            return reinterpret_cast<const T*>(
+                static_cast<const char*>(data_)+header_->section[i]);
+        }
+
+        bool sections_fit() const
+        {
+            uint64_t n=header_->node_count;
+            uint64_t e=header_->edge_count;
+            uint64_t sizes[9]={ 8*(n+1), 4*e, 8*e, 8*n, 8*n, 8*n,
+                                16*n, 8*n, n };
+            for (int i=0; i<9; i++) {
+                if (header_->section[i]%8!=0
+                        || header_->section[i]+sizes[i]>bytes_) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+}
+
+
+#endif // _REGION_GRAPH_HPP_
@@ -1,39 +1,141 @@
+#include <cmath>
+#include <fstream>
 #include <iostream>
-#include <utility>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
 #include <boost/random/mersenne_twister.hpp>
-#include <boost/random/linear_congruential.hpp>
-#include <boost/random/uniform_int.hpp>
-#include <boost/property_map/property_map.hpp>
-#include "quad_complex.hpp"
-#include "union_find.hpp"
-#include "generate_land.hpp"
-#include "geo_polyhedron.hpp"
-
+#include <boost/random/uniform_real.hpp>
+#include "rips_complex.hpp"
+#include "persistence.hpp"
 
 using namespace geodec;
+namespace po = boost::program_options;
 
 
-int main() {
-    // Generate some fake land use values.
-    size_t w=10, h=20;
-    boost::mt19937 rng;
-    typedef std::map<size_t,unsigned char> use_type;
-    typedef boost::associative_property_map<use_type> use_map_type;
-    use_type land_use;
-    use_map_type land_use_map(land_use);
-    boost::uniform_int<unsigned char> rand_usage(1,10);
-    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
-        std::cout << gen_idx << " ";
-        land_use.insert(std::make_pair(gen_idx, rand_usage(rng)));
+//! Reads points as x y pairs separated by whitespace.
+void read_points(const std::string& filename, std::vector<planar_point>& points)
+{
+    std::ifstream in(filename.c_str());
+    if (!in) {
+        throw std::runtime_error("Could not open "+filename);
+    }
+    planar_point p;
+    while (in >> p[0] >> p[1]) {
+        points.push_back(p);
     }
-    std::cout << std::endl;
+}
+
+
 
-    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+int main(int argc, char* argv[])
+{
+    size_t point_cnt;
+    double distance, degree;
+    int dimension;
+    size_t threshold_cnt;
+    std::string input, output, barcode;
+    po::options_description desc("Vietoris-Rips filtration of points.");
+    desc.add_options()
+        ("help","Build the Rips complex of points in the plane and sort it "
+            "into a filtration.")
+        ("file",po::value<std::string>(&input),
+            "points as x y pairs. Without it, points are uniform in a square.")
+        ("points",po::value<size_t>(&point_cnt)->default_value(1000000),
+            "number of random points")
+        ("distance",po::value<double>(&distance)->default_value(0),
+            "longest edge, or zero to choose it from the degree")
+        ("degree",po::value<double>(&degree)->default_value(8),
+            "typical number of neighbors of random points")
+        ("dimension",po::value<int>(&dimension)->default_value(2),
+            "largest simplices, one for the neighborhood graph, up to three")
+        ("output",po::value<std::string>(&output),
+            "write the filtration, a simplex per line as value and vertices")
+        ("persistence",po::value<std::string>(&barcode),
+            "find persistence in dimensions zero and one and write it to "
+            "this HDF5 file")
+        ("thresholds",po::value<size_t>(&threshold_cnt)->default_value(10),
+            "number of distances up to the longest edge at which to print "
+            "Betti numbers")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
 
-    compare_land_uses<use_map_type> comparison(land_use_map);
-    geodec::disjoint_set_cluster<Polyhedron,compare_land_uses<use_map_type>>
-        dsc(comparison);
-    dsc(*P);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    std::vector<planar_point> points;
+    if (vm.count("file")) {
+        read_points(input, points);
+    } else {
+        boost::mt19937 rng;
+        boost::uniform_real<double> rand_coord(0, 1);
+        points.resize(point_cnt);
+        for (size_t i=0; i<point_cnt; i++) {
+            points[i][0]=rand_coord(rng);
+            points[i][1]=rand_coord(rng);
+        }
+    }
+    if (distance<=0) {
+        // Expected neighbors of uniform points in the unit square.
+        distance=std::sqrt(degree/(M_PI*std::max<size_t>(points.size(), 1)));
+    }
 
+    typedef boost::chrono::high_resolution_clock clock;
+    auto start=clock::now();
+    rips_complex rips(points, distance, dimension);
+    boost::chrono::duration<double> neighbors=clock::now()-start;
+
+    start=clock::now();
+    std::vector<filtered_simplex> filtration;
+    rips.filtration(filtration);
+    boost::chrono::duration<double> sorted=clock::now()-start;
+
+    std::cout << "points " << points.size() << " distance " << distance
+              << std::endl;
+    for (int d=0; d<=dimension; d++) {
+        std::cout << "dimension " << d << " simplices "
+                  << rips.simplex_count(d) << std::endl;
+    }
+    std::cout << "neighbor seconds " << neighbors.count()
+              << " filtration seconds " << sorted.count() << std::endl;
+
+    if (vm.count("output")) {
+        std::ofstream out(output.c_str());
+        for (size_t i=0; i<filtration.size(); i++) {
+            const filtered_simplex& s=filtration[i];
+            out << s.value;
+            for (int v=0; v<=s.dimension; v++) {
+                out << ' ' << s.vertex[v];
+            }
+            out << '\n';
+        }
+    }
+
+    if (vm.count("persistence")) {
+        start=clock::now();
+        persistence_diagram diagram;
+        persistence(filtration, diagram);
+        boost::chrono::duration<double> reduced=clock::now()-start;
+        std::cout << "classes " << diagram.size() << " persistence seconds "
+                  << reduced.count() << std::endl;
+
+        std::vector<double> thresholds(threshold_cnt);
+        for (size_t t=0; t<threshold_cnt; t++) {
+            thresholds[t]=distance*(t+1)/threshold_cnt;
+        }
+        std::vector<size_t> betti0, betti1;
+        betti_curve(diagram, 0, thresholds, betti0);
+        betti_curve(diagram, 1, thresholds, betti1);
+        for (size_t t=0; t<threshold_cnt; t++) {
+            std::cout << "distance " << thresholds[t] << " betti0 "
+                      << betti0[t] << " betti1 " << betti1[t] << std::endl;
+        }
+        HDF_array_file file(barcode);
+        write_persistence(file, diagram);
+    }
     return 0;
 }
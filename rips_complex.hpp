@@ -0,0 +1,437 @@
+#ifndef _RIPS_COMPLEX_HPP_
+#define _RIPS_COMPLEX_HPP_ 1
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <stdint.h>
+#include <boost/array.hpp>
+#include "space_filling.hpp"
+
+
+namespace geodec
+{
+
+    typedef boost::array<double,2> planar_point;
+
+
+    /*! Points of the plane bucketed in a uniform grid of square cells.
+     *  Cells are keyed by the Morton code of their column and row, and
+     *  points are kept sorted by that key, so each occupied cell is one
+     *  run of points and nearby cells are mostly near in memory. Empty
+     *  cells cost nothing, so scattered sites over a large extent are
+     *  as cheap as dense ones. Points are copied in cell order, so
+     *  the distances within and between cells read memory in order.
+     */
+    class point_grid
+    {
+        double cell_;
+        double origin_[2];
+        //! Point indices, sorted by cell key, and the points in that order.
+        std::vector<unsigned int> order_;
+        std::vector<planar_point> sorted_;
+        //! Key of each occupied cell, and where its points start in order_.
+        std::vector<uint64_t> keys_;
+        std::vector<size_t> starts_;
+
+        boost::array<uint32_t,2> cell_of(const planar_point& p) const
+        {
+            boost::array<uint32_t,2> c={{
+                uint32_t((p[0]-origin_[0])/cell_),
+                uint32_t((p[1]-origin_[1])/cell_) }};
+            return c;
+        }
+
+        //! Position of the cell in keys_, or keys_.size() if it is empty.
+        size_t find_cell(uint64_t key) const
+        {
+            auto k=std::lower_bound(keys_.begin(), keys_.end(), key);
+            if (k==keys_.end() || *k!=key) return keys_.size();
+            return k-keys_.begin();
+        }
+
+    public:
+        /*! Cells are cell_size on a side. Pairs within cell_size of one
+         *  another then lie in the same or adjacent cells.
+         */
+        point_grid(const std::vector<planar_point>& points, double cell_size)
+            : cell_(cell_size)
+        {
+            if (!(cell_size>0)) {
+                throw std::runtime_error("Grid cells must have positive size");
+            }
+            if (points.size()>size_t(std::numeric_limits<unsigned int>::max())) {
+                throw std::runtime_error("Too many points for the grid");
+            }
+            origin_[0]=origin_[1]=0;
+            double extent[2]={ 0, 0 };
+            if (!points.empty()) {
+                origin_[0]=origin_[1]=std::numeric_limits<double>::max();
+                extent[0]=extent[1]=-std::numeric_limits<double>::max();
+            }
+            for (size_t i=0; i<points.size(); i++) {
+                for (int d=0; d<2; d++) {
+                    origin_[d]=std::min(origin_[d], points[i][d]);
+                    extent[d]=std::max(extent[d], points[i][d]);
+                }
+            }
+            for (int d=0; d<2; d++) {
+                if ((extent[d]-origin_[d])/cell_size>=double(uint32_t(-1)-1)) {
+                    std::stringstream msg;
+                    msg << "Cells of size " << cell_size << " are too small "
+                        << "for points spread over " << extent[d]-origin_[d];
+                    throw std::runtime_error(msg.str());
+                }
+            }
+
+            std::vector<std::pair<uint64_t,unsigned int>> keyed(points.size());
+            for (size_t i=0; i<points.size(); i++) {
+                boost::array<uint32_t,2> c=cell_of(points[i]);
+                keyed[i]=std::make_pair(morton_encode(c[0], c[1]),
+                                        (unsigned int)(i));
+            }
+            std::sort(keyed.begin(), keyed.end());
+            order_.resize(keyed.size());
+            sorted_.resize(keyed.size());
+            for (size_t i=0; i<keyed.size(); i++) {
+                order_[i]=keyed[i].second;
+                sorted_[i]=points[keyed[i].second];
+                if (i==0 || keyed[i-1].first!=keyed[i].first) {
+                    keys_.push_back(keyed[i].first);
+                    starts_.push_back(i);
+                }
+            }
+            starts_.push_back(keyed.size());
+        }
+
+
+        /*! Calls visit(i, j, distance) once for each pair of points, i<j,
+         *  no farther apart than the cell size. Each cell is paired
+         *  with itself and with four of its eight neighbors, east and
+         *  the three above, so each pair of cells is seen once.
+         */
+        template<class VISIT>
+        void for_each_pair(VISIT visit) const
+        {
+            const double r2=cell_*cell_;
+            const int offsets[4][2]={ { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+            for (size_t c=0; c<keys_.size(); c++) {
+                size_t begin=starts_[c], end=starts_[c+1];
+                for (size_t a=begin; a<end; a++) {
+                    for (size_t b=a+1; b<end; b++) {
+                        double d2=distance2(sorted_[a], sorted_[b]);
+                        if (d2<=r2) {
+                            unsigned int i=order_[a], j=order_[b];
+                            visit(std::min(i, j), std::max(i, j), std::sqrt(d2));
+                        }
+                    }
+                }
+                boost::array<uint32_t,2> xy=morton_decode(keys_[c]);
+                for (int o=0; o<4; o++) {
+                    if (offsets[o][0]<0 && xy[0]==0) continue;
+                    size_t n=find_cell(morton_encode(xy[0]+offsets[o][0],
+                                                     xy[1]+offsets[o][1]));
+                    if (n==keys_.size()) continue;
+                    for (size_t a=begin; a<end; a++) {
+                        for (size_t b=starts_[n]; b<starts_[n+1]; b++) {
+                            double d2=distance2(sorted_[a], sorted_[b]);
+                            if (d2<=r2) {
+                                unsigned int i=order_[a], j=order_[b];
+                                visit(std::min(i, j), std::max(i, j),
+                                      std::sqrt(d2));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+
+        static double distance2(const planar_point& a, const planar_point& b)
+        {
+            double dx=a[0]-b[0];
+            double dy=a[1]-b[1];
+            return dx*dx+dy*dy;
+        }
+
+        size_t occupied_cells() const { return keys_.size(); }
+    };
+
+
+
+    /*! A simplex of a filtration. Vertices are sorted, and those past
+     *  the dimension are unused. The value is the filtration parameter
+     *  at which the simplex enters, for a Rips complex the length of
+     *  its longest edge.
+     */
+    struct filtered_simplex
+    {
+        double value;
+        int dimension;
+        boost::array<int,4> vertex;
+    };
+
+
+    /*! Filtration order: by value, then by dimension, so faces come
+     *  before the simplices they bound, then by vertices.
+     */
+    inline bool operator<(const filtered_simplex& a, const filtered_simplex& b)
+    {
+        if (a.value!=b.value) return a.value<b.value;
+        if (a.dimension!=b.dimension) return a.dimension<b.dimension;
+        return std::lexicographical_compare(a.vertex.begin(),
+            a.vertex.begin()+a.dimension+1, b.vertex.begin(),
+            b.vertex.begin()+b.dimension+1);
+    }
+
+
+
+    namespace detail
+    {
+        /*! Sorts simplices into filtration order, if those of each
+         *  dimension come in lexicographic order of their vertices.
+         *  This is a stable radix sort, first on dimension, then on
+         *  value sixteen bits at a time from the lowest. Values must
+         *  not be negative, so their bits order as unsigned integers.
+         *  Digits every simplex shares, such as the exponent of lengths
+         *  of about one size, are skipped.
+         */
+        inline void sort_filtration(std::vector<filtered_simplex>& simplices)
+        {
+            const int digit_bits=16;
+            const size_t bucket_cnt=size_t(1)<<digit_bits;
+            std::vector<filtered_simplex> scratch(simplices.size());
+            std::vector<size_t> counts(bucket_cnt);
+            auto digit=[](const filtered_simplex& s, int shift) -> size_t {
+                if (shift<0) return s.dimension;
+                uint64_t bits;
+                std::memcpy(&bits, &s.value, sizeof(bits));
+                return (bits>>shift) & (bucket_cnt-1);
+            };
+            for (int shift=-digit_bits; shift<64; shift+=digit_bits) {
+                std::fill(counts.begin(), counts.end(), 0);
+                for (size_t i=0; i<simplices.size(); i++) {
+                    counts[digit(simplices[i], shift)]++;
+                }
+                if (simplices.empty() ||
+                        counts[digit(simplices[0], shift)]==simplices.size()) {
+                    continue;
+                }
+                size_t total=0;
+                for (size_t b=0; b<bucket_cnt; b++) {
+                    size_t c=counts[b];
+                    counts[b]=total;
+                    total+=c;
+                }
+                for (size_t i=0; i<simplices.size(); i++) {
+                    scratch[counts[digit(simplices[i], shift)]++]=simplices[i];
+                }
+                simplices.swap(scratch);
+            }
+        }
+    }
+
+
+
+    /*! The Vietoris-Rips complex of points in the plane, up to a
+     *  maximum distance and a maximum dimension from one, the
+     *  neighborhood graph, to three.
+     *
+     *  Neighbors come from a point_grid with cells of the maximum
+     *  distance, not from all pairs. They are kept as the upper
+     *  neighbors of each vertex, sorted, in compressed rows with the
+     *  length of each edge. A triangle v<u<w is found where w is an
+     *  upper neighbor of both v and u, by merging their rows, and a
+     *  tetrahedron by merging that list with the row of w, so each
+     *  clique is found once.
+     */
+    class rips_complex
+    {
+        const std::vector<planar_point>& points_;
+        double max_distance_;
+        int max_dimension_;
+        //! Upper neighbors of each vertex, and the lengths of those edges.
+        std::vector<size_t> offsets_;
+        std::vector<int> neighbors_;
+        std::vector<double> lengths_;
+        std::vector<size_t> counts_;
+
+        //! Shared upper neighbors of the rows of a and b, with lengths.
+        void common_neighbors(int a, int b, std::vector<int>& shared,
+                              std::vector<double>& from_a,
+                              std::vector<double>& from_b) const
+        {
+            shared.clear();
+            from_a.clear();
+            from_b.clear();
+            size_t i=offsets_[a], iend=offsets_[a+1];
+            size_t j=offsets_[b], jend=offsets_[b+1];
+            while (i<iend && j<jend) {
+                if (neighbors_[i]<neighbors_[j]) {
+                    i++;
+                } else if (neighbors_[j]<neighbors_[i]) {
+                    j++;
+                } else {
+                    shared.push_back(neighbors_[i]);
+                    from_a.push_back(lengths_[i]);
+                    from_b.push_back(lengths_[j]);
+                    i++;
+                    j++;
+                }
+            }
+        }
+
+    public:
+        rips_complex(const std::vector<planar_point>& points,
+                     double max_distance, int max_dimension=2)
+            : points_(points), max_distance_(max_distance),
+              max_dimension_(max_dimension), counts_(4, 0)
+        {
+            if (max_dimension<1 || max_dimension>3) {
+                std::stringstream msg;
+                msg << "Rips complex dimension " << max_dimension
+                    << " is not between one and three";
+                throw std::runtime_error(msg.str());
+            }
+            if (points.size()>size_t(std::numeric_limits<int>::max())) {
+                throw std::runtime_error("Too many points for a Rips complex");
+            }
+            size_t n=points.size();
+            counts_[0]=n;
+            point_grid grid(points, max_distance);
+
+            // Count upper neighbors, then fill rows in a second pass.
+            offsets_.assign(n+1, 0);
+            grid.for_each_pair([&](unsigned int i, unsigned int, double) {
+                offsets_[i+1]++;
+            });
+            for (size_t v=0; v<n; v++) {
+                offsets_[v+1]+=offsets_[v];
+            }
+            neighbors_.resize(offsets_[n]);
+            lengths_.resize(offsets_[n]);
+            std::vector<size_t> next(offsets_.begin(), offsets_.end()-1);
+            grid.for_each_pair([&](unsigned int i, unsigned int j, double d) {
+                neighbors_[next[i]]=j;
+                lengths_[next[i]]=d;
+                next[i]++;
+            });
+            std::vector<std::pair<int,double>> row;
+            for (size_t v=0; v<n; v++) {
+                row.clear();
+                for (size_t k=offsets_[v]; k<offsets_[v+1]; k++) {
+                    row.push_back(std::make_pair(neighbors_[k], lengths_[k]));
+                }
+                std::sort(row.begin(), row.end());
+                for (size_t k=0; k<row.size(); k++) {
+                    neighbors_[offsets_[v]+k]=row[k].first;
+                    lengths_[offsets_[v]+k]=row[k].second;
+                }
+            }
+            counts_[1]=neighbors_.size();
+        }
+
+
+        /*! Calls visit(simplex) for every simplex, vertices first, then
+         *  by lowest vertex. Simplices of each dimension come in
+         *  lexicographic order of their vertices. Nothing is stored, so
+         *  a caller can count or filter simplices without holding the
+         *  complex.
+         */
+        template<class VISIT>
+        void for_each_simplex(VISIT visit)
+        {
+            filtered_simplex s;
+            s.vertex.fill(-1);
+            s.value=0;
+            s.dimension=0;
+            for (size_t v=0; v<points_.size(); v++) {
+                s.vertex[0]=int(v);
+                visit(s);
+            }
+
+            std::vector<int> shared;
+            std::vector<double> from_v, from_u;
+            size_t triangle_cnt=0, tetrahedron_cnt=0;
+            for (size_t vi=0; vi<points_.size(); vi++) {
+                int v=int(vi);
+                for (size_t k=offsets_[v]; k<offsets_[v+1]; k++) {
+                    int u=neighbors_[k];
+                    s.dimension=1;
+                    s.vertex[0]=v;
+                    s.vertex[1]=u;
+                    s.vertex[2]=s.vertex[3]=-1;
+                    s.value=lengths_[k];
+                    visit(s);
+                    if (max_dimension_<2) continue;
+
+                    double vu=lengths_[k];
+                    common_neighbors(v, u, shared, from_v, from_u);
+                    for (size_t t=0; t<shared.size(); t++) {
+                        int w=shared[t];
+                        double vuw=std::max(vu, std::max(from_v[t], from_u[t]));
+                        s.dimension=2;
+                        s.vertex[2]=w;
+                        s.vertex[3]=-1;
+                        s.value=vuw;
+                        visit(s);
+                        triangle_cnt++;
+                        if (max_dimension_<3) continue;
+
+                        // Fourth vertices are shared by v and u, past w,
+                        // and are upper neighbors of w.
+                        size_t x=t+1, j=offsets_[w], jend=offsets_[w+1];
+                        while (x<shared.size() && j<jend) {
+                            if (shared[x]<neighbors_[j]) {
+                                x++;
+                            } else if (neighbors_[j]<shared[x]) {
+                                j++;
+                            } else {
+                                s.dimension=3;
+                                s.vertex[3]=shared[x];
+                                s.value=std::max(std::max(vuw, lengths_[j]),
+                                    std::max(from_v[x], from_u[x]));
+                                visit(s);
+                                tetrahedron_cnt++;
+                                x++;
+                                j++;
+                            }
+                        }
+                    }
+                }
+            }
+            counts_[2]=triangle_cnt;
+            counts_[3]=tetrahedron_cnt;
+        }
+
+
+        /*! Every simplex, sorted into filtration order, replacing the
+         *  contents of filtration. See detail::sort_filtration.
+         */
+        void filtration(std::vector<filtered_simplex>& filtration)
+        {
+            filtration.clear();
+            filtration.reserve(points_.size()+neighbors_.size());
+            for_each_simplex([&](const filtered_simplex& s) {
+                filtration.push_back(s);
+            });
+            detail::sort_filtration(filtration);
+        }
+
+
+        //! Simplices of dimension d, known for d>1 once they are visited.
+        size_t simplex_count(int d) const { return counts_[d]; }
+        size_t vertex_count() const { return points_.size(); }
+        size_t edge_count() const { return neighbors_.size(); }
+        double max_distance() const { return max_distance_; }
+        int max_dimension() const { return max_dimension_; }
+    };
+
+}
+
+
+#endif // _RIPS_COMPLEX_HPP_
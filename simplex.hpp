@@ -3,8 +3,14 @@
 
 #include <map>
 #include <set>
+#include <vector>
+#include <stdint.h>
+#include <tuple>
+#include <iterator>
+#include <ostream>
+#include <algorithm>
 #include <boost/array.hpp>
-#include <boost/iterator/iterator_adaptor.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <boost/iterator/iterator_traits.hpp>
 #include <boost/mpl/int.hpp>
 
@@ -15,145 +21,271 @@ namespace geodec {
  *  Given a list of integers, count how many permutations
  *  it would take to reorder them to this order and return
  *  whether it is even or odd.
+ *  Visited entries are marked by complementing them in place and
+ *  restored afterwards, so this allocates nothing.
  */
-int permutation_parity(int *const seq, int cnt)
+inline int permutation_parity(int *const seq, int cnt)
 {
     int cycle_cnt=0;
-    bool seen[cnt];
     for (int idx=0; idx<cnt; idx++) {
-        if (seen[idx]==false) {
+        if (seq[idx]>=0) {
             cycle_cnt+=1;
             int j = idx;
-            while (true) {
-                seen[j]=true;
-                j = seq[j];
-                if (j == idx) break;
+            while (seq[j]>=0) {
+                int next=seq[j];
+                seq[j]=~next;
+                j = next;
             }
         }
     }
+    for (int idx=0; idx<cnt; idx++) {
+        seq[idx]=~seq[idx];
+    }
     return (cnt - cycle_cnt) % 2;
 }
 
 
 
+//! Parity of the number of pairs out of order, for a few values.
+template<class ITER>
+int inversion_parity(ITER begin, int N)
+{
+    int parity=0;
+    ITER i=begin;
+    for (int a=0; a<N; a++, i++) {
+        ITER j=i;
+        j++;
+        for (int b=a+1; b<N; b++, j++) {
+            if (*j<*i) parity^=1;
+        }
+    }
+    return parity;
+}
+
+
+
 /*! Given a string a and a string b, return the relative parity.
- *  T should be a forward iterator.
+ *  T should be a forward iterator. Values must be distinct. Sorting
+ *  either string takes as many swaps, mod 2, as it has inversions,
+ *  so the parity between them is the sum of the two. This is
+ *  quadratic, which suits the few vertices of a simplex, and
+ *  allocates nothing.
  */
 template<class ITERA, class ITERB>
 int relative_parity(ITERA a_begin, ITERB b_begin, int N)
 {
-    // Find the index of every member of b within a.
-    typedef typename boost::iterator_value<ITERA>::type T;
+    return inversion_parity(a_begin, N) ^ inversion_parity(b_begin, N);
+}
+
+
 
-    std::map<T, int> idx;
-    
-    for (int cnt=0; cnt<N; cnt++) {
-        idx[*a_begin++]=cnt;
+
+namespace detail {
+
+    //! Index in a simplex of vertex k of the face that omits vertex omit.
+    constexpr int face_vertex(int omit, int k)
+    {
+        return k<omit ? k : k+1;
     }
-    int permutation[N];
-    for ( int *perm=permutation; perm!=permutation+N; b_begin++, perm++) {
-        *perm=idx[*b_begin];
+
+
+    /*! Orientation, 0 or 1, of the face that omits vertex omit,
+     *  relative to its simplex. This is the sign (-1)^omit of the
+     *  boundary operator.
+     */
+    constexpr int face_sign(int omit)
+    {
+        return omit & 1;
     }
-    return permutation_parity( permutation, N );
-}
 
 
+    /*! Copies vertices K to N-1 of face OMIT. The recursion unrolls at
+     *  compile time, and face_vertex is a constant at each step, so the
+     *  copy is a fixed sequence of loads and stores.
+     */
+    template<int OMIT, int K, int N>
+    struct copy_face
+    {
+        template<class SIMPLEX, class FACE>
+        static void apply(const SIMPLEX& s, FACE& f)
+        {
+            f[K]=s[face_vertex(OMIT, K)];
+            copy_face<OMIT,K+1,N>::apply(s, f);
+        }
+    };
 
+    template<int OMIT, int N>
+    struct copy_face<OMIT,N,N>
+    {
+        template<class SIMPLEX, class FACE>
+        static void apply(const SIMPLEX&, FACE&) {}
+    };
 
-/*! Iterate through all but the nth element */
-template<class ITER>
-class except_n_iterator
-    : public boost::iterator_adaptor<
-    except_n_iterator<ITER>,
-    ITER,
-    boost::use_default,
-    boost::forward_traversal_tag
-    >
-{
-    size_t _n;
-    size_t _i;
-public:
-    except_n_iterator()
-        : except_n_iterator::iterator_adaptor_(0)
-    {}
-    explicit except_n_iterator(ITER iter, size_t n)
-        :  _i(0), _n(n), except_n_iterator::iterator_adaptor_(iter)
+
+    //! Writes faces OMIT to N-1 of a simplex with N vertices.
+    template<int OMIT, int N>
+    struct write_faces
     {
-        skip_if_n();
-    }
-private:
-    friend class boost::iterator_core_access;
-    void increment() {
-        this->base_reference()++;
-        _i++;
-        skip_if_n();
+        template<class SIMPLEX, class FACE>
+        static void apply(const SIMPLEX& s, FACE* faces)
+        {
+            copy_face<OMIT,0,N-1>::apply(s, faces[OMIT]);
+            faces[OMIT].parity=s.parity ^ face_sign(OMIT);
+            write_faces<OMIT+1,N>::apply(s, faces);
+        }
+    };
+
+    template<int N>
+    struct write_faces<N,N>
+    {
+        template<class SIMPLEX, class FACE>
+        static void apply(const SIMPLEX&, FACE*) {}
+    };
+
+
+
+    /*! Puts a and b in order. Any swap of two entries is one
+     *  transposition, so a swap flips the parity. Written with min and
+     *  max, without a branch, since vertex order is unpredictable.
+     */
+    template<class T>
+    inline void compare_exchange(T& a, T& b, int& parity)
+    {
+        int swapped=(b<a);
+        T low=std::min(a, b);
+        b=std::max(a, b);
+        a=low;
+        parity^=swapped;
     }
-    void skip_if_n() {
-        if (_i == _n) {
-            increment();
+
+
+    /*! Sorts the N vertices of v in place and returns the parity of
+     *  the permutation that sorted them. Up to four vertices, enough
+     *  for a tetrahedron, this is a fixed sorting network. Larger
+     *  simplices use insertion sort.
+     */
+    template<int N>
+    struct parity_sort
+    {
+        template<class ARRAY>
+        static int apply(ARRAY& v)
+        {
+            int parity=0;
+            for (int i=1; i<N; i++) {
+                for (int j=i; j>0 && v[j]<v[j-1]; j--) {
+                    std::swap(v[j], v[j-1]);
+                    parity^=1;
+                }
+            }
+            return parity;
         }
+    };
+
+    template<>
+    struct parity_sort<1>
+    {
+        template<class ARRAY>
+        static int apply(ARRAY&) { return 0; }
+    };
+
+    template<>
+    struct parity_sort<2>
+    {
+        template<class ARRAY>
+        static int apply(ARRAY& v)
+        {
+            int parity=0;
+            compare_exchange(v[0], v[1], parity);
+            return parity;
+        }
+    };
+
+    template<>
+    struct parity_sort<3>
+    {
+        template<class ARRAY>
+        static int apply(ARRAY& v)
+        {
+            int parity=0;
+            compare_exchange(v[1], v[2], parity);
+            compare_exchange(v[0], v[2], parity);
+            compare_exchange(v[0], v[1], parity);
+            return parity;
+        }
+    };
+
+    template<>
+    struct parity_sort<4>
+    {
+        template<class ARRAY>
+        static int apply(ARRAY& v)
+        {
+            int parity=0;
+            compare_exchange(v[0], v[1], parity);
+            compare_exchange(v[2], v[3], parity);
+            compare_exchange(v[0], v[2], parity);
+            compare_exchange(v[1], v[3], parity);
+            compare_exchange(v[1], v[2], parity);
+            return parity;
+        }
+    };
+
+
+
+    /*! Writes the faces of a sorted simplex, face i omitting vertex i
+     *  with parity flipped for odd i. Faces of a sorted simplex are
+     *  sorted already, so no sort is needed.
+     */
+    template<class SIMPLEX>
+    void oriented_faces(const SIMPLEX& s,
+                        typename SIMPLEX::boundary_type* faces)
+    {
+        write_faces<0,SIMPLEX::dimension+1>::apply(s, faces);
     }
-};
+}
 
 
 
+/*! Steps through the faces of a simplex, as written once by
+ *  detail::oriented_faces when the iterator is made. SIMPLEX is the
+ *  face type, so there are SIMPLEX::dimension+2 faces. Faces are
+ *  returned by value, because each copy of the iterator holds its own.
+ */
 template<class SIMPLEX>
 class boundary_iterator_t
 	: public boost::iterator_facade<
 		boundary_iterator_t<SIMPLEX>,
-		const SIMPLEX,
-		boost::forward_traversal_tag
+		SIMPLEX,
+		boost::forward_traversal_tag,
+		SIMPLEX
 		>
 {
 public:
 	typedef SIMPLEX simplex_type;
 	typedef typename SIMPLEX::value_type T;
-	typedef typename SIMPLEX::const_iterator subiter;
+	static const int face_count=SIMPLEX::dimension+2;
 private:
-	SIMPLEX _simplex;
+	boost::array<SIMPLEX,face_count> _faces;
 	int _remove_idx;
-	subiter _begin; // iterator over vertex ids.
-	int _parity;
 public:
-    boundary_iterator_t() {}
-    explicit boundary_iterator_t(subiter begin, int parity)
-		: _begin(begin), _parity(parity), _remove_idx(0) {
-		assign_simplex();
+    boundary_iterator_t() : _remove_idx(face_count) {}
+    template<class PARENT>
+    explicit boundary_iterator_t(const PARENT& parent) : _remove_idx(0) {
+        detail::oriented_faces(parent, _faces.data());
     }
 	explicit boundary_iterator_t(int end_idx) : _remove_idx(end_idx) {}
 private:
 	friend class boost::iterator_core_access;
-	
+
 	void increment() {
 		_remove_idx++;
-		assign_simplex();
 	}
-	
+
 	bool equal(boundary_iterator_t const& other) const {
 		return other._remove_idx==_remove_idx;
 	}
-	
-	const SIMPLEX& dereference() const { return _simplex; }
-	
-	void assign_simplex() {
-        auto iter=except_n_iterator<subiter>(_begin, _remove_idx);
-        _simplex.assign(iter, _parity);
-	}
-};
 
-
-
-struct less_parity
-{
-    int &even;
-    less_parity(int& parity) : even(parity) {}
-    bool operator()(int a, int b) {
-        bool res = (a<b);
-        if (res) {
-            even=!even;
-        }
-        return res;
-    }
+	SIMPLEX dereference() const { return _faces[_remove_idx]; }
 };
 
 
@@ -183,21 +315,23 @@ public:
                    ^ b_parity;
     }
 
-	/*! This assigment tracks changes to parity during sorting
-	 *  the vertices.
+	/*! This assigment tracks changes to parity while sorting the
+	 *  vertices with detail::parity_sort, a sorting network for up
+	 *  to four vertices.
 	 */
     template<class InputIterator>
     void assign(InputIterator begin, int b_parity=0) {
         std::copy_n(begin, this->size(), this->begin());
-		int reorder_parity=0;
-		std::sort(this->begin(), this->end(), less_parity(reorder_parity));
-        parity=reorder_parity ^ b_parity;
+        parity=detail::parity_sort<M+1>::apply(*this) ^ b_parity;
     }
 
 
+	/*! The M+1 faces, face i omitting vertex i and oriented with
+	 *  sign (-1)^i relative to this simplex.
+	 */
 	std::pair<boundary_iterator,boundary_iterator>
 	boundary() const {
-		auto start=boundary_iterator(this->begin(), parity);
+		auto start=boundary_iterator(*this);
 		auto finish=boundary_iterator(M+1);
 		return std::pair<boundary_iterator,boundary_iterator>(start,finish);
 	}
@@ -221,6 +355,136 @@ std::ostream& operator<<(std::ostream& os, const simplex<T,M>& s)
 }
 
 
+namespace detail {
+
+    //! Hash of the vertices of a face, for open addressing.
+    template<class FACE>
+    uint64_t face_hash(const FACE& f)
+    {
+        uint64_t h=0x9e3779b97f4a7c15ull;
+        for (size_t v=0; v<f.size(); v++) {
+            h^=uint64_t(f[v]);
+            h*=0xff51afd7ed558ccdull;
+            h^=h>>33;
+        }
+        return h;
+    }
+}
+
+
+
+/*! The boundary, mod 2, of a chain of sorted simplices from [begin,end).
+ *  A face that appears an odd number of times survives, with the
+ *  orientation its copies sum to. All faces go into one flat vector,
+ *  which is sorted so copies of a face sit together and cancel in one
+ *  pass. The boundary replaces the contents of bdry, sorted. Nothing
+ *  is allocated per face.
+ */
+template<class ITER, class FACE>
+void sorted_boundary(ITER begin, ITER end, std::vector<FACE>& bdry)
+{
+    typedef typename std::iterator_traits<ITER>::value_type simplex_type;
+    const size_t n=simplex_type::dimension+1;
+    bdry.resize(n*std::distance(begin, end));
+    FACE* out=bdry.data();
+    for ( ; begin!=end; begin++, out+=n) {
+        detail::oriented_faces(*begin, out);
+    }
+    std::sort(bdry.begin(), bdry.end());
+
+    size_t kept=0;
+    for (size_t i=0; i<bdry.size(); ) {
+        size_t j=i;
+        int sum=0;
+        for ( ; j<bdry.size() && !(bdry[i]<bdry[j]); j++) {
+            sum+=bdry[j].parity ? -1 : 1;
+        }
+        if ((j-i)%2==1) {
+            bdry[kept]=bdry[i];
+            bdry[kept].parity=(sum<0);
+            kept++;
+        }
+        i=j;
+    }
+    bdry.resize(kept);
+}
+
+
+
+/*! The same boundary as sorted_boundary, found by counting faces in
+ *  an open-addressing hash table with linear probing. A face whose
+ *  copies so far cancel is deleted at once, by shifting later entries
+ *  back, so the table holds only the open front of the chain. For a
+ *  mesh read in order that is far smaller than the mesh. Only the
+ *  faces that survive are sorted at the end.
+ */
+template<class ITER, class FACE>
+void hashed_boundary(ITER begin, ITER end, std::vector<FACE>& bdry)
+{
+    typedef typename std::iterator_traits<ITER>::value_type simplex_type;
+    const size_t n=simplex_type::dimension+1;
+    struct slot {
+        FACE face;
+        int copies;
+        int sum;
+    };
+    std::vector<slot> table(1024);
+    size_t used=0;
+    FACE faces[n];
+    for ( ; begin!=end; begin++) {
+        detail::oriented_faces(*begin, faces);
+        for (size_t k=0; k<n; k++) {
+            if (2*(used+1)>table.size()) {
+                std::vector<slot> larger(2*table.size());
+                size_t mask=larger.size()-1;
+                for (size_t t=0; t<table.size(); t++) {
+                    if (table[t].copies==0) continue;
+                    size_t i=detail::face_hash(table[t].face) & mask;
+                    while (larger[i].copies!=0) i=(i+1) & mask;
+                    larger[i]=table[t];
+                }
+                table.swap(larger);
+            }
+            size_t mask=table.size()-1;
+            size_t i=detail::face_hash(faces[k]) & mask;
+            while (table[i].copies!=0 && table[i].face!=faces[k]) {
+                i=(i+1) & mask;
+            }
+            if (table[i].copies==0) {
+                table[i].face=faces[k];
+                used++;
+            }
+            table[i].copies++;
+            table[i].sum+=faces[k].parity ? -1 : 1;
+            if (table[i].copies%2==0 && table[i].sum==0) {
+                // Delete, moving back entries that probed past this slot.
+                used--;
+                for (size_t j=(i+1) & mask; table[j].copies!=0;
+                     j=(j+1) & mask) {
+                    size_t home=detail::face_hash(table[j].face) & mask;
+                    if (((j-home) & mask)>=((j-i) & mask)) {
+                        table[i]=table[j];
+                        i=j;
+                    }
+                }
+                table[i].copies=0;
+                table[i].sum=0;
+            }
+        }
+    }
+
+    bdry.clear();
+    for (size_t t=0; t<table.size(); t++) {
+        if (table[t].copies%2==1) {
+            bdry.push_back(table[t].face);
+            bdry.back().parity=(table[t].sum<0);
+        }
+    }
+    std::sort(bdry.begin(), bdry.end());
+}
+
+
+
 template<class STORAGE>
 class simplicial_complex {
 	STORAGE& _storage;
@@ -234,23 +498,15 @@ public:
 		return simplex_type::dimension;
 	}
 
-    std::set<boundary_type> boundary() {
-        std::set<boundary_type> bdry;
-        auto begin=_storage.storage_begin();
-        auto end=_storage.storage_end();
-		for ( ; begin!=end; begin++) {
-			typename simplex_type::boundary_iterator bd_begin, bd_end;
-			for (std::tie(bd_begin,bd_end) = begin->boundary();
-				 bd_begin!=bd_end;
-				 bd_begin++) {
-				auto elem = bdry.find(*bd_begin);
-				if (elem==bdry.end()) {
-					bdry.insert(*bd_begin);
-				} else {
-					bdry.erase(elem);
-				}
-			}
-		}
+	STORAGE& storage() { return _storage; }
+
+	/*! Faces that belong to an odd number of simplices, sorted, each
+	 *  oriented as its simplices induce. See hashed_boundary.
+	 */
+    std::vector<boundary_type> boundary() {
+        std::vector<boundary_type> bdry;
+        hashed_boundary(_storage.storage_begin(), _storage.storage_end(),
+                        bdry);
 		return bdry;
     }
 
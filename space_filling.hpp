@@ -0,0 +1,288 @@
+#ifndef _SPACE_FILLING_HPP_
+#define _SPACE_FILLING_HPP_ 1
+
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <stdint.h>
+#include <boost/array.hpp>
+
+
+namespace geodec
+{
+
+    //! How cells of a raster are numbered or visited.
+    enum cell_order { row_major_order, morton_order, hilbert_order };
+
+
+
+    namespace detail
+    {
+        //! Spread the 32 bits of v into the even bits of the result.
+        inline uint64_t spread_bits(uint32_t v)
+        {
+            uint64_t d=v;
+            d=(d | (d<<16)) & 0x0000ffff0000ffffull;
+            d=(d | (d<<8)) & 0x00ff00ff00ff00ffull;
+            d=(d | (d<<4)) & 0x0f0f0f0f0f0f0f0full;
+            d=(d | (d<<2)) & 0x3333333333333333ull;
+            d=(d | (d<<1)) & 0x5555555555555555ull;
+            return d;
+        }
+
+
+        //! Gather the even bits of d, the inverse of spread_bits.
+        inline uint32_t gather_bits(uint64_t d)
+        {
+            d&=0x5555555555555555ull;
+            d=(d | (d>>1)) & 0x3333333333333333ull;
+            d=(d | (d>>2)) & 0x0f0f0f0f0f0f0f0full;
+            d=(d | (d>>4)) & 0x00ff00ff00ff00ffull;
+            d=(d | (d>>8)) & 0x0000ffff0000ffffull;
+            d=(d | (d>>16)) & 0x00000000ffffffffull;
+            return uint32_t(d);
+        }
+    }
+
+
+
+    //! Interleave bits, x in the even bits and y in the odd.
+    inline uint64_t morton_encode(uint32_t x, uint32_t y)
+    {
+        return detail::spread_bits(x) | (detail::spread_bits(y)<<1);
+    }
+
+
+    inline boost::array<uint32_t,2> morton_decode(uint64_t d)
+    {
+        boost::array<uint32_t,2> xy = {{ detail::gather_bits(d),
+                                         detail::gather_bits(d>>1) }};
+        return xy;
+    }
+
+
+
+    namespace detail
+    {
+        //! Turn a quadrant of side s so the curve inside it lines up.
+        inline void hilbert_rotate(uint64_t s, uint64_t& x, uint64_t& y,
+                                   uint64_t rx, uint64_t ry)
+        {
+            if (ry==0) {
+                if (rx==1) {
+                    x=s-1-x;
+                    y=s-1-y;
+                }
+                std::swap(x, y);
+            }
+        }
+    }
+
+
+
+    /*! Distance along the Hilbert curve that fills a square of side
+     *  2^order, which starts at (0,0) and ends at (2^order-1,0).
+     */
+    inline uint64_t hilbert_encode(unsigned int order, uint32_t x, uint32_t y)
+    {
+        uint64_t n=uint64_t(1)<<order;
+        uint64_t px=x, py=y;
+        uint64_t d=0;
+        for (uint64_t s=n/2; s>0; s/=2) {
+            uint64_t rx=(px & s)>0;
+            uint64_t ry=(py & s)>0;
+            d+=s*s*((3*rx)^ry);
+            detail::hilbert_rotate(n, px, py, rx, ry);
+        }
+        return d;
+    }
+
+
+    inline boost::array<uint32_t,2> hilbert_decode(unsigned int order,
+                                                   uint64_t d)
+    {
+        uint64_t n=uint64_t(1)<<order;
+        uint64_t x=0, y=0;
+        for (uint64_t s=1; s<n; s*=2) {
+            uint64_t rx=1 & (d/2);
+            uint64_t ry=1 & (d^rx);
+            detail::hilbert_rotate(s, x, y, rx, ry);
+            x+=s*rx;
+            y+=s*ry;
+            d/=4;
+        }
+        boost::array<uint32_t,2> xy = {{ uint32_t(x), uint32_t(y) }};
+        return xy;
+    }
+
+
+
+    namespace detail
+    {
+        /*! Visits the cells of one quadrant of the curve, in curve order,
+         *  skipping quadrants that lie outside the w x h raster. Local
+         *  cell u of a quadrant of side s is at origin + a*u.
+         *  The matrix a is a signed permutation.
+         */
+        template<class VISIT>
+        void visit_quadrant(bool hilbert, long ox, long oy, const int a[4],
+                            long s, long w, long h, VISIT& visit)
+        {
+            long fx=ox+a[0]*(s-1)+a[1]*(s-1);
+            long fy=oy+a[2]*(s-1)+a[3]*(s-1);
+            if (std::max(ox, fx)<0 || std::min(ox, fx)>=w
+                    || std::max(oy, fy)<0 || std::min(oy, fy)>=h) {
+                return;
+            }
+            if (s==1) {
+                visit(size_t(ox), size_t(oy));
+                return;
+            }
+            long half=s/2;
+            for (int i=0; i<4; i++) {
+                long cx, cy;
+                int m[4]={ 1, 0, 0, 1 };
+                if (hilbert) {
+                    long rx=1 & (i/2);
+                    long ry=1 & (i^rx);
+                    cx=rx*half;
+                    cy=ry*half;
+                    if (i==0) {
+                        m[0]=0; m[1]=1; m[2]=1; m[3]=0;
+                    } else if (i==3) {
+                        cx+=half-1;
+                        cy+=half-1;
+                        m[0]=0; m[1]=-1; m[2]=-1; m[3]=0;
+                    }
+                } else {
+                    cx=(i & 1)*half;
+                    cy=(i>>1)*half;
+                }
+                int child[4]={ a[0]*m[0]+a[1]*m[2], a[0]*m[1]+a[1]*m[3],
+                               a[2]*m[0]+a[3]*m[2], a[2]*m[1]+a[3]*m[3] };
+                visit_quadrant(hilbert, ox+a[0]*cx+a[1]*cy,
+                               oy+a[2]*cx+a[3]*cy, child, half, w, h, visit);
+            }
+        }
+    }
+
+
+
+    /*! Calls visit(ix, iy) for each cell of a w x h raster in the given
+     *  order. The curves are those of the smallest power-of-two square
+     *  that covers the raster, with cells outside the raster left out.
+     *  Quadrants outside are skipped whole, so a long thin raster costs
+     *  about its own size, not that of the square.
+     */
+    template<class VISIT>
+    void for_each_cell(cell_order order, size_t w, size_t h, VISIT visit)
+    {
+        if (order==row_major_order) {
+            for (size_t iy=0; iy<h; iy++) {
+                for (size_t ix=0; ix<w; ix++) {
+                    visit(ix, iy);
+                }
+            }
+            return;
+        }
+        long side=1;
+        while (side<long(std::max(w, h))) {
+            side*=2;
+        }
+        int identity[4]={ 1, 0, 0, 1 };
+        detail::visit_quadrant(order==hilbert_order, 0, 0, identity, side,
+                               long(w), long(h), visit);
+    }
+
+
+
+    /*! Ids 0 to w*h-1 for the cells of a raster, assigned in row-major,
+     *  Morton or Hilbert order. With a curve order, cells that are close
+     *  in the raster mostly get close ids, so arrays indexed by id, such
+     *  as union-find parents, are read with better locality.
+     *
+     *  Ids are dense. The conversion both ways is a table lookup, and
+     *  to_raster and from_raster reorder whole arrays for output. Row
+     *  major order needs no tables. Vertices of the raster are numbered
+     *  with a second numbering of (w+1) x (h+1).
+     */
+    template<class INDEX=unsigned int>
+    class curve_numbering
+    {
+        size_t w_, h_;
+        cell_order order_;
+        std::vector<INDEX> id_of_cell_;
+        std::vector<INDEX> cell_of_id_;
+    public:
+        curve_numbering(size_t w, size_t h, cell_order order)
+            : w_(w), h_(h), order_(order)
+        {
+            if (w*h>size_t(std::numeric_limits<INDEX>::max())) {
+                throw std::runtime_error("Index type too small for numbering");
+            }
+            if (order==row_major_order) {
+                return;
+            }
+            id_of_cell_.resize(w*h);
+            cell_of_id_.resize(w*h);
+            size_t next=0;
+            for_each_cell(order, w, h, [&](size_t ix, size_t iy) {
+                id_of_cell_[ix+iy*w]=INDEX(next);
+                cell_of_id_[next++]=INDEX(ix+iy*w);
+            });
+        }
+
+
+        size_t id(size_t ix, size_t iy) const
+        {
+            if (order_==row_major_order) return ix+iy*w_;
+            return id_of_cell_[ix+iy*w_];
+        }
+
+
+        //! Row-major raster index, ix+iy*w, of a cell.
+        size_t raster_index(size_t id) const
+        {
+            if (order_==row_major_order) return id;
+            return cell_of_id_[id];
+        }
+
+
+        boost::array<size_t,2> cell(size_t id) const
+        {
+            size_t index=raster_index(id);
+            boost::array<size_t,2> xy = {{ index%w_, index/w_ }};
+            return xy;
+        }
+
+
+        //! Copy values ordered by id into a row-major raster.
+        template<class T>
+        void to_raster(const T* by_id, T* raster) const
+        {
+            for (size_t i=0; i<w_*h_; i++) {
+                raster[raster_index(i)]=by_id[i];
+            }
+        }
+
+
+        //! Copy a row-major raster into values ordered by id.
+        template<class T>
+        void from_raster(const T* raster, T* by_id) const
+        {
+            for (size_t i=0; i<w_*h_; i++) {
+                by_id[i]=raster[raster_index(i)];
+            }
+        }
+
+
+        size_t width() const { return w_; }
+        size_t height() const { return h_; }
+        cell_order order() const { return order_; }
+    };
+
+}
+
+
+#endif // _SPACE_FILLING_HPP_
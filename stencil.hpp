@@ -0,0 +1,253 @@
+#ifndef _STENCIL_HPP_
+#define _STENCIL_HPP_ 1
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <boost/array.hpp>
+#include <boost/property_map/property_map.hpp>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "implicit_grid.hpp"
+
+
+namespace geodec
+{
+
+    /*! Explicit time steps of advection and diffusion of a density on
+     *  the cells of a w x h grid, without assembling a matrix.
+     *
+     *  Diffusivity varies by cell, usually by land use, and the flux
+     *  between two cells uses the harmonic mean of theirs, so a cell
+     *  with zero diffusivity is a barrier. Advection is first-order
+     *  upwind with a constant velocity. The border of the grid passes no diffusive
+     *  flux. Advection carries density out of it and brings nothing in.
+     *
+     *  Fields are stored with a ring of zero cells, so the stencil
+     *  has no branches and the inner loop vectorizes. Steps are
+     *  blocked in time: each tile of the grid is copied with a halo
+     *  of time_block cells and advanced time_block steps in a buffer
+     *  that stays in cache, recomputing the halo instead of
+     *  synchronizing. Tiles run in parallel on TBB threads.
+     */
+    template<class T=float>
+    class diffusion_stencil
+    {
+        size_t w_, h_;
+        size_t stride_;
+        //! Conductance to the east and north neighbor, times dt/dx^2.
+        std::vector<T> kx_, ky_;
+        //! Upwind advection numbers split by sign.
+        T axp_, axn_, ayp_, ayn_;
+        std::vector<T> field_, next_;
+        size_t tile_w_, tile_h_;
+        size_t time_block_;
+
+        struct tile_buffers
+        {
+            std::vector<T> u, out, kx, ky;
+        };
+        tbb::enumerable_thread_specific<tile_buffers> buffers_;
+
+    public:
+        //! Floating point operations in one cell update.
+        static const int flops_per_cell=20;
+
+        /*! diffusivity is a readable property map from cell id,
+         *  ix+iy*w, to diffusivity in map units squared per unit time.
+         *  velocity is in map units per unit time.
+         */
+        template<class DIFFUSIVITY>
+        diffusion_stencil(size_t w, size_t h, DIFFUSIVITY diffusivity,
+                          const grid_geometry& geometry, double dt,
+                          boost::array<double,2> velocity)
+            : w_(w), h_(h), stride_(w+2),
+              kx_((w+2)*(h+2), 0), ky_((w+2)*(h+2), 0),
+              field_((w+2)*(h+2), 0), next_((w+2)*(h+2), 0),
+              tile_w_(512), tile_h_(64), time_block_(4)
+        {
+            double dx=geometry.row_edge_length();
+            double dy=geometry.column_edge_length();
+            for (size_t iy=0; iy<h; iy++) {
+                for (size_t ix=0; ix<w; ix++) {
+                    double d=get(diffusivity, ix+iy*w);
+                    size_t p=pad(ix, iy);
+                    if (ix+1<w) {
+                        kx_[p]=harmonic(d, get(diffusivity, ix+1+iy*w))*dt/(dx*dx);
+                    }
+                    if (iy+1<h) {
+                        ky_[p]=harmonic(d, get(diffusivity, ix+(iy+1)*w))*dt/(dy*dy);
+                    }
+                }
+            }
+            double ax=velocity[0]*dt/dx;
+            double ay=velocity[1]*dt/dy;
+            axp_=std::max(ax, 0.0);
+            axn_=std::min(ax, 0.0);
+            ayp_=std::max(ay, 0.0);
+            ayn_=std::min(ay, 0.0);
+        }
+
+
+        /*! Tile size in cells and the number of steps taken per tile
+         *  before writing back. A time_block of one is plain stepping.
+         */
+        void set_blocking(size_t tile_w, size_t tile_h, size_t time_block)
+        {
+            tile_w_=std::max<size_t>(tile_w, 1);
+            tile_h_=std::max<size_t>(tile_h, 1);
+            time_block_=std::max<size_t>(time_block, 1);
+        }
+
+
+        //! True if no cell's new value gets a negative weight.
+        bool is_stable() const
+        {
+            double advect=axp_-axn_+ayp_-ayn_;
+            for (size_t iy=0; iy<h_; iy++) {
+                for (size_t ix=0; ix<w_; ix++) {
+                    size_t p=pad(ix, iy);
+                    if (kx_[p]+kx_[p-1]+ky_[p]+ky_[p-stride_]+advect>1) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+
+        //! Copy in a density with w*h values, ordered by cell id.
+        void load(const T* density)
+        {
+            for (size_t iy=0; iy<h_; iy++) {
+                std::copy(density+iy*w_, density+(iy+1)*w_,
+                          &field_[pad(0, iy)]);
+            }
+        }
+
+
+        void store(T* density) const
+        {
+            for (size_t iy=0; iy<h_; iy++) {
+                std::copy(&field_[pad(0, iy)], &field_[pad(0, iy)]+w_,
+                          density+iy*w_);
+            }
+        }
+
+
+        void advance(size_t steps)
+        {
+            size_t tiles_x=(w_+tile_w_-1)/tile_w_;
+            size_t tiles_y=(h_+tile_h_-1)/tile_h_;
+            while (steps>0) {
+                size_t block=std::min(steps, time_block_);
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, tiles_x*tiles_y),
+                    [&](const tbb::blocked_range<size_t>& range) {
+                    for (size_t t=range.begin(); t!=range.end(); t++) {
+                        this->advance_tile((t%tiles_x)*tile_w_,
+                                           (t/tiles_x)*tile_h_, block);
+                    }
+                });
+                field_.swap(next_);
+                steps-=block;
+            }
+        }
+
+
+        size_t width() const { return w_; }
+        size_t height() const { return h_; }
+
+    private:
+        size_t pad(size_t ix, size_t iy) const { return (ix+1)+(iy+1)*stride_; }
+
+        static double harmonic(double a, double b)
+        {
+            if (a+b==0) return 0;
+            return 2*a*b/(a+b);
+        }
+
+
+        /*! One step over n cells in a row. Both arrays share stride,
+         *  and u, kx and ky share layout.
+         */
+        void advance_row(const T* __restrict__ u, T* __restrict__ out,
+                         const T* __restrict__ kx, const T* __restrict__ ky,
+                         size_t n, size_t stride) const
+        {
+            const T axp=axp_, axn=axn_, ayp=ayp_, ayn=ayn_;
+            for (size_t i=0; i<n; i++) {
+                T c=u[i];
+                T east=u[i+1]-c;
+                T west=c-u[i-1];
+                T north=u[i+stride]-c;
+                T south=c-u[i-stride];
+                out[i]=c + kx[i]*east - kx[i-1]*west
+                    + ky[i]*north - ky[i-stride]*south
+                    - axp*west - axn*east - ayp*south - ayn*north;
+            }
+        }
+
+
+        /*! Advance the tile whose lower cell is (x0,y0) by steps.
+         *  The tile and a halo of steps+1 padded cells are copied to
+         *  thread-local buffers. Step s updates the tile grown by
+         *  steps-s cells, clipped to the grid, so after the last step
+         *  the tile itself is exact.
+         */
+        void advance_tile(size_t x0, size_t y0, size_t steps)
+        {
+            size_t x1=std::min(x0+tile_w_, w_);
+            size_t y1=std::min(y0+tile_h_, h_);
+            // Padded extent to copy, clipped to the padded grid.
+            long halo=steps+1;
+            long px0=std::max<long>(long(x0)+1-halo, 0);
+            long py0=std::max<long>(long(y0)+1-halo, 0);
+            long px1=std::min<long>(long(x1)+1+halo, w_+2);
+            long py1=std::min<long>(long(y1)+1+halo, h_+2);
+            size_t lw=px1-px0;
+            size_t lh=py1-py0;
+
+            tile_buffers& local=buffers_.local();
+            local.u.resize(lw*lh);
+            local.out.resize(lw*lh);
+            local.kx.resize(lw*lh);
+            local.ky.resize(lw*lh);
+            for (long py=py0; py<py1; py++) {
+                size_t from=px0+py*stride_;
+                size_t to=(py-py0)*lw;
+                std::copy(&field_[from], &field_[from]+lw, &local.u[to]);
+                std::copy(&kx_[from], &kx_[from]+lw, &local.kx[to]);
+                std::copy(&ky_[from], &ky_[from]+lw, &local.ky[to]);
+            }
+            local.out=local.u;
+
+            for (size_t s=1; s<=steps; s++) {
+                long grow=steps-s;
+                long cx0=std::max<long>(long(x0)+1-grow, 1);
+                long cy0=std::max<long>(long(y0)+1-grow, 1);
+                long cx1=std::min<long>(long(x1)+1+grow, w_+1);
+                long cy1=std::min<long>(long(y1)+1+grow, h_+1);
+                for (long py=cy0; py<cy1; py++) {
+                    size_t i=(cx0-px0)+(py-py0)*lw;
+                    advance_row(&local.u[i], &local.out[i], &local.kx[i],
+                                &local.ky[i], cx1-cx0, lw);
+                }
+                local.u.swap(local.out);
+            }
+
+            for (size_t iy=y0; iy<y1; iy++) {
+                size_t i=(x0+1-px0)+(iy+1-py0)*lw;
+                std::copy(&local.u[i], &local.u[i]+(x1-x0),
+                          &next_[pad(x0, iy)]);
+            }
+        }
+    };
+
+    template<class T>
+    const int diffusion_stencil<T>::flops_per_cell;
+
+}
+
+
+#endif // _STENCIL_HPP_
@@ -0,0 +1,345 @@
+#ifndef _STREAM_LABEL_HPP_
+#define _STREAM_LABEL_HPP_ 1
+
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include "disjoint_sets.hpp"
+#include "gdal_io.hpp"
+#include "hdf_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! Labels clusters of equal value one row at a time.
+     *  It keeps the previous row of values and labels, which is the
+     *  frontier, and a table of equivalences among the labels of the
+     *  frontier and the row being added. A cell gets a new label only
+     *  where it matches neither its west nor its south neighbor.
+     *
+     *  After each row, the labels still alive in that row are given
+     *  compact ids below the width, and the table starts over from
+     *  them, so it never holds more than two rows' worth of labels,
+     *  however many clusters the raster has. relabeled() then says,
+     *  for each label of the row before, either the cluster id it
+     *  ended as, if no cell of the new row continues it, or its new
+     *  label. A cluster id is the smallest cell id in the cluster,
+     *  the same id label_raster gives. A caller spills these records
+     *  and resolves rows from last to first with a label_resolver.
+     */
+    template<class T, class LABEL=unsigned int>
+    class streaming_labeler
+    {
+        size_t width_;
+        size_t row_;
+        std::vector<T> prev_values_;
+        std::vector<LABEL> prev_labels_;
+        std::vector<LABEL> labels_;
+        //! Labels of the frontier are [0,live_), then new labels.
+        size_t live_;
+        dense_disjoint_sets<LABEL> equivalence_;
+        //! Id of the first cell in the set of each label, at its root.
+        std::vector<size_t> first_cell_;
+        std::vector<size_t> next_first_cell_;
+        std::vector<LABEL> next_label_;
+        std::vector<long> relabeled_;
+        size_t label_count_;
+        size_t peak_bytes_;
+
+        static const LABEL npos;
+    public:
+        streaming_labeler(size_t width) : width_(width), row_(0),
+            prev_values_(width), prev_labels_(width), labels_(width),
+            live_(0), equivalence_(2*width), label_count_(0), peak_bytes_(0)
+        {
+            if (2*width>=size_t(std::numeric_limits<LABEL>::max())) {
+                throw std::runtime_error("Too many labels for label type");
+            }
+            first_cell_.reserve(2*width);
+            next_first_cell_.reserve(width);
+            next_label_.reserve(2*width);
+            relabeled_.reserve(width);
+        }
+
+
+        /*! Label the next row, with labels below the width. The result
+         *  is valid until the next call.
+         */
+        const std::vector<LABEL>& add_row(const T* values)
+        {
+            for (size_t ix=0; ix<width_; ix++) {
+                bool west = (ix>0) && values[ix]==values[ix-1];
+                bool south = (row_>0) && values[ix]==prev_values_[ix];
+                if (west) {
+                    labels_[ix]=labels_[ix-1];
+                    if (south && !(values[ix]==prev_values_[ix-1])) {
+                        merge(labels_[ix], prev_labels_[ix]);
+                    }
+                } else if (south) {
+                    labels_[ix]=prev_labels_[ix];
+                } else {
+                    labels_[ix]=new_label(ix+row_*width_);
+                }
+            }
+            compact();
+            std::copy(values, values+width_, prev_values_.begin());
+            prev_labels_.swap(labels_);
+            row_++;
+            peak_bytes_=std::max(peak_bytes_, bytes());
+            return prev_labels_;
+        }
+
+
+        /*! Call after the last row. Every label of that row ends, so
+         *  relabeled() gives only cluster ids.
+         */
+        void finish()
+        {
+            relabeled_.assign(first_cell_.begin(), first_cell_.end());
+            first_cell_.clear();
+            live_=0;
+        }
+
+
+        /*! For each label of the row before the last add_row(), the
+         *  cluster id it ended as, or -1-label for its label in the row
+         *  just added. Valid until the next call.
+         */
+        const std::vector<long>& relabeled() const { return relabeled_; }
+
+
+        //! Labels made so far, counting each new label once.
+        size_t label_count() const { return label_count_; }
+
+
+        //! Bytes held now by the frontier and the equivalence table.
+        size_t bytes() const
+        {
+            return width_*(sizeof(T)+2*sizeof(LABEL))
+                + equivalence_.size()*(sizeof(LABEL)+1)
+                + (first_cell_.capacity()+next_first_cell_.capacity())
+                    *sizeof(size_t)
+                + next_label_.capacity()*sizeof(LABEL)
+                + relabeled_.capacity()*sizeof(long);
+        }
+
+
+        size_t peak_bytes() const { return peak_bytes_; }
+
+    private:
+        LABEL new_label(size_t cell)
+        {
+            LABEL label=first_cell_.size();
+            equivalence_.make_set(label);
+            first_cell_.push_back(cell);
+            label_count_++;
+            return label;
+        }
+
+
+        //! Join two sets, keeping the earlier first cell at the root.
+        void merge(LABEL a, LABEL b)
+        {
+            a=equivalence_.find_set(a);
+            b=equivalence_.find_set(b);
+            if (a==b) return;
+            size_t first=std::min(first_cell_[a], first_cell_[b]);
+            equivalence_.link(a, b);
+            first_cell_[equivalence_.find_set(a)]=first;
+        }
+
+
+        /*! Number the sets in the new row in order of appearance,
+         *  record where each label of the frontier went, and start the
+         *  table over with one set per new label.
+         */
+        void compact()
+        {
+            next_label_.assign(first_cell_.size(), npos);
+            next_first_cell_.clear();
+            for (size_t ix=0; ix<width_; ix++) {
+                LABEL root=equivalence_.find_set(labels_[ix]);
+                if (next_label_[root]==npos) {
+                    next_label_[root]=next_first_cell_.size();
+                    next_first_cell_.push_back(first_cell_[root]);
+                }
+                labels_[ix]=next_label_[root];
+            }
+            relabeled_.resize(live_);
+            for (size_t label=0; label<live_; label++) {
+                LABEL root=equivalence_.find_set(label);
+                relabeled_[label]=(next_label_[root]==npos)
+                    ? long(first_cell_[root]) : -1-long(next_label_[root]);
+            }
+            first_cell_.swap(next_first_cell_);
+            live_=first_cell_.size();
+            for (size_t label=0; label<live_; label++) {
+                equivalence_.make_set(label);
+            }
+        }
+    };
+
+
+    template<class T, class LABEL>
+    const LABEL streaming_labeler<T,LABEL>::npos=
+        std::numeric_limits<LABEL>::max();
+
+
+
+    /*! Turns the labels of rows into cluster ids, from the last row to
+     *  the first. Give it relabeled() from finish(), then resolve the
+     *  last row. Before each earlier row, give it the relabeled() that
+     *  followed the row after it.
+     */
+    class label_resolver
+    {
+        std::vector<long> cluster_;
+        std::vector<long> previous_;
+    public:
+        //! Step back one row, given where its labels went.
+        void step_back(const long* relabeled, size_t label_cnt)
+        {
+            previous_.resize(label_cnt);
+            for (size_t label=0; label<label_cnt; label++) {
+                long next=relabeled[label];
+                previous_[label]=(next>=0) ? next : cluster_[-1-next];
+            }
+            cluster_.swap(previous_);
+        }
+
+
+        long cluster_id(size_t label) const { return cluster_[label]; }
+
+
+        size_t bytes() const
+        {
+            return (cluster_.capacity()+previous_.capacity())*sizeof(long);
+        }
+    };
+
+
+
+    /*! What stream_label_file used and whether it fit in its ceiling. */
+    struct stream_label_report
+    {
+        size_t label_count;
+        size_t peak_bytes;
+        size_t ceiling_bytes;
+        bool within_ceiling() const { return peak_bytes<=ceiling_bytes; }
+    };
+
+
+    inline std::ostream& operator<<(std::ostream& os,
+                                    const stream_label_report& r)
+    {
+        os << "provisional labels " << r.label_count << " peak bytes "
+           << r.peak_bytes << " ceiling bytes " << r.ceiling_bytes;
+        if (!r.within_ceiling()) {
+            os << " EXCEEDED";
+        }
+        return os;
+    }
+
+
+
+    /*! Label clusters of a raster file without holding it in memory.
+     *  Reads one row of GDAL blocks at a time and writes the labels of
+     *  each strip to out as it finishes. The record of where each
+     *  row's labels went, with its length after it, is appended to a
+     *  label_map dataset in out. A second pass goes from the last strip
+     *  to the first, reading labels and records back and rewriting the
+     *  labels as final cluster ids, and then removes label_map. Peak
+     *  memory is a strip of the raster, its labels and records, and
+     *  the frontier and equivalence table, all proportional to the
+     *  width. It is reported against ceiling_bytes.
+     */
+    inline stream_label_report stream_label_file(gdal_file& reader,
+                        HDF_cluster_grid_file& out, size_t ceiling_bytes)
+    {
+        typedef unsigned int label_type;
+        boost::array<size_t,2> size=reader.size();
+        boost::array<size_t,2> block=reader.block_size();
+        size_t width=size[0];
+        if (size[0]*size[1] > size_t(std::numeric_limits<int>::max())) {
+            throw std::runtime_error("Raster too large for int cluster ids");
+        }
+
+        std::vector<unsigned char> strip(width*block[1]);
+        std::vector<label_type> strip_labels(width*block[1]);
+        // At most width labels per record, and its length.
+        std::vector<long> records;
+        records.reserve((width+1)*block[1]);
+        streaming_labeler<unsigned char,label_type> labeler(width);
+        const std::string map_name("label_map");
+        out.create_appendable<long>(map_name);
+        auto keep_record=[&]() {
+            const std::vector<long>& relabeled=labeler.relabeled();
+            records.insert(records.end(), relabeled.begin(), relabeled.end());
+            records.push_back(relabeled.size());
+        };
+
+        size_t y0=0;
+        for (size_t by=0; by<reader.block_count()[1]; by++) {
+            size_t rows=reader.read_strip(by, &strip[0]);
+            records.clear();
+            for (size_t iy=0; iy<rows; iy++) {
+                const std::vector<label_type>& row=
+                                    labeler.add_row(&strip[iy*width]);
+                std::copy(row.begin(), row.end(),
+                          strip_labels.begin()+iy*width);
+                keep_record();
+            }
+            out.write_rows(y0, rows, &strip_labels[0]);
+            out.append_array(map_name, records.data(), records.size());
+            y0+=rows;
+        }
+        labeler.finish();
+        records.clear();
+        keep_record();
+        out.append_array(map_name, records.data(), records.size());
+
+        // The records that resolve a strip are those of its rows after
+        // the first and the one after its last row, so they end the
+        // part of label_map not yet read.
+        label_resolver resolver;
+        size_t map_end=out.array_size(map_name);
+        for (size_t by=reader.block_count()[1]; by-->0; ) {
+            y0=by*block[1];
+            size_t rows=std::min(block[1], size[1]-y0);
+            size_t span=std::min(map_end, (width+1)*rows);
+            records.resize(span);
+            out.read_array(map_name, map_end-span, span, records.data());
+            out.read_rows(y0, rows, &strip_labels[0]);
+            size_t record_end=span;
+            for (size_t iy=rows; iy-->0; ) {
+                size_t label_cnt=records[record_end-1];
+                record_end-=label_cnt+1;
+                resolver.step_back(&records[record_end], label_cnt);
+                label_type* row=&strip_labels[iy*width];
+                for (size_t ix=0; ix<width; ix++) {
+                    row[ix]=resolver.cluster_id(row[ix]);
+                }
+            }
+            map_end-=span-record_end;
+            out.write_rows(y0, rows, &strip_labels[0]);
+        }
+        out.remove(map_name);
+
+        stream_label_report report;
+        report.label_count=labeler.label_count();
+        report.peak_bytes=labeler.peak_bytes()
+            + strip.size()*sizeof(unsigned char)
+            + strip_labels.size()*sizeof(label_type)
+            + records.capacity()*sizeof(long)
+            + resolver.bytes();
+        report.ceiling_bytes=ceiling_bytes;
+        return report;
+    }
+
+}
+
+
+#endif // _STREAM_LABEL_HPP_
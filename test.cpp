@@ -1,10 +1,18 @@
 #include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #define BOOST_TEST_MAIN
 #include <boost/test/unit_test.hpp>
 #include <boost/property_map/vector_property_map.hpp>
 #include <iostream>
 #include <utility>
+#include <map>
+#include <set>
+#include <tuple>
+#include <iterator>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/linear_congruential.hpp>
 #include <boost/random/uniform_int.hpp>
@@ -15,6 +23,25 @@
 #include "quad_complex.hpp"
 #include "generate_land.hpp"
 #include "gdal_io.hpp"
+#include "raster_label.hpp"
+#include "parallel_label.hpp"
+#include "stream_label.hpp"
+#include "implicit_grid.hpp"
+#include "quad_mesh.hpp"
+#include "dec_operators.hpp"
+#include "hodge_star.hpp"
+#include "stencil.hpp"
+#include "region_graph.hpp"
+#include "tile_cache.hpp"
+#include "prefetch_reader.hpp"
+#include "space_filling.hpp"
+#include "pixel_types.hpp"
+#include "paged_index.hpp"
+#include "triangle_mesh.hpp"
+#include "rips_complex.hpp"
+#include "persistence.hpp"
+#include "gdal/gdal_priv.h"
+#include "gdal/cpl_string.h"
 
 
 using namespace geodec;
@@ -115,6 +142,901 @@ BOOST_AUTO_TEST_CASE( test_checker_land_type )
 }
 
 
+BOOST_AUTO_TEST_CASE( test_cluster_summaries )
+{
+    // Two halves of a 4x3 grid with an island in the left half.
+    size_t w=4, h=3;
+    std::vector<unsigned char> land_use(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        land_use[cell] = (cell%w<2) ? 1 : 2;
+    }
+    land_use[5]=3;
+    typedef boost::iterator_property_map<std::vector<unsigned char>::iterator,
+        boost::identity_property_map> use_map_type;
+    use_map_type land_use_map(land_use.begin(), boost::identity_property_map());
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+
+    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+    geodec::disjoint_set_cluster<Polyhedron,compare_type,
+        dense_disjoint_sets<>> dsc(comparison);
+    dsc(*P);
+
+    BOOST_REQUIRE_EQUAL(dsc.clusters_.size(), 3);
+    const cluster_summary& left=dsc.clusters_[0];
+    BOOST_CHECK_EQUAL(left.id, 0);
+    BOOST_CHECK_EQUAL(left.cell_count, 5);
+    BOOST_CHECK_CLOSE(left.area, 5.0, 1e-9);
+    BOOST_CHECK_CLOSE(left.centroid[0], 0.9, 1e-9);
+    BOOST_CHECK_EQUAL(left.representative, 4);
+    BOOST_CHECK(left.border);
+    const cluster_summary& island=dsc.clusters_[2];
+    BOOST_CHECK_EQUAL(island.id, 5);
+    BOOST_CHECK_EQUAL(island.representative, 5);
+    BOOST_CHECK(!island.border);
+    BOOST_CHECK_EQUAL(dsc.cluster_index(9), 0);
+
+    BOOST_REQUIRE_EQUAL(dsc.adjacency_.size(), 3);
+    BOOST_CHECK_CLOSE(dsc.adjacency_[0].border_length, 2.0, 1e-9);
+    BOOST_CHECK_CLOSE(dsc.adjacency_[1].border_length, 3.0, 1e-9);
+    BOOST_CHECK_EQUAL(dsc.adjacency_[2].a, 1);
+    BOOST_CHECK_EQUAL(dsc.adjacency_[2].b, 2);
+    BOOST_CHECK_CLOSE(dsc.adjacency_[2].border_length, 1.0, 1e-9);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_region_graph_file )
+{
+    size_t w=4, h=3;
+    std::vector<unsigned char> land_use(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        land_use[cell] = (cell%w<2) ? 1 : 2;
+    }
+    land_use[5]=3;
+    typedef boost::iterator_property_map<std::vector<unsigned char>::iterator,
+        boost::identity_property_map> use_map_type;
+    use_map_type land_use_map(land_use.begin(), boost::identity_property_map());
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+
+    implicit_grid<Kernel> grid(w,h);
+    geodec::disjoint_set_cluster<implicit_grid<Kernel>,compare_type,
+        dense_disjoint_sets<>> dsc(comparison);
+    dsc(grid);
+    region_graph graph;
+    make_region_graph(dsc.clusters_, dsc.adjacency_, graph);
+    BOOST_CHECK_EQUAL(graph.node_count(), 3);
+    BOOST_CHECK_EQUAL(graph.edge_count(), 6);
+
+    std::string filename("region_graph_test.bin");
+    write_region_graph_file(filename, graph);
+    {
+        mapped_region_graph mapped(filename);
+        BOOST_CHECK_EQUAL(mapped.node_count(), 3);
+        BOOST_CHECK_EQUAL(mapped.edge_count(), 6);
+        for (size_t i=0; i<=mapped.node_count(); i++) {
+            BOOST_CHECK_EQUAL(mapped.offsets()[i], graph.offsets[i]);
+        }
+        // The island, cluster 2, touches both halves.
+        BOOST_CHECK_EQUAL(mapped.neighbors()[4], 0);
+        BOOST_CHECK_CLOSE(mapped.border_length()[4], 3.0, 1e-9);
+        BOOST_CHECK_EQUAL(mapped.cluster_id()[2], 5);
+        BOOST_CHECK_EQUAL(mapped.border()[2], 0);
+        BOOST_CHECK_CLOSE(mapped.centroid()[0], 0.9, 1e-9);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_hdf_chunk_writes )
+{
+    // Not a multiple of the chunk size, so edge chunks are partial.
+    size_t w=700, h=530;
+    std::vector<int> labels(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        labels[cell]=(cell*7)%1000;
+    }
+    std::string filename("hdf_chunk_test.h5");
+    for (int compression=0; compression<2; compression++) {
+        HDF_cluster_grid_file out(filename, w, h, compression);
+        BOOST_CHECK_EQUAL(out.chunk_size()[0], 256);
+        out.write_grid(&labels[0]);
+        std::vector<int> back(w*h);
+        out.read_rows(0, h, &back[0]);
+        BOOST_CHECK(back==labels);
+
+        // Other types go through HDF5's conversion.
+        std::vector<unsigned int> small(w*h, 3);
+        out.write_grid(&small[0]);
+        out.read_rows(0, h, &back[0]);
+        BOOST_CHECK_EQUAL(back[w*h-1], 3);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_tile_cache_lru )
+{
+    // Three 64-byte tiles fit in the budget of a 2x2 grid of blocks.
+    geodec::tile_cache cache("tile_cache_test.bin", 64, 1, 2, 2, 3*64+10);
+    BOOST_CHECK_EQUAL(cache.stats().budget_bytes, 3*64);
+    size_t decoded=0;
+    auto fill=[&](size_t bx, size_t by) {
+        return [&decoded,bx,by](unsigned char* tile) {
+            decoded++;
+            std::fill(tile, tile+64, static_cast<unsigned char>(bx+2*by+1));
+        };
+    };
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 0, fill(0,0))[63], 1);
+    BOOST_CHECK_EQUAL(cache.get(0, 1, 0, fill(1,0))[0], 2);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 1, fill(0,1))[0], 3);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 0, fill(0,0))[0], 1);
+    BOOST_CHECK_EQUAL(decoded, 3);
+
+    // (1,0) is least recently used, so (1,1) takes its slot.
+    BOOST_CHECK_EQUAL(cache.get(0, 1, 1, fill(1,1))[0], 4);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 1, fill(0,1))[0], 3);
+    BOOST_CHECK_EQUAL(cache.get(0, 1, 0, fill(1,0))[0], 2);
+    BOOST_CHECK_EQUAL(decoded, 5);
+    BOOST_CHECK_EQUAL(cache.stats().hits, 2);
+    BOOST_CHECK_EQUAL(cache.stats().misses, 5);
+    BOOST_CHECK_EQUAL(cache.stats().evictions, 2);
+
+    // A failed decode evicts (1,1) and leaves its slot empty, so the
+    // retry reuses that slot and the other two tiles stay.
+    BOOST_CHECK_THROW(cache.get(0, 0, 0, [](unsigned char*) {
+        throw std::runtime_error("bad block"); }), std::runtime_error);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 0, fill(0,0))[0], 1);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 1, fill(0,1))[0], 3);
+    BOOST_CHECK_EQUAL(cache.get(0, 1, 0, fill(1,0))[0], 2);
+    BOOST_CHECK_EQUAL(cache.stats().hits, 4);
+    BOOST_CHECK_EQUAL(cache.stats().evictions, 3);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_tile_cache_bands )
+{
+    // Two bands with room for one tile each. The tile band zero holds
+    // is pinned, so reads of band one take turns in the other slot.
+    geodec::tile_cache cache("tile_cache_bands.bin", 64, 2, 2, 1, 0);
+    BOOST_CHECK_EQUAL(cache.stats().budget_bytes, 2*64);
+    auto fill=[](unsigned char value) {
+        return [value](unsigned char* tile) {
+            std::fill(tile, tile+64, value);
+        };
+    };
+    const unsigned char* a=cache.get(0, 0, 0, fill(1));
+    for (size_t bx=0; bx<6; bx++) {
+        const unsigned char* b=cache.get(1, bx%2, 0, fill(10+bx%2));
+        BOOST_CHECK_EQUAL(b[0], 10+bx%2);
+        BOOST_CHECK_EQUAL(a[0], 1);
+    }
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 0, fill(2))[0], 1);
+
+    // Once band zero moves on, its old tile can go.
+    BOOST_CHECK_EQUAL(cache.get(0, 1, 0, fill(3))[0], 3);
+    BOOST_CHECK_EQUAL(cache.get(1, 0, 0, fill(12))[0], 12);
+    BOOST_CHECK_EQUAL(cache.get(0, 0, 0, fill(4))[0], 4);
+    BOOST_CHECK_EQUAL(cache.stats().evictions, 8);
+}
+
+
+
+/*! Stands in for GDAL. Fills each block with its own number and
+ *  fails on one block if asked.
+ */
+struct numbered_block_decoder
+{
+    size_t bad_block;
+    void operator()(size_t bx, size_t by, geodec::raster_block& block)
+    {
+        if (bx+5*by==bad_block) {
+            throw std::runtime_error("bad block");
+        }
+        block.pixels.assign(16, static_cast<unsigned char>(bx+5*by));
+    }
+};
+
+struct numbered_decoder_factory
+{
+    size_t bad_block;
+    std::unique_ptr<numbered_block_decoder> operator()() const
+    {
+        numbered_block_decoder* decode=new numbered_block_decoder;
+        decode->bad_block=bad_block;
+        return std::unique_ptr<numbered_block_decoder>(decode);
+    }
+};
+
+
+
+BOOST_AUTO_TEST_CASE( test_block_prefetcher_order )
+{
+    numbered_decoder_factory factory;
+    factory.bad_block=100;
+    for (size_t workers=1; workers<5; workers++) {
+        geodec::block_prefetcher<numbered_block_decoder>
+            reader(5, 7, 3, workers, factory);
+        size_t count=0;
+        while (const geodec::raster_block* block=reader.next()) {
+            BOOST_CHECK_EQUAL(block->bx+5*block->by, count);
+            BOOST_CHECK_EQUAL(block->pixels[15], count);
+            count++;
+        }
+        BOOST_CHECK_EQUAL(count, 35);
+        BOOST_CHECK(reader.next()==0);
+    }
+
+    // The failure comes out for its own block, and the reader can be
+    // dropped with blocks still in flight.
+    factory.bad_block=6;
+    geodec::block_prefetcher<numbered_block_decoder> reader(5, 7, 4, 2, factory);
+    for (size_t i=0; i<6; i++) {
+        BOOST_CHECK_EQUAL(reader.next()->pixels[0], i);
+    }
+    BOOST_CHECK_THROW(reader.next(), std::runtime_error);
+    BOOST_CHECK_EQUAL(reader.next()->pixels[0], 7);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_curve_numbering )
+{
+    // On a square of side 2^k, Hilbert neighbors in id are neighbors
+    // in the raster.
+    geodec::curve_numbering<> square(16, 16, geodec::hilbert_order);
+    for (size_t id=1; id<256; id++) {
+        boost::array<size_t,2> a=square.cell(id-1), b=square.cell(id);
+        BOOST_CHECK_EQUAL(std::abs(long(a[0])-long(b[0]))
+                          +std::abs(long(a[1])-long(b[1])), 1);
+        BOOST_CHECK_EQUAL(geodec::hilbert_encode(4, b[0], b[1]), id);
+    }
+
+    // Other shapes leave out cells beyond the raster but keep ids dense,
+    // and values survive the trip to id order and back.
+    geodec::cell_order orders[]={ geodec::row_major_order,
+                                  geodec::morton_order, geodec::hilbert_order };
+    size_t w=13, h=5;
+    std::vector<int> raster(w*h), by_id(w*h), back(w*h);
+    for (size_t cell=0; cell<w*h; cell++) {
+        raster[cell]=cell*3;
+    }
+    for (int o=0; o<3; o++) {
+        geodec::curve_numbering<> ids(w, h, orders[o]);
+        std::vector<int> seen(w*h, 0);
+        for (size_t iy=0; iy<h; iy++) {
+            for (size_t ix=0; ix<w; ix++) {
+                size_t id=ids.id(ix, iy);
+                BOOST_REQUIRE(id<w*h);
+                seen[id]++;
+                BOOST_CHECK_EQUAL(ids.cell(id)[0], ix);
+                BOOST_CHECK_EQUAL(ids.cell(id)[1], iy);
+            }
+        }
+        BOOST_CHECK(std::count(seen.begin(), seen.end(), 1)==int(w*h));
+        ids.from_raster(&raster[0], &by_id[0]);
+        ids.to_raster(&by_id[0], &back[0]);
+        BOOST_CHECK(back==raster);
+    }
+    BOOST_CHECK_EQUAL(geodec::curve_numbering<>(w, h, geodec::morton_order).id(1, 1), 3);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_paged_index )
+{
+    // Pages of 16 ids. Only pages that are written get allocated.
+    geodec::paged_index<unsigned int,4> index;
+    BOOST_CHECK(!index.contains(5));
+    BOOST_CHECK_EQUAL(index.find(1000), index.npos);
+    index.set(5, 0);
+    index.set(6, 1);
+    index.set(1000, 2);
+    BOOST_CHECK_EQUAL(index.find(5), 0u);
+    BOOST_CHECK_EQUAL(index.find(6), 1u);
+    BOOST_CHECK_EQUAL(index.find(1000), 2u);
+    BOOST_CHECK(!index.contains(7));
+    BOOST_CHECK(!index.contains(999));
+    BOOST_CHECK_EQUAL(index.size(), 3u);
+    BOOST_CHECK_EQUAL(index.page_bytes(), 2*16*sizeof(unsigned int));
+
+    // Overwriting an id does not count it twice.
+    index.set(6, 7);
+    BOOST_CHECK_EQUAL(index.find(6), 7u);
+    BOOST_CHECK_EQUAL(index.size(), 3u);
+
+    // Erasing the last id of a page frees it.
+    index.erase(1000);
+    BOOST_CHECK(!index.contains(1000));
+    BOOST_CHECK_EQUAL(index.size(), 2u);
+    BOOST_CHECK_EQUAL(index.page_bytes(), 16*sizeof(unsigned int));
+    index.erase(5);
+    BOOST_CHECK_EQUAL(index.find(6), 7u);
+
+    index.clear();
+    BOOST_CHECK(!index.contains(5));
+    BOOST_CHECK_EQUAL(index.page_bytes(), 0u);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_pixel_span_maps )
+{
+    // A 4x3 block at (4,3) of a raster 7 wide, clipped to 3x2, with a
+    // float nodata value.
+    std::vector<float> block(12);
+    for (size_t i=0; i<12; i++) {
+        block[i]=float(i);
+    }
+    block[5]=-9999;
+    boost::array<size_t,4> extent = {{ 4, 3, 3, 2 }};
+    geodec::pixel_span<float> span(&block[0], extent, 4);
+    BOOST_CHECK_EQUAL(span(2, 1), 6);
+    BOOST_CHECK_EQUAL(span.at(5, 4), -9999);
+    BOOST_CHECK(span.contains(6, 4));
+    BOOST_CHECK(!span.contains(7, 4));
+
+    geodec::span_cell_map<float> by_cell(span, 7);
+    BOOST_CHECK_EQUAL(get(by_cell, 4+3*7), 0);
+    BOOST_CHECK_EQUAL(get(by_cell, 6+4*7), 6);
+
+    geodec::band_info info = { geodec::pixel_float32, true, -9999 };
+    BOOST_CHECK(geodec::is_nodata(span(1, 1), info));
+    BOOST_CHECK(!geodec::is_nodata(span(0, 1), info));
+    info.nodata=std::numeric_limits<double>::quiet_NaN();
+    BOOST_CHECK(geodec::is_nodata(std::numeric_limits<float>::quiet_NaN(), info));
+    BOOST_CHECK(!geodec::is_nodata(1.0f, info));
+
+    // A whole band works as the land use map of compare_land_uses.
+    typedef geodec::band_map<float>::type map_type;
+    map_type uses=geodec::make_band_map(&block[0]);
+    compare_land_uses<map_type> comparison(uses);
+    block[7]=block[6];
+    BOOST_CHECK(comparison(6, 7));
+    BOOST_CHECK(!comparison(6, 8));
+    BOOST_CHECK_EQUAL(geodec::pixel_bytes(geodec::pixel_type_of<uint16_t>::value), 2);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_dense_matches_hashed )
+{
+    size_t w=10, h=20;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,3);
+    typedef std::map<size_t,unsigned char> use_type;
+    typedef boost::associative_property_map<use_type> use_map_type;
+    use_type land_use;
+    use_map_type land_use_map(land_use);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        land_use[gen_idx]=rand_usage(rng);
+    }
+    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+    geodec::disjoint_set_cluster<Polyhedron,compare_type> hashed(comparison);
+    hashed(*P);
+    geodec::disjoint_set_cluster<Polyhedron,compare_type,
+        dense_disjoint_sets<>> dense(comparison);
+    dense(*P);
+
+    auto elem_begin=boost::counting_iterator<size_t>(0);
+    auto elem_end=boost::counting_iterator<size_t>(w*h);
+    BOOST_CHECK_EQUAL(dense.dset_.count_sets(elem_begin,elem_end),
+                      hashed.dset_.count_sets(elem_begin,elem_end));
+    hashed.dset_.normalize_sets(elem_begin,elem_end);
+    dense.dset_.normalize_sets(elem_begin,elem_end);
+    for (size_t cell=0; cell<w*h; cell++) {
+        BOOST_CHECK_EQUAL(dense.dset_.find_set(cell),
+                          hashed.dset_.find_set(cell));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( test_raster_label_matches_cluster )
+{
+    size_t w=12, h=17;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,3);
+    typedef std::map<size_t,unsigned char> use_type;
+    typedef boost::associative_property_map<use_type> use_map_type;
+    use_type land_use;
+    use_map_type land_use_map(land_use);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        land_use[gen_idx]=rand_usage(rng);
+    }
+    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+    geodec::disjoint_set_cluster<Polyhedron,compare_type,
+        dense_disjoint_sets<>> dsc(comparison);
+    dsc(*P);
+    auto elem_begin=boost::counting_iterator<size_t>(0);
+    auto elem_end=boost::counting_iterator<size_t>(w*h);
+    dsc.dset_.normalize_sets(elem_begin,elem_end);
+
+    std::vector<unsigned int> labels;
+    label_raster(w, h, comparison, labels);
+    for (size_t cell=0; cell<w*h; cell++) {
+        BOOST_CHECK_EQUAL(labels[cell], dsc.dset_.find_set(cell));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( test_parallel_label_matches_serial )
+{
+    size_t w=53, h=41;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,2);
+    std::vector<unsigned char> use(w*h);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        use[gen_idx]=rand_usage(rng);
+    }
+    raster_values_equal<unsigned char> compare(use.data());
+    std::vector<unsigned int> serial;
+    label_raster(w, h, compare, serial);
+    for (size_t tile=1; tile<12; tile+=3) {
+        std::vector<unsigned int> parallel;
+        parallel_label_raster(w, h, tile, tile+1, compare, parallel, 2);
+        BOOST_CHECK(parallel==serial);
+    }
+}
+
+
+/*! Labels a raster with streaming_labeler, keeping every row's labels
+ *  and records, and resolves them from the last row to the first.
+ */
+size_t stream_labels(size_t w, size_t h, const std::vector<unsigned char>& use,
+                     std::vector<unsigned int>& labels)
+{
+    streaming_labeler<unsigned char> labeler(w);
+    labels.resize(w*h);
+    std::vector<std::vector<long>> records;
+    for (size_t row_idx=0; row_idx<h; row_idx++) {
+        const std::vector<unsigned int>& row=labeler.add_row(&use[row_idx*w]);
+        std::copy(row.begin(), row.end(), labels.begin()+row_idx*w);
+        records.push_back(labeler.relabeled());
+        BOOST_CHECK(std::all_of(row.begin(), row.end(),
+            [w](unsigned int label) { return label<w; }));
+    }
+    labeler.finish();
+    records.push_back(labeler.relabeled());
+    label_resolver resolver;
+    for (size_t row_idx=h; row_idx-->0; ) {
+        const std::vector<long>& after=records[row_idx+1];
+        resolver.step_back(after.data(), after.size());
+        for (size_t ix=0; ix<w; ix++) {
+            labels[ix+row_idx*w]=resolver.cluster_id(labels[ix+row_idx*w]);
+        }
+    }
+    return labeler.peak_bytes();
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_streaming_label_matches_raster )
+{
+    size_t w=31, h=23;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,2);
+    std::vector<unsigned char> use(w*h);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        use[gen_idx]=rand_usage(rng);
+    }
+    std::vector<unsigned int> labels;
+    label_raster(w, h, raster_values_equal<unsigned char>(use.data()), labels);
+    std::vector<unsigned int> streamed;
+    stream_labels(w, h, use, streamed);
+    BOOST_CHECK(streamed==labels);
+
+    // A checkerboard makes a cluster of every cell, and memory still
+    // does not grow with the number of rows.
+    size_t tall=40*h;
+    std::vector<unsigned char> board(w*tall);
+    for (size_t cell=0; cell<w*tall; cell++) {
+        board[cell]=((cell%w)+(cell/w))%2;
+    }
+    size_t short_bytes=stream_labels(w, h, board, streamed);
+    size_t tall_bytes=stream_labels(w, tall, board, streamed);
+    BOOST_CHECK_EQUAL(tall_bytes, short_bytes);
+    label_raster(w, tall, raster_values_equal<unsigned char>(board.data()),
+                 labels);
+    BOOST_CHECK(streamed==labels);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_implicit_grid_cluster )
+{
+    size_t w=7, h=9;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,3);
+    std::vector<unsigned char> land_use(w*h);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        land_use[gen_idx]=rand_usage(rng);
+    }
+    typedef boost::iterator_property_map<std::vector<unsigned char>::iterator,
+        boost::identity_property_map> use_map_type;
+    use_map_type land_use_map(land_use.begin(), boost::identity_property_map());
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+
+    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+    geodec::disjoint_set_cluster<Polyhedron,compare_type> poly_dsc(comparison);
+    poly_dsc(*P);
+
+    implicit_grid<Kernel> grid(w,h);
+    BOOST_CHECK(examine_polyhedron_grid(grid));
+    geodec::disjoint_set_cluster<implicit_grid<Kernel>,compare_type,
+        dense_disjoint_sets<>> grid_dsc(comparison);
+    grid_dsc(grid);
+
+    auto elem_begin=boost::counting_iterator<size_t>(0);
+    auto elem_end=boost::counting_iterator<size_t>(w*h);
+    BOOST_CHECK_EQUAL(grid_dsc.dset_.count_sets(elem_begin,elem_end),
+                      poly_dsc.dset_.count_sets(elem_begin,elem_end));
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_grid_geometry )
+{
+    boost::array<double,6> xform = {{ 500000, 30, 0, 4100000, 0, -30 }};
+    grid_geometry geometry(xform);
+    BOOST_CHECK_CLOSE(geometry.cell_area(), 900.0, 1e-9);
+    BOOST_CHECK_CLOSE(geometry.row_edge_length(), 30.0, 1e-9);
+    boost::array<double,2> center=geometry.cell_centroid(2, 3);
+    BOOST_CHECK_CLOSE(center[0], 500075.0, 1e-9);
+    BOOST_CHECK_CLOSE(center[1], 4099895.0, 1e-9);
+
+    implicit_grid<Kernel> grid(4, 2, geometry);
+    Kernel::Point_3 corner=grid.point(grid.size_of_vertices()-1);
+    BOOST_CHECK_CLOSE(corner.x(), 500120.0, 1e-9);
+    BOOST_CHECK_CLOSE(corner.y(), 4099940.0, 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_quad_mesh_masked )
+{
+    size_t w=6, h=5;
+    std::vector<bool> mask(w*h, true);
+    mask[0]=false;
+    mask[8]=false;
+    mask[w*h-1]=false;
+    quad_mesh<Kernel> mesh(w, h, mask);
+    BOOST_CHECK(mesh.is_valid());
+    BOOST_CHECK_EQUAL(mesh.size_of_facets(), w*h-3);
+
+    // Face, edge and halfedge adjacency agree.
+    size_t npos=quad_mesh<Kernel>::npos;
+    size_t border_facet=w*h;
+    for (auto f=mesh.facets_begin(); f!=mesh.facets_end(); ++f) {
+        boost::array<size_t,4> edges=mesh.face_edges(f->id());
+        auto h=f->facet_begin();
+        for (int side=0; side<4; side++, ++h) {
+            int sign=quad_mesh<Kernel>::face_edge_sign(side);
+            boost::array<size_t,2> faces=mesh.edge_faces(edges[side]);
+            BOOST_CHECK_EQUAL(faces[sign>0 ? 0 : 1], f->id());
+            size_t across=faces[sign>0 ? 1 : 0];
+            if (h->opposite()->is_border()) {
+                BOOST_CHECK_EQUAL(across, npos);
+                BOOST_CHECK_EQUAL(h->opposite()->facet()->id(), border_facet);
+            } else {
+                BOOST_CHECK_EQUAL(across, h->opposite()->facet()->id());
+            }
+            boost::array<size_t,2> ends=mesh.edge_vertices(edges[side]);
+            BOOST_CHECK_EQUAL(ends[sign>0 ? 1 : 0], h->vertex()->id());
+        }
+    }
+    size_t edge_cnt=0;
+    for (size_t e=0; e<mesh.edge_count(); e++) {
+        if (mesh.edge_exists(e)) edge_cnt++;
+    }
+    BOOST_CHECK_EQUAL(2*edge_cnt, mesh.size_of_halfedges());
+    BOOST_CHECK_EQUAL(mesh.vertex_edges(0)[0], npos);
+
+    // Missing cells make no sets and join nothing.
+    std::vector<unsigned char> land_use(w*h, 1);
+    typedef boost::iterator_property_map<std::vector<unsigned char>::iterator,
+        boost::identity_property_map> use_map_type;
+    use_map_type land_use_map(land_use.begin(), boost::identity_property_map());
+    typedef compare_land_uses<use_map_type> compare_type;
+    compare_type comparison(land_use_map);
+    geodec::disjoint_set_cluster<quad_mesh<Kernel>,compare_type,
+        dense_disjoint_sets<>> dsc(comparison);
+    dsc(mesh);
+    BOOST_CHECK(!dsc.dset_.has_set(8));
+    BOOST_CHECK_EQUAL(dsc.dset_.find_set(1), dsc.dset_.find_set(w*h-2));
+
+    std::ostringstream out;
+    write_complex(&mesh, out);
+    BOOST_CHECK(out.str().find("facets")!=std::string::npos);
+}
+
+
+
+/*! Storage for simplicial_complex, which expects storage_begin(). */
+template<class SIMPLEX>
+struct simplex_storage
+{
+    typedef SIMPLEX value_type;
+    std::vector<SIMPLEX> simplices;
+    typename std::vector<SIMPLEX>::iterator storage_begin() {
+        return simplices.begin();
+    }
+    typename std::vector<SIMPLEX>::iterator storage_end() {
+        return simplices.end();
+    }
+};
+
+
+
+BOOST_AUTO_TEST_CASE( test_exterior_derivatives )
+{
+    size_t w=7, h=5;
+    std::vector<bool> mask(w*h, true);
+    mask[3]=false;
+    mask[17]=false;
+    quad_mesh<Kernel> mesh(w, h, mask);
+    csr_matrix<> d0, d1;
+    grid_d0(mesh, d0);
+    grid_d1(mesh, d1);
+    BOOST_CHECK(product_is_zero(d1, d0));
+    BOOST_CHECK_EQUAL(d1.nnz(), 4*mesh.size_of_facets());
+    BOOST_CHECK_EQUAL(d0.nnz(), mesh.size_of_halfedges());
+    d1.values[0]=-d1.values[0];
+    BOOST_CHECK(!product_is_zero(d1, d0));
+
+    std::unique_ptr<Polyhedron> P = grid2d<Polyhedron>(w,h);
+    csr_matrix<> p0, p1;
+    polyhedron_d0(*P, p0);
+    polyhedron_d1(*P, p1);
+    BOOST_CHECK(product_is_zero(p1, p0));
+    BOOST_CHECK_EQUAL(p0.rows, mesh.edge_count());
+    BOOST_CHECK_EQUAL(p1.nnz(), 4*w*h);
+
+    // A fan of triangles oriented alike. Interior edges cancel.
+    simplex_storage<simplex<int,2>> storage;
+    int triangles[][3]={{0,1,2},{2,1,3},{3,4,2}};
+    for (int t=0; t<3; t++) {
+        simplex<int,2> tri;
+        tri.assign(triangles[t], 0);
+        storage.simplices.push_back(tri);
+    }
+    simplicial_complex<simplex_storage<simplex<int,2>>> complex(storage);
+    std::vector<simplex<int,1>> edges;
+    std::vector<simplex<int,0>> vertices;
+    csr_matrix<> s0, s1;
+    simplicial_derivative(complex, edges, s1);
+    simplicial_derivative(edges.begin(), edges.end(), vertices, s0);
+    BOOST_CHECK_EQUAL(edges.size(), 7);
+    BOOST_CHECK_EQUAL(vertices.size(), 5);
+    BOOST_CHECK(product_is_zero(s1, s0));
+    std::vector<double> edge_sum(s1.cols, 0);
+    for (size_t k=0; k<s1.nnz(); k++) {
+        edge_sum[s1.columns[k]]+=s1.values[k];
+    }
+    size_t interior=0;
+    for (size_t e=0; e<edges.size(); e++) {
+        if (edge_sum[e]==0) interior++;
+    }
+    BOOST_CHECK_EQUAL(interior, 2);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_simplex_boundary )
+{
+    int seq[]={ 2, 0, 1, 4, 3 };
+    BOOST_CHECK_EQUAL(permutation_parity(seq, 5), 1);
+    BOOST_CHECK_EQUAL(seq[0], 2);
+    BOOST_CHECK_EQUAL(seq[4], 3);
+    int a[]={ 3, 1, 2 }, b[]={ 1, 2, 3 }, c[]={ 2, 1, 3 };
+    BOOST_CHECK_EQUAL(relative_parity(a, b, 3), 0);
+    BOOST_CHECK_EQUAL(relative_parity(c, b, 3), 1);
+
+    // Two triangles in each cell of a w x h grid, oriented alike.
+    size_t w=4, h=3;
+    simplex_storage<simplex<int,2>> storage;
+    for (size_t iy=0; iy<h; iy++) {
+        for (size_t ix=0; ix<w; ix++) {
+            int v=ix+iy*(w+1);
+            int lower[]={ v, v+1, v+int(w)+2 };
+            int upper[]={ v, v+int(w)+2, v+int(w)+1 };
+            simplex<int,2> tri;
+            tri.assign(lower, 0);
+            storage.simplices.push_back(tri);
+            tri.assign(upper, 0);
+            storage.simplices.push_back(tri);
+        }
+    }
+    simplicial_complex<simplex_storage<simplex<int,2>>> complex(storage);
+    std::vector<simplex<int,1>> bdry=complex.boundary();
+    BOOST_CHECK_EQUAL(bdry.size(), 2*(w+h));
+    BOOST_CHECK(std::is_sorted(bdry.begin(), bdry.end()));
+
+    // The boundary is a cycle, so each vertex is entered as often as left.
+    std::vector<int> degree((w+1)*(h+1), 0);
+    for (size_t e=0; e<bdry.size(); e++) {
+        int tail=bdry[e][bdry[e].parity], head=bdry[e][1-bdry[e].parity];
+        degree[tail]--;
+        degree[head]++;
+    }
+    BOOST_CHECK(std::count(degree.begin(), degree.end(), 0)==int(degree.size()));
+
+    std::vector<simplex<int,1>> sorted;
+    sorted_boundary(storage.simplices.begin(), storage.simplices.end(), sorted);
+    BOOST_REQUIRE_EQUAL(sorted.size(), bdry.size());
+    for (size_t e=0; e<bdry.size(); e++) {
+        BOOST_CHECK(sorted[e]==bdry[e]);
+        BOOST_CHECK_EQUAL(sorted[e].parity, bdry[e].parity);
+    }
+}
+
+
+
+template<int M>
+void check_simplex_faces()
+{
+    int vals[]={ 7, 2, 9, 4 };
+    std::sort(vals, vals+M+1);
+    do {
+        simplex<int,M> a, b;
+        a.assign(vals, 1);
+        b.assign2(vals, 1);
+        BOOST_CHECK(a==b);
+        BOOST_CHECK_EQUAL(a.parity, b.parity);
+        BOOST_CHECK(std::is_sorted(a.begin(), a.end()));
+
+        int omit=0;
+        auto faces=a.boundary();
+        for (auto f=faces.first; f!=faces.second; f++, omit++) {
+            for (int k=0; k<M; k++) {
+                BOOST_CHECK_EQUAL((*f)[k], a[detail::face_vertex(omit, k)]);
+            }
+            BOOST_CHECK_EQUAL(f->parity, a.parity^(omit&1));
+        }
+        BOOST_CHECK_EQUAL(omit, M+1);
+    } while (std::next_permutation(vals, vals+M+1));
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_simplex_faces )
+{
+    check_simplex_faces<1>();
+    check_simplex_faces<2>();
+    check_simplex_faces<3>();
+
+    // The boundary of the boundary of a tetrahedron is empty: each
+    // edge comes from two triangles, oppositely oriented.
+    simplex<int,3> tet;
+    int vals[]={ 3, 0, 2, 1 };
+    tet.assign(vals, 0);
+    std::vector<simplex<int,1>> edges;
+    auto triangles=tet.boundary();
+    for (auto t=triangles.first; t!=triangles.second; t++) {
+        edges.insert(edges.end(), t->boundary().first, t->boundary().second);
+    }
+    BOOST_REQUIRE_EQUAL(edges.size(), 12);
+    std::sort(edges.begin(), edges.end());
+    for (size_t e=0; e<edges.size(); e+=2) {
+        BOOST_CHECK(edges[e]==edges[e+1]);
+        BOOST_CHECK(edges[e].parity!=edges[e+1].parity);
+    }
+    std::vector<simplex<int,2>> faces;
+    std::vector<simplex<int,3>> one(1, tet);
+    sorted_boundary(one.begin(), one.end(), faces);
+    BOOST_CHECK_EQUAL(faces.size(), 4);
+
+    // A face outlives the iterator that made it.
+    const simplex<int,2>& first=*tet.boundary().first;
+    BOOST_CHECK(first==*triangles.first);
+    BOOST_CHECK_EQUAL(first.parity, triangles.first->parity);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_grid_laplacian )
+{
+    size_t w=6, h=4;
+    std::vector<bool> mask(w*h, true);
+    mask[8]=false;
+    boost::array<double,6> xform = {{ 0, 30, 0, 0, 0, -20 }};
+    quad_mesh<Kernel> mesh(w, h, mask, grid_geometry(xform));
+    diagonal_hodge hodge;
+    grid_hodge_stars(mesh, hodge);
+    double dual_area=0;
+    for (size_t v=0; v<hodge.star0.size(); v++) {
+        dual_area+=hodge.star0[v];
+    }
+    BOOST_CHECK_CLOSE(dual_area, (w*h-1)*600.0, 1e-9);
+
+    csr_matrix<> laplacian;
+    grid_laplacian(mesh, hodge, laplacian);
+    std::vector<double> ones(laplacian.cols, 1), result(laplacian.rows);
+    laplacian.multiply(&ones[0], &result[0]);
+    for (size_t v=0; v<result.size(); v++) {
+        BOOST_CHECK_SMALL(result[v], 1e-12);
+    }
+
+    // Same as star0^-1 d0^T star1 d0 applied to a field.
+    csr_matrix<> d0;
+    grid_d0(mesh, d0);
+    std::vector<double> u(laplacian.cols), lu(laplacian.rows);
+    std::vector<double> gradient(d0.rows), expected(laplacian.rows, 0);
+    for (size_t v=0; v<u.size(); v++) {
+        u[v]=(v*7)%5;
+    }
+    laplacian.multiply(&u[0], &lu[0]);
+    d0.multiply(&u[0], &gradient[0]);
+    for (size_t e=0; e<d0.rows; e++) {
+        for (size_t k=d0.offsets[e]; k<d0.offsets[e+1]; k++) {
+            expected[d0.columns[k]]+=d0.values[k]*hodge.star1[e]*gradient[e];
+        }
+    }
+    for (size_t v=0; v<u.size(); v++) {
+        if (hodge.star0[v]>0) {
+            BOOST_CHECK_SMALL(expected[v]/hodge.star0[v]-lu[v], 1e-9);
+        }
+    }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_diffusion_stencil_blocking )
+{
+    size_t w=37, h=23, wall=17;
+    std::vector<double> diffusivity(w*h, 1.0);
+    for (size_t iy=0; iy<h; iy++) {
+        diffusivity[wall+iy*w]=0;
+    }
+    typedef boost::iterator_property_map<std::vector<double>::iterator,
+        boost::identity_property_map> diffusivity_map;
+    diffusivity_map coefficients(diffusivity.begin(),
+                                 boost::identity_property_map());
+    std::vector<float> density(w*h, 0), plain(w*h), blocked(w*h);
+    density[5+5*w]=100;
+    density[30+10*w]=50;
+
+    // Without advection, diffusion keeps mass and stops at the wall.
+    boost::array<double,2> still = {{ 0, 0 }};
+    diffusion_stencil<float> stencil(w, h, coefficients, grid_geometry(),
+                                     0.2, still);
+    BOOST_CHECK(stencil.is_stable());
+    stencil.load(&density[0]);
+    stencil.advance(10);
+    stencil.store(&plain[0]);
+    double total=0, west=0;
+    for (size_t cell=0; cell<w*h; cell++) {
+        total+=plain[cell];
+        if (cell%w<wall) west+=plain[cell];
+    }
+    BOOST_CHECK_CLOSE(total, 150.0, 1e-3);
+    BOOST_CHECK_CLOSE(west, 100.0, 1e-3);
+
+    // Blocking in time gives the same values as stepping.
+    boost::array<double,2> wind = {{ 0.3, -0.2 }};
+    diffusion_stencil<float> stepped(w, h, coefficients, grid_geometry(),
+                                     0.2, wind);
+    stepped.set_blocking(w, h, 1);
+    stepped.load(&density[0]);
+    stepped.advance(50);
+    stepped.store(&plain[0]);
+    diffusion_stencil<float> tiled(w, h, coefficients, grid_geometry(),
+                                   0.2, wind);
+    tiled.set_blocking(7, 3, 6);
+    tiled.load(&density[0]);
+    tiled.advance(50);
+    tiled.store(&blocked[0]);
+    BOOST_CHECK(plain==blocked);
+}
+
+
+
 /*! Adding a single quad to a grid.
  *  The question is how incremental_builder indexes vertices.
  *  The answer is that the size_t index you pass to the incremental
@@ -219,6 +1141,449 @@ BOOST_AUTO_TEST_CASE( test_two_structures )
 
 
 
+/*! Reads blocks of a w x h grid of unit squares, for block_stitcher
+ *  and triangle_mesh_builder, leaving out the cells in a square hole.
+ */
+struct synthetic_block_reader
+{
+    size_t w, h, side;
+    size_t hole[4];
+    std::vector<unsigned char> halo;
+    //! Blocks whose vertex coordinates were read.
+    size_t coordinate_reads=0;
+
+    boost::array<size_t,2> size() const
+    {
+        boost::array<size_t,2> wh={{ w, h }};
+        return wh;
+    }
+
+    boost::array<size_t,2> block_size() const
+    {
+        boost::array<size_t,2> bs={{ side, side }};
+        return bs;
+    }
+
+    boost::array<size_t,4> block_extent(size_t bx, size_t by) const
+    {
+        boost::array<size_t,4> extent={{ bx*side, by*side,
+            std::min(side, w-bx*side), std::min(side, h-by*side) }};
+        return extent;
+    }
+
+    /*! Validity with a ring of neighbors, as gdal_file gives it, which
+     *  fills in a side of the ring only if the block has a valid cell
+     *  along that side.
+     */
+    const unsigned char* block_validity(size_t bx, size_t by)
+    {
+        boost::array<size_t,4> e=block_extent(bx, by);
+        size_t hw=side+2;
+        halo.assign(hw*(side+2), 0);
+        bool west=false, east=false, south=false, north=false;
+        for (size_t iy=0; iy<e[3]; iy++) {
+            for (size_t ix=0; ix<e[2]; ix++) {
+                bool v=valid(e[0]+ix, e[1]+iy);
+                halo[(ix+1)+(iy+1)*hw]=v;
+                west|=v && ix==0;
+                east|=v && ix+1==e[2];
+                south|=v && iy==0;
+                north|=v && iy+1==e[3];
+            }
+        }
+        for (long iy=-1; iy<=long(e[3]); iy++) {
+            for (long ix=-1; ix<=long(e[2]); ix++) {
+                long px=long(e[0])+ix, py=long(e[1])+iy;
+                bool ring_x=(ix<0 && west) || (ix==long(e[2]) && east);
+                bool ring_y=(iy<0 && south) || (iy==long(e[3]) && north);
+                bool inside_x=ix>=0 && ix<long(e[2]);
+                bool inside_y=iy>=0 && iy<long(e[3]);
+                if (!((ring_x && inside_y) || (ring_y && inside_x))) continue;
+                if (px<0 || py<0 || px>=long(w) || py>=long(h)) continue;
+                halo[(ix+1)+(iy+1)*hw]=valid(px, py);
+            }
+        }
+        return &halo[0];
+    }
+
+    void vertex_coordinates(const boost::array<size_t,4>& ind,
+                            double* x, double* y, double* z)
+    {
+        coordinate_reads++;
+        for (size_t iy=0; iy<=ind[3]; iy++) {
+            for (size_t ix=0; ix<=ind[2]; ix++) {
+                size_t k=ix+iy*(ind[2]+1);
+                x[k]=double(ind[0]+ix);
+                y[k]=double(ind[1]+iy);
+                z[k]=0;
+            }
+        }
+    }
+
+    size_t facet_id(size_t px, size_t py) const { return px+py*w; }
+
+    boost::array<size_t,2> block_count() const
+    {
+        boost::array<size_t,2> cnt={{ (w+side-1)/side, (h+side-1)/side }};
+        return cnt;
+    }
+
+    bool valid(size_t px, size_t py) const
+    {
+        return !(px>=hole[0] && px<hole[2] && py>=hole[1] && py<hole[3]);
+    }
+
+    template<class BUILDER>
+    void read_block(BUILDER& builder, size_t bx, size_t by)
+    {
+        size_t x1=std::min(w, (bx+1)*side), y1=std::min(h, (by+1)*side);
+        for (size_t iy=by*side; iy<=y1; iy++) {
+            for (size_t ix=bx*side; ix<=x1; ix++) {
+                boost::array<double,3> loc={{ double(ix), double(iy), 0 }};
+                builder.add_vertex(loc, ix+iy*(w+1));
+            }
+        }
+        for (size_t py=by*side; py<y1; py++) {
+            for (size_t px=bx*side; px<x1; px++) {
+                if (!valid(px, py)) continue;
+                size_t v=px+py*(w+1);
+                boost::array<size_t,4> verts={{ v, v+1, v+w+2, v+w+1 }};
+                builder.add_face(verts, px+py*w);
+            }
+        }
+    }
+};
+
+
+
+BOOST_AUTO_TEST_CASE( test_block_stitcher )
+{
+    synthetic_block_reader reader;
+    reader.w=10;
+    reader.h=7;
+    reader.side=3;
+    size_t hole[4]={ 4, 2, 6, 4 };
+    std::copy(hole, hole+4, reader.hole);
+    size_t w=reader.w, h=reader.h;
+
+    // Blocks added out of order meet along seams they share.
+    Polyhedron P;
+    geodec::block_stitcher<Polyhedron,synthetic_block_reader> stitch(P, reader);
+    size_t order[][2]={ {2,1}, {0,0}, {3,2}, {1,1}, {3,0}, {0,2}, {2,0},
+                        {1,0}, {0,1}, {2,2}, {3,1}, {1,2} };
+    for (size_t b=0; b<12; b++) {
+        stitch.add_block(order[b][0], order[b][1]);
+    }
+    BOOST_CHECK(P.is_valid());
+    BOOST_CHECK_EQUAL(P.size_of_facets(), w*h-4);
+    BOOST_CHECK_EQUAL(P.size_of_vertices(), (w+1)*(h+1)-1);
+    // One border loop outside and one around the hole.
+    P.normalize_border();
+    BOOST_CHECK_EQUAL(P.size_of_border_halfedges(), 2*(w+h)+8);
+    BOOST_CHECK_EQUAL(stitch.border_count(), 2*(w+h)+8);
+
+    // Evicting leaves the blocks that remain, with their own vertices.
+    for (size_t b=0; b<11; b++) {
+        stitch.evict_block(order[b][0], order[b][1]);
+    }
+    BOOST_CHECK(P.is_valid());
+    BOOST_CHECK_EQUAL(P.size_of_facets(), 3u*1u);
+    BOOST_CHECK_EQUAL(P.size_of_vertices(), 4u*2u);
+    BOOST_CHECK_EQUAL(stitch.vertex_count(), 8u);
+    stitch.evict_block(1, 2);
+    BOOST_CHECK_EQUAL(P.size_of_halfedges(), 0u);
+
+    // A sweep of two rows of blocks holds only those rows.
+    Polyhedron Q;
+    geodec::block_stitcher<Polyhedron,synthetic_block_reader> sweeper(Q, reader);
+    std::vector<size_t> facets;
+    sweeper.sweep(2, [&](Polyhedron& R, size_t by) {
+        BOOST_CHECK(R.is_valid());
+        facets.push_back(R.size_of_facets());
+    });
+    BOOST_REQUIRE_EQUAL(facets.size(), 3u);
+    BOOST_CHECK_EQUAL(facets[0], 3*w-2);
+    BOOST_CHECK_EQUAL(facets[1], 6*w-4);
+    BOOST_CHECK_EQUAL(facets[2], 4*w-2);
+}
+
+
+
+//! Reads blocks like synthetic_block_reader, then repeats one face.
+struct repeating_block_reader : public synthetic_block_reader
+{
+    size_t repeat_x, repeat_y;
+
+    template<class BUILDER>
+    void read_block(BUILDER& builder, size_t bx, size_t by)
+    {
+        synthetic_block_reader::read_block(builder, bx, by);
+        size_t x1=std::min(w, (bx+1)*side), y1=std::min(h, (by+1)*side);
+        if (repeat_x>=bx*side && repeat_x<x1
+                && repeat_y>=by*side && repeat_y<y1) {
+            size_t v=repeat_x+repeat_y*(w+1);
+            boost::array<size_t,4> verts={{ v, v+1, v+w+2, v+w+1 }};
+            builder.add_face(verts, repeat_x+repeat_y*w);
+        }
+    }
+};
+
+
+
+BOOST_AUTO_TEST_CASE( test_block_stitcher_repeated_face )
+{
+    repeating_block_reader reader;
+    reader.w=10;
+    reader.h=7;
+    reader.side=3;
+    size_t hole[4]={ 4, 2, 6, 4 };
+    std::copy(hole, hole+4, reader.hole);
+    // The north-west cell of block (1,0). Its south and east edges are
+    // inside the block, and its north edge is on the border, so the
+    // repeat is found only at the third edge.
+    reader.repeat_x=3;
+    reader.repeat_y=2;
+
+    Polyhedron P;
+    geodec::block_stitcher<Polyhedron,repeating_block_reader> stitch(P, reader);
+    stitch.add_block(0, 0);
+    BOOST_CHECK_THROW(stitch.add_block(1, 0), std::runtime_error);
+    // The refused block leaves the complex as block (0,0) made it.
+    BOOST_CHECK(P.is_valid());
+    BOOST_CHECK(!stitch.has_block(1, 0));
+    BOOST_CHECK_EQUAL(P.size_of_facets(), 9u);
+    BOOST_CHECK_EQUAL(P.size_of_vertices(), 16u);
+    BOOST_CHECK_EQUAL(stitch.vertex_count(), 16u);
+    BOOST_CHECK_EQUAL(stitch.border_count(), 12u);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_triangle_mesh_builder )
+{
+    synthetic_block_reader reader;
+    reader.w=10;
+    reader.h=7;
+    reader.side=3;
+    size_t w=reader.w, h=reader.h;
+    // A square hole, a column of cells that fills the west side
+    // of the second column of blocks, so seams cross masked sides,
+    // and a hole that is all of block (1,1).
+    size_t holes[][4]={ { 4, 2, 6, 4 }, { 3, 0, 4, 7 }, { 3, 3, 6, 6 } };
+    size_t cell_cnt[]={ w*h-4, w*h-h, w*h-9 };
+    size_t vertex_cnt[]={ (w+1)*(h+1)-1, (w+1)*(h+1), (w+1)*(h+1)-4 };
+    size_t border_cnt[]={ 2*(w+h)+8, 2*(w+h)-2+2*h, 2*(w+h)+12 };
+    size_t read_cnt[]={ 12, 12, 11 };
+    for (int c=0; c<3; c++) {
+        std::copy(holes[c], holes[c]+4, reader.hole);
+        reader.coordinate_reads=0;
+        std::vector<boost::array<double,3>> vertices;
+        std::vector<simplex<int,2>> elements;
+        std::vector<size_t> cells;
+        triangle_mesh_builder<synthetic_block_reader> build(reader, vertices,
+                                                            elements, &cells);
+        BOOST_CHECK(build.add_block_row());
+        build.build();
+        BOOST_CHECK(!build.add_block_row());
+        BOOST_CHECK_EQUAL(elements.size(), 2*cell_cnt[c]);
+        BOOST_CHECK_EQUAL(cells.size(), cell_cnt[c]);
+        BOOST_CHECK_EQUAL(vertices.size(), vertex_cnt[c]);
+        BOOST_CHECK_EQUAL(reader.coordinate_reads, read_cnt[c]);
+
+        // No vertex is made twice along a seam.
+        std::vector<boost::array<double,3>> sorted(vertices);
+        std::sort(sorted.begin(), sorted.end());
+        BOOST_CHECK(std::adjacent_find(sorted.begin(), sorted.end())
+                    ==sorted.end());
+
+        simplex_storage<simplex<int,2>> storage;
+        storage.simplices=elements;
+        simplicial_complex<simplex_storage<simplex<int,2>>> complex(storage);
+        BOOST_CHECK_EQUAL(complex.boundary().size(), border_cnt[c]);
+
+        simplicial_mesh<std::vector<boost::array<double,3>>,
+                        std::vector<simplex<int,2>>> mesh(vertices, elements);
+    }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_rips_complex )
+{
+    // Points in clumps, so there are cliques, and some far away.
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_coord(0, 1000);
+    std::vector<planar_point> points(80);
+    for (size_t i=0; i<points.size(); i++) {
+        double scale=(i<60) ? 0.0003 : 0.01;
+        points[i][0]=rand_coord(rng)*scale+(i%3);
+        points[i][1]=rand_coord(rng)*scale;
+    }
+    double r=0.2;
+    rips_complex rips(points, r, 3);
+    std::vector<filtered_simplex> filtration;
+    rips.filtration(filtration);
+
+    // All subsets whose pairs are within r, found the slow way.
+    auto length=[&](int a, int b) {
+        double dx=points[a][0]-points[b][0], dy=points[a][1]-points[b][1];
+        return std::sqrt(dx*dx+dy*dy);
+    };
+    int n=int(points.size());
+    std::vector<filtered_simplex> expected;
+    for (int a=0; a<n; a++) {
+        filtered_simplex s={ 0, 0, {{ a, -1, -1, -1 }} };
+        expected.push_back(s);
+        for (int b=a+1; b<n; b++) {
+            double ab=length(a, b);
+            if (ab>r) continue;
+            filtered_simplex e={ ab, 1, {{ a, b, -1, -1 }} };
+            expected.push_back(e);
+            for (int c=b+1; c<n; c++) {
+                double abc=std::max(ab, std::max(length(a, c), length(b, c)));
+                if (abc>r) continue;
+                filtered_simplex t={ abc, 2, {{ a, b, c, -1 }} };
+                expected.push_back(t);
+                for (int d=c+1; d<n; d++) {
+                    double abcd=std::max(abc, std::max(length(a, d),
+                        std::max(length(b, d), length(c, d))));
+                    if (abcd>r) continue;
+                    filtered_simplex q={ abcd, 3, {{ a, b, c, d }} };
+                    expected.push_back(q);
+                }
+            }
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    BOOST_REQUIRE_EQUAL(filtration.size(), expected.size());
+    BOOST_CHECK(rips.simplex_count(3)>0);
+    for (size_t i=0; i<expected.size(); i++) {
+        BOOST_CHECK_EQUAL(filtration[i].dimension, expected[i].dimension);
+        BOOST_CHECK(filtration[i].vertex==expected[i].vertex);
+        BOOST_CHECK_EQUAL(filtration[i].value, expected[i].value);
+    }
+    BOOST_CHECK(std::is_sorted(filtration.begin(), filtration.end()));
+
+    BOOST_CHECK_THROW(rips_complex(points, r, 4), std::runtime_error);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_persistence )
+{
+    // Four corners of a unit square make one loop, from the sides
+    // until the diagonal fills it.
+    std::vector<planar_point> square(4);
+    square[1][0]=1; square[2][1]=1; square[3][0]=1; square[3][1]=1;
+    std::vector<filtered_simplex> filtration;
+    rips_complex(square, 2, 2).filtration(filtration);
+    persistence_diagram diagram;
+    persistence(filtration, diagram);
+    std::vector<double> thresholds={ 0, 0.5, 1, 1.2, 2 };
+    std::vector<size_t> betti;
+    betti_curve(diagram, 0, thresholds, betti);
+    BOOST_CHECK(betti==std::vector<size_t>({ 4, 4, 1, 1, 1 }));
+    betti_curve(diagram, 1, thresholds, betti);
+    BOOST_CHECK(betti==std::vector<size_t>({ 0, 0, 1, 1, 0 }));
+
+    // Clumps with holes between them, against reduction of the whole
+    // boundary matrix, the slow way.
+    boost::mt19937 rng;
+    boost::uniform_int<int> rand_coord(0, 1000);
+    std::vector<planar_point> points(200);
+    for (size_t i=0; i<points.size(); i++) {
+        points[i][0]=rand_coord(rng)*0.001+(i%4);
+        points[i][1]=rand_coord(rng)*0.001;
+    }
+    rips_complex(points, 0.15, 2).filtration(filtration);
+    persistence(filtration, diagram);
+
+    std::map<boost::array<int,4>,size_t> position;
+    for (size_t i=0; i<filtration.size(); i++) {
+        position[filtration[i].vertex]=i;
+    }
+    std::vector<std::vector<size_t>> columns(filtration.size());
+    for (size_t i=0; i<filtration.size(); i++) {
+        const filtered_simplex& s=filtration[i];
+        for (int omit=0; s.dimension>0 && omit<=s.dimension; omit++) {
+            boost::array<int,4> face={{ -1, -1, -1, -1 }};
+            for (int v=0, k=0; v<=s.dimension; v++) {
+                if (v!=omit) face[k++]=s.vertex[v];
+            }
+            columns[i].push_back(position[face]);
+        }
+        std::sort(columns[i].begin(), columns[i].end());
+    }
+    std::map<size_t,size_t> column_of_low;
+    std::vector<bool> paired(filtration.size(), false);
+    typedef std::tuple<int,double,double> bar;
+    std::vector<bar> expected;
+    for (size_t i=0; i<filtration.size(); i++) {
+        std::vector<size_t>& col=columns[i];
+        while (!col.empty() && column_of_low.count(col.back())) {
+            const std::vector<size_t>& other=columns[column_of_low[col.back()]];
+            std::vector<size_t> sum;
+            std::set_symmetric_difference(col.begin(), col.end(),
+                other.begin(), other.end(), std::back_inserter(sum));
+            col.swap(sum);
+        }
+        if (col.empty()) continue;
+        column_of_low[col.back()]=i;
+        paired[col.back()]=paired[i]=true;
+        const filtered_simplex& born=filtration[col.back()];
+        if (born.value<filtration[i].value) {
+            expected.push_back(bar(born.dimension, born.value,
+                                   filtration[i].value));
+        }
+    }
+    for (size_t i=0; i<filtration.size(); i++) {
+        if (!paired[i] && filtration[i].dimension<2) {
+            expected.push_back(bar(filtration[i].dimension, filtration[i].value,
+                std::numeric_limits<double>::infinity()));
+        }
+    }
+    std::vector<bar> found;
+    for (size_t i=0; i<diagram.size(); i++) {
+        found.push_back(bar(diagram.dimension[i], diagram.birth[i],
+                            diagram.death[i]));
+        BOOST_CHECK_EQUAL(filtration[diagram.birth_simplex[i]].value,
+                          diagram.birth[i]);
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    BOOST_CHECK(std::count_if(found.begin(), found.end(),
+        [](const bar& b) { return std::get<0>(b)==1; })>0);
+    BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+    BOOST_CHECK(found==expected);
+
+    // The diagram reads back from its group unchanged.
+    std::string filename("persistence_test.h5");
+    {
+        HDF_array_file file(filename);
+        write_persistence(file, diagram);
+        size_t n=diagram.size();
+        BOOST_REQUIRE_EQUAL(file.array_size("persistence/birth"), n);
+        std::vector<int> dimension(n);
+        std::vector<double> birth(n), death(n);
+        std::vector<uint64_t> birth_simplex(n), death_simplex(n);
+        file.read_array("persistence/dimension", 0, n, dimension.data());
+        file.read_array("persistence/birth", 0, n, birth.data());
+        file.read_array("persistence/death", 0, n, death.data());
+        file.read_array("persistence/birth_simplex", 0, n,
+                        birth_simplex.data());
+        file.read_array("persistence/death_simplex", 0, n,
+                        death_simplex.data());
+        BOOST_CHECK(dimension==diagram.dimension);
+        BOOST_CHECK(birth==diagram.birth);
+        BOOST_CHECK(death==diagram.death);
+        BOOST_CHECK(birth_simplex==diagram.birth_simplex);
+        BOOST_CHECK(death_simplex==diagram.death_simplex);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
 BOOST_AUTO_TEST_CASE( test_double_attach )
 {
     size_t w=3, h=5;
@@ -231,6 +1596,161 @@ BOOST_AUTO_TEST_CASE( test_double_attach )
 
 
 
+/*! Writes cells as a byte raster in square tiles, with zero for
+ *  nodata, so reads with a mask band see invalid cells.
+ */
+void write_tiled_raster(const std::string& filename, size_t w, size_t h,
+                        size_t block, std::vector<unsigned char>& cells)
+{
+    GDALAllRegister();
+    GDALDriver* driver=GetGDALDriverManager()->GetDriverByName("GTiff");
+    std::stringstream block_size;
+    block_size << block;
+    char** options=0;
+    options=CSLSetNameValue(options, "TILED", "YES");
+    options=CSLSetNameValue(options, "BLOCKXSIZE", block_size.str().c_str());
+    options=CSLSetNameValue(options, "BLOCKYSIZE", block_size.str().c_str());
+    GDALDataset* dataset=driver->Create(filename.c_str(), int(w), int(h), 1,
+                                        GDT_Byte, options);
+    CSLDestroy(options);
+    BOOST_REQUIRE(dataset!=0);
+    GDALRasterBand* band=dataset->GetRasterBand(1);
+    band->SetNoDataValue(0);
+    band->RasterIO(GF_Write, 0, 0, int(w), int(h), &cells[0], int(w), int(h),
+                   GDT_Byte, 0, 0);
+    GDALClose(dataset);
+}
+
+
+
+//! Records the vertex ids a reader sends, those its faces use, and faces.
+struct vertex_use_builder
+{
+    std::set<size_t> added;
+    std::set<size_t> used;
+    std::set<size_t> facets;
+    void add_vertex(boost::array<double,3>, size_t id) { added.insert(id); }
+    void add_face(const boost::array<size_t,4>& ids, size_t id)
+    {
+        used.insert(ids.begin(), ids.end());
+        facets.insert(id);
+    }
+};
+
+
+
+BOOST_AUTO_TEST_CASE( test_gdal_mask_band )
+{
+    // Six 16x16 blocks. Cells touch only at a corner inside block (0,0),
+    // across the seam east of it, and across the seam north of it, and
+    // block (2,1) is wholly masked.
+    size_t w=48, h=32, block=16;
+    std::string filename("mask_band_test.tif");
+    std::vector<unsigned char> cells(w*h, 1);
+    size_t masked[][2]={ {5,4}, {4,5}, {16,7}, {15,8}, {7,15}, {8,16} };
+    for (size_t m=0; m<6; m++) {
+        cells[masked[m][0]+masked[m][1]*w]=0;
+    }
+    for (size_t py=16; py<32; py++) {
+        std::fill(&cells[32+py*w], &cells[48+py*w], 0);
+    }
+    write_tiled_raster(filename, w, h, block, cells);
+
+    gdal_file reader(filename);
+    reader.set_mask_band(1);
+    vertex_use_builder builder;
+    while (reader.read_block(builder)) {}
+    BOOST_CHECK(builder.added==builder.used);
+    BOOST_CHECK_EQUAL(builder.facets.size(), w*h-6-16*16);
+    for (size_t m=0; m<6; m++) {
+        BOOST_CHECK_EQUAL(builder.facets.count(
+            reader.facet_id(masked[m][0], masked[m][1])), 0u);
+    }
+
+    // Each pinch has both vertices, and no other vertex is pinched.
+    size_t pinch[][2]={ {5,5}, {16,8}, {8,16} };
+    for (size_t p=0; p<3; p++) {
+        BOOST_CHECK_EQUAL(builder.added.count(
+            reader.vertex_id(pinch[p][0], pinch[p][1])), 1u);
+        BOOST_CHECK_EQUAL(builder.added.count(
+            reader.pinched_vertex_id(pinch[p][0], pinch[p][1])), 1u);
+    }
+    BOOST_CHECK_EQUAL(builder.added.size(), (w+1)*(h+1)+3-16*16);
+
+    // The masked block keeps only the vertices on its west and south
+    // sides, which its neighbors use.
+    BOOST_CHECK_EQUAL(builder.facets.count(reader.facet_id(40, 24)), 0u);
+    BOOST_CHECK_EQUAL(builder.added.count(reader.vertex_id(40, 24)), 0u);
+    BOOST_CHECK_EQUAL(builder.added.count(reader.vertex_id(40, 16)), 1u);
+    BOOST_CHECK_EQUAL(builder.added.count(reader.vertex_id(32, 24)), 1u);
+    BOOST_CHECK_EQUAL(builder.added.count(reader.vertex_id(48, 32)), 0u);
+    std::remove(filename.c_str());
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_gdal_pinched_block_corner )
+{
+    // Every pattern of the four cells around the vertex where four
+    // 16x16 blocks meet, with the rest of the raster valid. Only the
+    // two diagonal pairs pinch, and every vertex sent is in a face.
+    size_t w=32, h=32, block=16;
+    std::string filename("pinched_corner_test.tif");
+    for (int pattern=0; pattern<16; pattern++) {
+        std::vector<unsigned char> cells(w*h, 1);
+        cells[15+15*w]=(pattern&1) ? 1 : 0;
+        cells[16+15*w]=(pattern&2) ? 1 : 0;
+        cells[15+16*w]=(pattern&4) ? 1 : 0;
+        cells[16+16*w]=(pattern&8) ? 1 : 0;
+        write_tiled_raster(filename, w, h, block, cells);
+
+        gdal_file reader(filename);
+        reader.set_mask_band(1);
+        vertex_use_builder builder;
+        while (reader.read_block(builder)) {}
+        BOOST_CHECK(builder.added==builder.used);
+        bool pinched=(pattern==9 || pattern==6);
+        BOOST_CHECK_EQUAL(builder.added.count(
+            reader.pinched_vertex_id(16, 16)), pinched ? 1u : 0u);
+        BOOST_CHECK_EQUAL(builder.added.count(reader.vertex_id(16, 16)),
+                          pattern ? 1u : 0u);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
+BOOST_AUTO_TEST_CASE( test_stream_label_file )
+{
+    // Strips of 16 rows, resolved through label_map from the last up.
+    size_t w=40, h=37;
+    boost::mt19937 rng;
+    boost::uniform_int<unsigned char> rand_usage(1,2);
+    std::vector<unsigned char> use(w*h);
+    for (size_t gen_idx=0; gen_idx<w*h; gen_idx++) {
+        use[gen_idx]=rand_usage(rng);
+    }
+    std::vector<unsigned int> labels;
+    label_raster(w, h, raster_values_equal<unsigned char>(use.data()), labels);
+
+    std::string raster_name("stream_label_test.tif");
+    std::string cluster_name("stream_label_test.h5");
+    write_tiled_raster(raster_name, w, h, 16, use);
+    std::vector<int> ids(w*h);
+    {
+        gdal_file reader(raster_name);
+        HDF_cluster_grid_file out(cluster_name, w, h);
+        stream_label_report report=stream_label_file(reader, out, 1<<20);
+        BOOST_CHECK(report.within_ceiling());
+        out.read_rows(0, h, &ids[0]);
+    }
+    BOOST_CHECK(std::equal(ids.begin(), ids.end(), labels.begin()));
+    std::remove(raster_name.c_str());
+    std::remove(cluster_name.c_str());
+}
+
+
+
 BOOST_AUTO_TEST_CASE( gdal_io )
 {
     // grid_from_file is in quad_complex.hpp.
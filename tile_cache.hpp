@@ -0,0 +1,212 @@
+#ifndef _TILE_CACHE_HPP_
+#define _TILE_CACHE_HPP_ 1
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+namespace geodec
+{
+
+    /*! Counts from a tile_cache. */
+    struct tile_cache_stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t budget_bytes;
+    };
+
+
+
+    /*! A least-recently-used cache of decoded raster tiles, keyed by
+     *  band and block x and y. Tiles live in slots of a scratch file
+     *  mapped into memory, so a budget larger than RAM pages to that
+     *  file instead of to swap, and a later pass over the raster faults
+     *  pages back in instead of decompressing the blocks again.
+     *
+     *  Keys are dense, so the lookup is a vector indexed by key and the
+     *  recency list is threaded through an array of slots. Nothing is
+     *  allocated after construction.
+     *
+     *  The tile last returned for each band is pinned until the next
+     *  get() of that band, so reading one band never evicts the tile
+     *  another band is still using.
+     */
+    class tile_cache
+    {
+        enum { none=0xffffffffu };
+        struct slot
+        {
+            uint64_t key;
+            uint32_t prev;
+            uint32_t next;
+        };
+
+        size_t tile_bytes_;
+        size_t block_cnt_[2];
+        std::vector<uint32_t> slot_of_key_;
+        std::vector<slot> slots_;
+        //! Slot last returned for each band.
+        std::vector<uint32_t> pinned_;
+        uint32_t used_;
+        //! Most and least recently used slots.
+        uint32_t head_, tail_;
+        unsigned char* data_;
+        size_t mapped_bytes_;
+        tile_cache_stats stats_;
+
+        tile_cache(const tile_cache&);
+        tile_cache& operator=(const tile_cache&);
+    public:
+        /*! The scratch file is created or truncated and is removed from
+         *  the directory at once, so it disappears with the process.
+         *  The budget holds at least one tile per band.
+         */
+        tile_cache(const std::string& scratch_file, size_t tile_bytes,
+                   size_t band_cnt, size_t block_cnt_x, size_t block_cnt_y,
+                   size_t budget_bytes)
+            : tile_bytes_(tile_bytes),
+              slot_of_key_(band_cnt*block_cnt_x*block_cnt_y, none),
+              pinned_(band_cnt, none), used_(0), head_(none), tail_(none)
+        {
+            block_cnt_[0]=block_cnt_x;
+            block_cnt_[1]=block_cnt_y;
+            // No more slots than tiles, and at least one per band, so
+            // there is always a slot that is not pinned.
+            size_t slot_cnt=std::min(budget_bytes/tile_bytes, slot_of_key_.size());
+            slot_cnt=std::max<size_t>(slot_cnt, std::max<size_t>(band_cnt, 1));
+            slots_.resize(slot_cnt);
+            mapped_bytes_=slot_cnt*tile_bytes;
+
+            int fd=open(scratch_file.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600);
+            if (fd<0) {
+                throw std::runtime_error("Could not open tile cache "
+                                         +scratch_file);
+            }
+            unlink(scratch_file.c_str());
+            void* mapped=MAP_FAILED;
+            if (ftruncate(fd, mapped_bytes_)==0) {
+                mapped=mmap(0, mapped_bytes_, PROT_READ|PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (mapped==MAP_FAILED) {
+                std::stringstream msg;
+                msg << "Could not map " << mapped_bytes_
+                    << " bytes for tile cache " << scratch_file;
+                throw std::runtime_error(msg.str());
+            }
+            data_=static_cast<unsigned char*>(mapped);
+
+            stats_.hits=0;
+            stats_.misses=0;
+            stats_.evictions=0;
+            stats_.budget_bytes=mapped_bytes_;
+        }
+
+
+        ~tile_cache() { munmap(data_, mapped_bytes_); }
+
+
+        /*! The decoded tile, calling load(buffer) to fill it on a miss.
+         *  The pointer is valid until the next get() of the same band.
+         */
+        template<class LOADER>
+        const unsigned char* get(size_t band, size_t bx, size_t by,
+                                 LOADER load)
+        {
+            uint64_t key=bx+block_cnt_[0]*(by+block_cnt_[1]*band);
+            pinned_[band]=none;
+            uint32_t s=slot_of_key_[key];
+            if (s!=none) {
+                stats_.hits++;
+                touch(s);
+                pinned_[band]=s;
+                return data_+s*tile_bytes_;
+            }
+
+            stats_.misses++;
+            if (used_<slots_.size()) {
+                s=used_++;
+            } else {
+                s=tail_;
+                while (is_pinned(s)) s=slots_[s].prev;
+                unlink_slot(s);
+                if (slots_[s].key!=empty_key()) {
+                    slot_of_key_[slots_[s].key]=none;
+                    stats_.evictions++;
+                }
+            }
+            unsigned char* tile=data_+s*tile_bytes_;
+            try {
+                load(tile);
+            } catch (...) {
+                // The slot goes back empty, first in line for reuse.
+                slots_[s].key=empty_key();
+                push_back(s);
+                throw;
+            }
+            slots_[s].key=key;
+            slot_of_key_[key]=s;
+            push_front(s);
+            pinned_[band]=s;
+            return tile;
+        }
+
+
+        const tile_cache_stats& stats() const { return stats_; }
+        size_t tile_bytes() const { return tile_bytes_; }
+
+    private:
+        uint64_t empty_key() const { return slot_of_key_.size(); }
+
+        bool is_pinned(uint32_t s) const
+        {
+            uint64_t key=slots_[s].key;
+            if (key==empty_key()) return false;
+            return pinned_[key/(block_cnt_[0]*block_cnt_[1])]==s;
+        }
+
+        void touch(uint32_t s)
+        {
+            if (head_==s) return;
+            unlink_slot(s);
+            push_front(s);
+        }
+
+        void unlink_slot(uint32_t s)
+        {
+            slot& x=slots_[s];
+            if (x.prev!=none) slots_[x.prev].next=x.next; else head_=x.next;
+            if (x.next!=none) slots_[x.next].prev=x.prev; else tail_=x.prev;
+        }
+
+        void push_front(uint32_t s)
+        {
+            slots_[s].prev=none;
+            slots_[s].next=head_;
+            if (head_!=none) slots_[head_].prev=s; else tail_=s;
+            head_=s;
+        }
+
+        void push_back(uint32_t s)
+        {
+            slots_[s].next=none;
+            slots_[s].prev=tail_;
+            if (tail_!=none) slots_[tail_].next=s; else head_=s;
+            tail_=s;
+        }
+    };
+
+}
+
+
+#endif // _TILE_CACHE_HPP_
@@ -0,0 +1,227 @@
+#ifndef _TRIANGLE_MESH_HPP_
+#define _TRIANGLE_MESH_HPP_ 1
+
+#include <vector>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <boost/array.hpp>
+#include "simplex.hpp"
+#include "gdal_io.hpp"
+
+
+namespace geodec
+{
+
+    /*! Triangulates the valid cells of a raster into flat vectors of
+     *  vertex coordinates and simplex<INDEX,2> elements, as
+     *  simplicial_mesh takes them. Each cell becomes two triangles
+     *  split along the diagonal from its lower corner, and both are
+     *  oriented alike, so interior edges cancel in the boundary.
+     *
+     *  Blocks are read a row of blocks at a time, left to right. A
+     *  vertex gets its index from the first block that needs it. The
+     *  indices along seams are passed on in two rows of raster width,
+     *  for the seams below and above the row of blocks, and a column
+     *  of block height, for the seam to the west. No map from vertex
+     *  ids is kept, so memory beyond the output is about one block.
+     *
+     *  With a mask band set on the reader, invalid cells get no
+     *  triangles and only vertices of valid cells are kept. Two cells
+     *  that meet only at a corner share that vertex, which a
+     *  simplicial complex allows.
+     *
+     *  READER has size(), block_size(), block_count(), block_extent(),
+     *  block_validity(), vertex_coordinates() and facet_id(), as
+     *  gdal_file does.
+     */
+    template<class READER=gdal_file, class INDEX=int>
+    class triangle_mesh_builder
+    {
+    public:
+        typedef boost::array<double,3> vertex_type;
+        typedef simplex<INDEX,2> element_type;
+    private:
+        READER& reader_;
+        std::vector<vertex_type>& vertices_;
+        std::vector<element_type>& elements_;
+        std::vector<size_t>* cells_;
+        boost::array<size_t,2> block_cnt_;
+        size_t by_;
+        //! Vertex indices along the seams below and above the block row.
+        std::vector<INDEX> south_;
+        std::vector<INDEX> north_;
+        //! Vertex indices along the east edge of the last block.
+        std::vector<INDEX> west_;
+        //! Vertex indices of the block being read.
+        std::vector<INDEX> local_;
+        std::vector<double> x_, y_, z_;
+
+        static const INDEX npos;
+
+        INDEX new_vertex(size_t k)
+        {
+            if (vertices_.size()>=size_t(std::numeric_limits<INDEX>::max())) {
+                std::stringstream msg;
+                msg << "More than " << std::numeric_limits<INDEX>::max()
+                    << " vertices for the index type of the mesh";
+                throw std::runtime_error(msg.str());
+            }
+            vertex_type v={{ x_[k], y_[k], z_[k] }};
+            vertices_.push_back(v);
+            return INDEX(vertices_.size()-1);
+        }
+
+        void add_triangle(INDEX a, INDEX b, INDEX c)
+        {
+            INDEX verts[3]={ a, b, c };
+            element_type tri;
+            tri.assign(verts, 0);
+            elements_.push_back(tri);
+        }
+
+        //! Triangulates block (bx,by), the next in its row of blocks.
+        void add_block(size_t bx, size_t by)
+        {
+            boost::array<size_t,4> ind=reader_.block_extent(bx, by);
+            size_t x0=ind[0], y0=ind[1], w=ind[2], h=ind[3];
+            size_t row=w+1;
+            const unsigned char* valid=reader_.block_validity(bx, by);
+            size_t hw=reader_.block_size()[0]+2;
+            // Validity of cell (px,py) of the block, which may be in the
+            // ring around it, so px and py run from -1.
+            auto cell=[&](long px, long py) -> bool {
+                return 0==valid || valid[(px+1)+(py+1)*hw];
+            };
+            // A block with no valid cell adds nothing and leaves no
+            // vertices for the block to its east.
+            if (valid) {
+                bool any=false;
+                for (size_t j=0; j<h && !any; j++) {
+                    for (size_t i=0; i<w && !any; i++) {
+                        any=cell(long(i), long(j));
+                    }
+                }
+                if (!any) {
+                    west_.assign(h+1, npos);
+                    return;
+                }
+            }
+
+            size_t n=row*(h+1);
+            x_.resize(n);
+            y_.resize(n);
+            z_.resize(n);
+            reader_.vertex_coordinates(ind, &x_[0], &y_[0], &z_[0]);
+
+            local_.assign(n, npos);
+            for (size_t j=0; j<=h; j++) {
+                for (size_t i=0; i<=w; i++) {
+                    long pi=long(i), pj=long(j);
+                    if (valid && !(cell(pi-1, pj-1) || cell(pi, pj-1)
+                                   || cell(pi-1, pj) || cell(pi, pj))) {
+                        continue;
+                    }
+                    INDEX v=npos;
+                    if (j==0 && y0>0) v=south_[x0+i];
+                    if (v==npos && i==0 && x0>0) v=west_[j];
+                    if (v==npos) v=new_vertex(i+j*row);
+                    local_[i+j*row]=v;
+                }
+            }
+
+            west_.resize(h+1);
+            for (size_t j=0; j<=h; j++) {
+                west_[j]=local_[w+j*row];
+            }
+            // Two blocks share the corner above a seam. Keep whichever
+            // of them has it.
+            for (size_t i=0; i<=w; i++) {
+                if (local_[i+h*row]!=npos) north_[x0+i]=local_[i+h*row];
+            }
+
+            for (size_t j=0; j<h; j++) {
+                for (size_t i=0; i<w; i++) {
+                    if (!cell(long(i), long(j))) continue;
+                    INDEX v00=local_[i+j*row], v10=local_[i+1+j*row];
+                    INDEX v01=local_[i+(j+1)*row], v11=local_[i+1+(j+1)*row];
+                    add_triangle(v00, v10, v11);
+                    add_triangle(v00, v11, v01);
+                    if (cells_) cells_->push_back(reader_.facet_id(x0+i, y0+j));
+                }
+            }
+        }
+
+
+    public:
+        /*! Elements are appended to elements. Given cells, the facet_id
+         *  of the raster cell of each pair of elements is appended to it.
+         */
+        triangle_mesh_builder(READER& reader, std::vector<vertex_type>& vertices,
+                              std::vector<element_type>& elements,
+                              std::vector<size_t>* cells=0)
+            : reader_(reader), vertices_(vertices), elements_(elements),
+              cells_(cells), block_cnt_(reader.block_count()), by_(0)
+        {
+            size_t w=reader.size()[0];
+            south_.assign(w+1, npos);
+            north_.assign(w+1, npos);
+        }
+
+
+        /*! Triangulates the next row of blocks. Returns false once
+         *  every row has been read.
+         */
+        bool add_block_row()
+        {
+            if (by_>=block_cnt_[1]) return false;
+            for (size_t bx=0; bx<block_cnt_[0]; bx++) {
+                add_block(bx, by_);
+            }
+            south_.swap(north_);
+            std::fill(north_.begin(), north_.end(), npos);
+            by_++;
+            return true;
+        }
+
+
+        //! Triangulates every row of blocks that is left.
+        void build()
+        {
+            while (add_block_row()) {}
+        }
+    };
+
+
+    template<class READER, class INDEX>
+    const INDEX triangle_mesh_builder<READER,INDEX>::npos=
+        std::numeric_limits<INDEX>::max();
+
+
+
+    /*! Triangulates a raster datafile into vertices and elements, for a
+     *  simplicial_mesh. With a mask band, cells that band's nodata value
+     *  or mask marks invalid get no triangles.
+     */
+    template<class INDEX>
+    void triangles_from_file(const std::string& filename,
+                             std::vector<boost::array<double,3>>& vertices,
+                             std::vector<simplex<INDEX,2>>& elements,
+                             size_t mask_band=0)
+    {
+        gdal_file reader(filename);
+        reader.set_mask_band(mask_band);
+        if (0==mask_band) {
+            boost::array<size_t,2> size=reader.size();
+            vertices.reserve(vertices.size()+(size[0]+1)*(size[1]+1));
+            elements.reserve(elements.size()+2*size[0]*size[1]);
+        }
+        triangle_mesh_builder<gdal_file,INDEX> build(reader, vertices,
+                                                     elements);
+        build.build();
+    }
+
+}
+
+
+#endif // _TRIANGLE_MESH_HPP_
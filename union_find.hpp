@@ -1,10 +1,15 @@
 #include <set>
 #include <list>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
 #include <functional>
+#include <boost/array.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/pending/disjoint_sets.hpp>
 #include <boost/iterator/iterator_facade.hpp>
-#include "CGAL/centroid.h"
+#include "disjoint_sets.hpp"
 
 
 namespace geodec
@@ -12,14 +17,16 @@ namespace geodec
 
 
     /*! I have an iterator to facets but want an iterator to facet ids.
-     *  FITER is a Facet_const_iterator.
+     *  FITER is a Facet_const_iterator. Ids are returned by value
+     *  because meshes like implicit_grid compute them.
      */
     template<class FITER>
     class facet_id_iterator
         : public boost::iterator_facade<
         facet_id_iterator<FITER>,
         const size_t,
-        boost::forward_traversal_tag
+        boost::forward_traversal_tag,
+        size_t
         >
     {
         FITER m_;
@@ -33,7 +40,7 @@ namespace geodec
         {
             return this->m_ == other.m_;
         }
-        const size_t& dereference() const { return m_->id(); }
+        size_t dereference() const { return m_->id(); }
     };
 
 
@@ -48,11 +55,46 @@ namespace geodec
 	
 	
 	
+    /*! What disjoint_set_cluster learns about one cluster.
+     *  The id is the smallest facet id in the cluster. The centroid
+     *  is weighted by area, and the representative is the facet whose
+     *  centroid is nearest it. A border cluster touches the edge of
+     *  the complex.
+     */
+    struct cluster_summary
+    {
+        size_t id;
+        size_t cell_count;
+        double area;
+        boost::array<double,2> centroid;
+        size_t representative;
+        bool border;
+    };
+
+
+    /*! Two clusters, by index into the list of summaries with a<b,
+     *  and the length of the border between them.
+     */
+    struct cluster_adjacency
+    {
+        size_t a;
+        size_t b;
+        double border_length;
+        bool operator<(const cluster_adjacency& o) const {
+            return a<o.a || (a==o.a && b<o.b);
+        }
+    };
+
+
+
     /*! This functor runs adds faces of a complex to a disjoint_set.
      * Region is a CGAL Polyhedron.
      * Compare is the type of a functor that compares two faces.
+     * DSET is the union-find storage. hashed_disjoint_sets accepts any
+     * facet ids. dense_disjoint_sets<> is much faster when facet ids
+     * are dense, as they are from Build_grid and add_from_file.
      */
-    template<class Region,class Compare>
+    template<class Region,class Compare,class DSET=hashed_disjoint_sets>
 	class disjoint_set_cluster
 	{
     public:
@@ -61,37 +103,29 @@ namespace geodec
         typedef typename Region::Halfedge_around_facet_const_circulator
                                                 HF_const_circulator;
 
-        //! Maps from element to count of elements in set.
-        typedef boost::unordered_map<size_t,size_t> rank_t;
-        //! Maps from element to parent of element.
-        typedef boost::unordered_map<size_t,size_t> parent_t;
-        typedef boost::associative_property_map<rank_t> rank_pmap_t;
-        typedef boost::associative_property_map<parent_t> parent_pmap_t;
-      
-        typedef boost::disjoint_sets<rank_pmap_t,parent_pmap_t> dset_t;
-
-        rank_t        rank_map_;
-        parent_t      parent_map_;
-        rank_pmap_t   rank_pmap_;
-        parent_pmap_t parent_pmap_;
+        typedef DSET dset_t;
         dset_t        dset_;
 
+        //! One entry per cluster, filled by operator().
+        std::vector<cluster_summary> clusters_;
+        //! Pairs of clusters that share edges, each pair once, sorted.
+        std::vector<cluster_adjacency> adjacency_;
+
         Compare compare_;
     public:
 
-        disjoint_set_cluster(Compare compare) : compare_(compare),
-                rank_pmap_(rank_map_), parent_pmap_(parent_map_),
-                dset_(rank_pmap_,parent_pmap_)
+        disjoint_set_cluster(Compare compare) : compare_(compare)
         {
         }
 
 
         void operator()(const Region& region) {
             size_t facet_cnt=0;
+            dset_.reserve(region.size_of_facets());
             Facet_const_iterator last_facet = region.facets_end();
             Facet_const_iterator f = region.facets_begin();
             do {
-                if (parent_map_.find(f->id())==parent_map_.end()) {
+                if (!dset_.has_set(f->id())) {
                     dset_.make_set(f->id());
                 }
                 HF_const_circulator h = f->facet_begin();
@@ -99,7 +133,7 @@ namespace geodec
                     typename Region::Halfedge_const_handle opp = h->opposite();
                     if ( !opp->is_border() ) {
                         Facet_const_handle g = opp->facet();
-                        if (parent_map_.find(g->id())==parent_map_.end()) {
+                        if (!dset_.has_set(g->id())) {
                             dset_.make_set(g->id());
                         }
                         if (compare_(f->id(),g->id())) {
@@ -119,78 +153,170 @@ namespace geodec
                                                 region.facets_end());
             dset_.compress_sets(id_begin, id_end);
 
-			// Walk clusters in order to find representatives and neighbors.
-            std::list<Facet_const_iterator> unexplored;
-            unexplored.push_back(region.facets_begin());
-			std::map<size_t,size_t> edges;
+            summarize(region);
+        }
 
-			typedef typename Region::Point_3 Point_3;
-			typedef typename Region::Traits::Kernel::Vector_3 Vector_3;
-			
-            while (!unexplored.empty()) {
-                auto f=unexplored.front();
-                unexplored.pop_front();
-                bool border_cluster=false;
 
-				size_t id = parent_map_[f->id()];
+        //! Index in clusters_ of the cluster of a facet.
+        size_t cluster_index(size_t facet_id) {
+            return index_[dset_.find_set(facet_id)];
+        }
 
-                std::list<Facet_const_iterator> cluster_next;
-                cluster_next.push_back(f);
-                std::set<Facet_const_iterator> cluster_seen;
-				typedef std::map<Point_3,size_t> centroid_type;
-				centroid_type centroids;
-                while (!cluster_next.empty()) {
-                    auto next=cluster_next.front();
-                    cluster_next.pop_front();
-                    cluster_seen.insert(next);
+    private:
+        /*! Fills clusters_ and adjacency_ after the sets are compressed.
+         *  One scan over facets accumulates area, centroid, border
+         *  flags and the halfedges between clusters, and a second scan
+         *  picks the facet nearest each centroid. The only storage is
+         *  flat: index_ by facet id, the summaries, and the list of
+         *  cluster pairs, which is sorted and merged once at the end.
+         *  Clusters are numbered in the order facets are visited.
+         */
+        void summarize(const Region& region)
+        {
+            const size_t npos=size_t(-1);
+            size_t extent=0;
+            for (auto f=region.facets_begin(); f!=region.facets_end(); ++f) {
+                extent=std::max(extent, size_t(f->id())+1);
+            }
+            index_.assign(extent, npos);
+            clusters_.clear();
+            adjacency_.clear();
+
+            for (auto f=region.facets_begin(); f!=region.facets_end(); ++f) {
+                size_t root=dset_.find_set(f->id());
+                if (index_[root]==npos) {
+                    index_[root]=clusters_.size();
+                    cluster_summary summary;
+                    summary.id=f->id();
+                    summary.cell_count=0;
+                    summary.area=0;
+                    summary.centroid[0]=0;
+                    summary.centroid[1]=0;
+                    summary.representative=f->id();
+                    summary.border=false;
+                    clusters_.push_back(summary);
+                }
+                cluster_summary& summary=clusters_[index_[root]];
+                summary.id=std::min(summary.id, size_t(f->id()));
 
-					Vector_3 midpoint;
-					size_t vertex_cnt=0;
-                    HF_const_circulator h = next->facet_begin();
-                    do {
-						vertex_cnt++;
-						midpoint=midpoint+Vector_3(CGAL::ORIGIN, h->vertex()->point());
-	
-                        typename Region::Halfedge_const_handle opp = h->opposite();
-                        if ( !opp->is_border() ) {
-                            Facet_const_handle g = opp->facet();
-							bool b_seen=(cluster_seen.find(g)!=cluster_seen.end());
-							if (!b_seen) {
-								size_t gparent=parent_map_[g->id()];
-                            	if (gparent == id) {
-	                                cluster_next.push_back(g);
-	                            } else {
-									edges.insert(std::pair<size_t,size_t>(id, gparent));
-                            	}
-							}
-                        } else {
-                            border_cluster=true;
-                        }
-                    } while ( ++h != next->facet_begin() );
-					midpoint = midpoint / vertex_cnt;
-					centroids.insert(std::pair<Point_3,size_t>(CGAL::ORIGIN+midpoint, f->id()));
-                } // !cluster_next.empty()
+                double area;
+                boost::array<double,2> centroid;
+                facet_geometry(f, area, centroid);
+                summary.cell_count++;
+                summary.area+=area;
+                summary.centroid[0]+=area*centroid[0];
+                summary.centroid[1]+=area*centroid[1];
 
-				typedef pair_get_first<typename centroid_type::value_type> centroid_get_pt;
-				typedef boost::transform_iterator<centroid_get_pt,typename centroid_type::const_iterator>
-					cent_pt_type;
-				cent_pt_type cent_begin(centroids.begin(), centroid_get_pt());
-				cent_pt_type cent_end(centroids.end(), centroid_get_pt());
-				Point_3 cluster_centroid = CGAL::centroid(cent_begin, cent_end);
-				
-				// Find id of cluster that is closest to centroid.
-				auto close_begin=centroids.begin();
-				auto close_end=centroids.end();
-				auto closest=close_begin;
-				while (close_begin!=close_end) {
-					if (CGAL::has_smaller_distance_to_point(cluster_centroid,close_begin->first,closest->first))
-					{
-						closest=close_begin;
-					}
-					close_begin++;
-				}
-            } // !unexplored.empty()
+                HF_const_circulator h = f->facet_begin();
+                do {
+                    typename Region::Halfedge_const_handle opp = h->opposite();
+                    if (opp->is_border()) {
+                        summary.border=true;
+                        continue;
+                    }
+                    // Each shared edge is seen from both sides. Keep one.
+                    size_t other=dset_.find_set(opp->facet()->id());
+                    if (other<=root) continue;
+                    double length=edge_length(h);
+                    if (!adjacency_.empty() && adjacency_.back().a==root
+                            && adjacency_.back().b==other) {
+                        adjacency_.back().border_length+=length;
+                    } else {
+                        cluster_adjacency edge;
+                        edge.a=root;
+                        edge.b=other;
+                        edge.border_length=length;
+                        adjacency_.push_back(edge);
+                    }
+                } while ( ++h != f->facet_begin() );
+            }
+
+            for (auto c=clusters_.begin(); c!=clusters_.end(); ++c) {
+                if (c->area>0) {
+                    c->centroid[0]/=c->area;
+                    c->centroid[1]/=c->area;
+                }
+            }
+
+            std::vector<double> nearest(clusters_.size(),
+                                        std::numeric_limits<double>::max());
+            for (auto f=region.facets_begin(); f!=region.facets_end(); ++f) {
+                size_t idx=index_[dset_.find_set(f->id())];
+                double area;
+                boost::array<double,2> centroid;
+                facet_geometry(f, area, centroid);
+                double dx=centroid[0]-clusters_[idx].centroid[0];
+                double dy=centroid[1]-clusters_[idx].centroid[1];
+                double distance=dx*dx+dy*dy;
+                if (distance<nearest[idx]) {
+                    nearest[idx]=distance;
+                    clusters_[idx].representative=f->id();
+                }
+            }
+
+            for (auto e=adjacency_.begin(); e!=adjacency_.end(); ++e) {
+                e->a=index_[e->a];
+                e->b=index_[e->b];
+                if (e->a>e->b) std::swap(e->a, e->b);
+            }
+            std::sort(adjacency_.begin(), adjacency_.end());
+            size_t kept=0;
+            for (size_t i=0; i<adjacency_.size(); i++) {
+                if (kept>0 && adjacency_[kept-1].a==adjacency_[i].a
+                        && adjacency_[kept-1].b==adjacency_[i].b) {
+                    adjacency_[kept-1].border_length+=adjacency_[i].border_length;
+                } else {
+                    adjacency_[kept++]=adjacency_[i];
+                }
+            }
+            adjacency_.resize(kept);
         }
+
+
+        /*! Area and centroid of a facet in x and y, by the shoelace
+         *  formula, measured from its first vertex to keep precision
+         *  with projected coordinates.
+         */
+        void facet_geometry(Facet_const_iterator f, double& area,
+                            boost::array<double,2>& centroid) const
+        {
+            HF_const_circulator h = f->facet_begin();
+            auto origin=h->vertex()->point();
+            double x0=0, y0=0;
+            double twice_area=0, cx=0, cy=0;
+            do {
+                ++h;
+                auto p=h->vertex()->point();
+                double x1=p.x()-origin.x(), y1=p.y()-origin.y();
+                double cross=x0*y1-x1*y0;
+                twice_area+=cross;
+                cx+=(x0+x1)*cross;
+                cy+=(y0+y1)*cross;
+                x0=x1;
+                y0=y1;
+            } while ( h != f->facet_begin() );
+            area=std::fabs(twice_area)/2;
+            if (twice_area!=0) {
+                centroid[0]=origin.x()+cx/(3*twice_area);
+                centroid[1]=origin.y()+cy/(3*twice_area);
+            } else {
+                centroid[0]=origin.x();
+                centroid[1]=origin.y();
+            }
+        }
+
+
+        template<class HALFEDGE>
+        double edge_length(const HALFEDGE& h) const
+        {
+            auto a=h->vertex()->point();
+            auto b=h->opposite()->vertex()->point();
+            double dx=a.x()-b.x(), dy=a.y()-b.y();
+            return std::sqrt(dx*dx+dy*dy);
+        }
+
+        //! Index in clusters_ of each root facet id.
+        std::vector<size_t> index_;
     };
 
 